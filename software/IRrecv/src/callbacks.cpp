@@ -10,42 +10,112 @@
 #include <espnow.h>
 #include "messages.h"
 #include "callbacks.h"
+#include "latency.h"
+#include "logring.h"
+#include "delivery.h"
+#include "peers.h"
+#include "link.h"
+#include "events.h"
 
-// Pointer to received data
-static struct_message_rcv *rcvData_p;
-static size_t rcvDataSize = 0;
-static volatile bool *wifiConnectError;     // pointer to overall indication of whether there is a connection error (FALSE is good)
+static uint8_t *peerStats_p;                // MSG_STATS reply of an IRsend
+static volatile uint8_t *peerStatsLen;      // its length, 0 until one arrives
+static volatile uint8_t *peerStatsFrom;     // peer number of the IRsend it came from
 
 
 
+// Answer an IRsend's MSG_TIME_REQ, which came in at micros() receiveUs, with
+// our clock. Sent right from the callback, so the time it took stays short.
+static void sendTime( uint8_t *mac, const struct_time_hdr *req, uint32_t receiveUs )
+{
+    struct_time_hdr reply;
+
+    reply.msg_type = MSG_TIME;
+    reply.requestUs = req->requestUs;
+    reply.receiveUs = receiveUs;
+    reply.replyUs = micros();
+    linkSend( mac, &reply, sizeof(reply) );
+}
+
 // Setup needed callback function data
-void callbacksInit( struct_message_rcv *ptr, size_t size, volatile bool *connectError )
+void callbacksInit( uint8_t *peerStats, volatile uint8_t *statsLen, volatile uint8_t *statsFrom )
 {
-    rcvData_p = ptr;
-    rcvDataSize = size;
-    wifiConnectError = connectError;
+    peerStats_p = peerStats;
+    peerStatsLen = statsLen;
+    peerStatsFrom = statsFrom;
 }
 
 // Callback function called when data is sent
 void OnDataSent( uint8_t *mac_addr, uint8_t  status )
 {
-    if( status == 0 )
+    bool marked;
+    uint32_t sendUs = linkSendDone( &marked );
+
+    // The last packet of a frame, the radio is done with it
+    if( marked )
+        latencyEvent( STAGE_RADIO );
+
+    struct_logrec *rec = logNew( status == 0 ? LOG_DEBUG : LOG_ERROR, LOG_EV_SENT );
+
+    if( rec != NULL )
+        rec->success = ( status == 0 );
+
+    peersSent( mac_addr, status, sendUs, millis() );
+
+    return;
+}
+
+// Handle one message from the IRsend peer, on its own or out of a batch
+static void receive( uint8_t *mac, int8_t peer, const uint8_t *incomingData, uint8_t len, uint32_t receiveUs )
+{
+    if( len >= sizeof(struct_IRack_hdr) && incomingData[0] == MSG_IR_ACK )
     {
-        *wifiConnectError = false;
-        Serial.println("Message sent successfully!");
+        deliveryAck( peer, ((const struct_IRack_hdr *)incomingData)->frameId );
+        return;
     }
-    else
+
+    if( len == sizeof(struct_time_hdr) && incomingData[0] == MSG_TIME_REQ )
     {
-        *wifiConnectError = true;
-        Serial.println("Message send error!");
+        sendTime( mac, (const struct_time_hdr *)incomingData, receiveUs );
+        return;
     }
 
-    return;
+    if( len >= sizeof(struct_IRmiss_hdr) && incomingData[0] == MSG_IR_MISS )
+    {
+        deliveryMiss( peer, ((const struct_IRmiss_hdr *)incomingData)->frameId );
+        return;
+    }
+
+    // Keep a stats reply for loop() to print, unless it still has one to print
+    if( len != 0 && incomingData[0] == MSG_STATS )
+    {
+        if( *peerStatsLen == 0 )
+        {
+            memcpy( peerStats_p, incomingData, len );
+            *peerStatsFrom = peer;
+            *peerStatsLen = len;
+        }
+    }
 }
 
 // // Callback function executed when data is received
 void OnDataRecv( uint8_t *mac, uint8_t *incomingData, uint8_t len )
 {
-     // Get receievd data
-     memcpy(rcvData_p, incomingData, rcvDataSize );
-}
\ No newline at end of file
+    uint32_t receiveUs = micros();
+    int8_t peer = peersFind( mac );
+    uint8_t offset = 0;
+    uint8_t msgLen;
+    const uint8_t *msg;
+
+    // Only our IRsend nodes are listened to. Anything they send, their
+    // heartbeat included, shows their link is up.
+    if( peer < 0 )
+        return;
+
+    peersHeard( peer, incomingData, len, millis() );
+
+    while(( msg = linkNext( incomingData, len, &offset, &msgLen )) != NULL )
+        receive( mac, peer, msg, msgLen, receiveUs );
+
+    // Stats replies are printed from loop()
+    eventPost( EVENT_RADIO );
+}
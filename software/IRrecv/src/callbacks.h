@@ -8,6 +8,6 @@
 */
 #include <espnow.h>
 
-void callbacksInit( struct_message_rcv *, size_t, volatile bool * );
+void callbacksInit( uint8_t *, volatile uint8_t *, volatile uint8_t * );
 void OnDataSent( uint8_t *, uint8_t status );
 void OnDataRecv( uint8_t *mac, uint8_t *incomingData, uint8_t len );
\ No newline at end of file
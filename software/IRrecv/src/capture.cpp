@@ -0,0 +1,141 @@
+/*
+ *  IRrecv:  capture.cpp - Double-buffered IR capture pipeline.
+ *
+ *  The ISR captures into the buffer owned by IRrecv and stops once a frame is
+ *  complete. captureGrab() copies the frame out into a free slot, which re-arms
+ *  the ISR straight away, and then decodes the copy. Encoding and sending
+ *  happen from that slot while the ISR is already catching the next frame
+ *  into its own buffer. A frame frameend.cpp knows to be complete is stopped
+ *  before the ISR's timeout, stream.cpp sends on long ones as they grow and
+ *  noise.cpp drops those that are noise before they are decoded. trace.cpp
+ *  records them all, when it's on.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include "capture.h"
+#include "frameend.h"
+#include "stream.h"
+#include "noise.h"
+#include "trace.h"
+
+namespace _IRrecv
+{
+extern volatile irparams_t params;
+}
+
+typedef struct struct_capture_slot
+{
+    decode_results results;     // decoded capture, rawbuf points into save
+    irparams_t save;            // copy of the ISR state when the capture ended
+    uint32_t grabTime;          // micros() when the capture was copied out
+    uint32_t decodeTime;        // usecs decode() took to copy and decode it
+    int16_t streamId;           // frameId it was streamed under, -1 if it wasn't
+} struct_capture_slot;
+
+static IRrecv *irrecv_p;
+static struct_capture_slot slots[CAPTURE_SLOTS];
+static uint8_t first = 0;       // oldest slot holding a capture
+static uint8_t count = 0;       // slots holding a capture
+
+// Allocate the slot buffers, bufSize must match the one IRrecv was created with
+void captureInit( IRrecv *recv, uint16_t bufSize )
+{
+    irrecv_p = recv;
+
+    for( uint8_t i = 0; i < CAPTURE_SLOTS; i++ )
+    {
+        slots[i].save.rawbuf = new uint16_t[bufSize];
+        slots[i].save.bufsize = bufSize;
+    }
+}
+
+// Move a completed capture out of the ISR buffer into a free slot.
+// decode() copies the ISR state into our save buffer and resumes the
+// capture before it runs the decoders.
+// Returns true when a capture was grabbed.
+bool captureGrab( void )
+{
+    // Don't wait out the timeout if the frame is already complete, and send
+    // on what came in of a long one unless it looks like noise
+    frameEndCheck();
+    noiseScan();
+    streamPoll();
+
+    if( count >= CAPTURE_SLOTS )
+        return false;
+
+    // Only a capture the ISR stopped is judged and decoded, else it could
+    // stop in between and be decoded without being judged
+    if( _IRrecv::params.rcvstate != kStopState )
+        return false;
+
+    // Noise doesn't get decoded, let alone sent
+    if( noiseReject() )
+    {
+        traceNoise( _IRrecv::params.rawbuf, _IRrecv::params.rawlen, _IRrecv::params.overflow, micros() );
+        irrecv_p->resume();
+        return false;
+    }
+
+    struct_capture_slot *slot = &slots[(first + count) % CAPTURE_SLOTS];
+
+    uint32_t start = micros();
+
+    if( !irrecv_p->decode( &slot->results, &slot->save ))
+        return false;
+
+    slot->grabTime = start;
+    slot->decodeTime = micros() - start;
+
+    traceCapture( &slot->results, start );
+
+    slot->streamId = streamEnd( &slot->results );
+    frameEndCaptured();
+
+    ++ count;
+
+    return true;
+}
+
+// The ISR has edges of a capture, or one it stopped waits to be grabbed
+bool captureActive( void )
+{
+    return _IRrecv::params.rawlen != 0 || _IRrecv::params.rcvstate == kStopState;
+}
+// Get the oldest grabbed capture, NULL if there is none
+decode_results *captureNext( void )
+{
+    if( count == 0 )
+        return NULL;
+
+    return &slots[first].results;
+}
+
+// micros() when the capture returned by captureNext() was copied out
+uint32_t captureGrabTime( void )
+{
+    return slots[first].grabTime;
+}
+
+// Time in usecs it took to decode the capture returned by captureNext()
+uint32_t captureDecodeTime( void )
+{
+    return slots[first].decodeTime;
+}
+
+// frameId the capture returned by captureNext() was streamed under, -1 if it
+// wasn't streamed
+int16_t captureStreamId( void )
+{
+    return slots[first].streamId;
+}
+
+// Free the slot returned by captureNext()
+void captureRelease( void )
+{
+    if( count == 0 )
+        return;
+
+    first = (first + 1) % CAPTURE_SLOTS;
+    -- count;
+}
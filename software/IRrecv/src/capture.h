@@ -0,0 +1,21 @@
+/*
+ *  IRrecv:  capture.h - Double-buffered IR capture pipeline.
+*/
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <IRrecv.h>
+
+// Number of captures that can be held while the oldest one is being sent
+#define CAPTURE_SLOTS   2
+
+void captureInit( IRrecv *recv, uint16_t bufSize );
+bool captureGrab( void );
+bool captureActive( void );
+decode_results *captureNext( void );
+uint32_t captureGrabTime( void );
+uint32_t captureDecodeTime( void );
+int16_t captureStreamId( void );
+void captureRelease( void );
+
+#endif  // CAPTURE_H
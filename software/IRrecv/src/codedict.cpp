@@ -0,0 +1,78 @@
+/*
+ *  IRrecv:  codedict.cpp - Codes the IRsend nodes have learned.
+ *
+ *  An IRsend learns every frame it emits under its code id (see codekey.cpp),
+ *  so once it has acknowledged a frame sent in full, the same button only
+ *  needs its code. This remembers which nodes acknowledged which code. It
+ *  starts out empty after a reboot, the first press of each button then goes
+ *  out in full again. A node that lost a code answers with a MSG_IR_MISS.
+*/
+#include <Arduino.h>
+#include "codedict.h"
+
+typedef struct struct_dict_code
+{
+    uint32_t code;          // 0 while the entry is free
+    uint8_t peers;          // mask of the nodes that have it
+    uint32_t lastUsed;      // uses counter when it was last used
+} struct_dict_code;
+
+static struct_dict_code codes[CODEDICT_SIZE];
+static uint32_t uses = 0;
+
+static int8_t codeDictFind( uint32_t code )
+{
+    for( uint8_t i = 0; i < CODEDICT_SIZE; i++ )
+    {
+        if( codes[i].code == code && code != 0 )
+            return i;
+    }
+
+    return -1;
+}
+
+// Mask of the nodes that have code
+uint8_t codeDictPeers( uint32_t code )
+{
+    int8_t i = codeDictFind( code );
+
+    if( i < 0 )
+        return 0;
+
+    codes[i].lastUsed = ++ uses;
+
+    return codes[i].peers;
+}
+
+// Node number peer acknowledged the frame of code sent in full. Past
+// CODEDICT_SIZE codes, the one used longest ago is forgotten.
+void codeDictLearned( uint32_t code, uint8_t peer )
+{
+    int8_t i = codeDictFind( code );
+
+    if( i < 0 )
+    {   // A free entry, or the one used longest ago
+        i = 0;
+
+        for( uint8_t j = 1; j < CODEDICT_SIZE && codes[i].code != 0; j++ )
+        {
+            if( codes[j].code == 0 || codes[j].lastUsed < codes[i].lastUsed )
+                i = j;
+        }
+
+        codes[i].code = code;
+        codes[i].peers = 0;
+    }
+
+    codes[i].peers |= 1 << peer;
+    codes[i].lastUsed = ++ uses;
+}
+
+// Node number peer doesn't have code any more
+void codeDictForget( uint32_t code, uint8_t peer )
+{
+    int8_t i = codeDictFind( code );
+
+    if( i >= 0 )
+        codes[i].peers &= ~( 1 << peer );
+}
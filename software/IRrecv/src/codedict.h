@@ -0,0 +1,16 @@
+/*
+ *  IRrecv:  codedict.h - Codes the IRsend nodes have learned.
+*/
+#ifndef CODEDICT_H
+#define CODEDICT_H
+
+#include <Arduino.h>
+
+// Number of codes kept track of, like IRsend's CODECACHE_SIZE
+#define CODEDICT_SIZE   64
+
+uint8_t codeDictPeers( uint32_t code );
+void codeDictLearned( uint32_t code, uint8_t peer );
+void codeDictForget( uint32_t code, uint8_t peer );
+
+#endif  // CODEDICT_H
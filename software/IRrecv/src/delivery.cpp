@@ -0,0 +1,247 @@
+/*
+ *  IRrecv:  delivery.cpp - Acknowledged delivery of IR frames to the IRsend nodes.
+ *
+ *  A frame is sent straight away, so the no-loss case costs nothing extra.
+ *  It then stays in its slot until every IRsend it was routed to has
+ *  acknowledged its frameId. If a MSG_IR_ACK is missing after the ACK
+ *  timeout, the frame is sent again with the same frameId to the nodes that
+ *  haven't acknowledged it, and IRsend only acknowledges a duplicate instead
+ *  of emitting it twice.
+ *
+ *  Nodes that already learned the frame get only its code (see
+ *  codedict.cpp). One that answers with a MSG_IR_MISS gets the frame in full
+ *  right away.
+ *
+ *  Once the deadline after the capture has passed, the frame is dropped: a
+ *  TV that powers on a second late is worse than a press that has to be
+ *  repeated.
+*/
+#include <Arduino.h>
+#include "messages.h"
+#include "irframe.h"
+#include "logring.h"
+#include "peers.h"
+#include "codekey.h"
+#include "codedict.h"
+#include "delivery.h"
+#include "events.h"
+
+typedef struct struct_delivery_slot
+{
+    uint8_t buf[IRFRAME_MAX_LEN] __attribute__((aligned(4)));
+    uint16_t frameLen;          // 0 while the slot isn't waiting for an ACK
+    uint8_t frameId;
+    uint8_t pending;            // mask of the peers that haven't acknowledged it
+    uint8_t byCode;             // mask of the peers it's sent to as a code
+    uint32_t code;              // irCodeKey() of the frame
+    uint8_t tries;              // times the frame was sent
+    uint32_t captureTime;       // millis() when it was captured
+    uint32_t captureUs;         // micros() when the capture was over, sent along
+    uint32_t sentAt;            // millis() when it was last sent
+} struct_delivery_slot;
+
+static uint32_t ackTimeout;
+static uint32_t deadline;
+static struct_delivery_slot slots[DELIVERY_SLOTS];
+static uint8_t next = 0;        // slot the next frame is encoded into
+static uint8_t lastPeers = 0;   // peers the last frame went to, its repeats go there too
+
+static uint32_t acked = 0;      // frames IRsend acknowledged
+static uint32_t retries = 0;    // retransmits
+static uint32_t expired = 0;    // frames given up on
+static uint32_t coded = 0;      // frames sent as a code to every peer
+static uint32_t misses = 0;     // codes a peer didn't have
+
+// Log that a frame won't be retransmitted any more
+static void deliveryExpire( struct_delivery_slot *slot )
+{
+    struct_logrec *rec = logNew( LOG_ERROR, LOG_EV_EXPIRED );
+
+    if( rec != NULL )
+    {
+        rec->frameId = slot->frameId;
+        rec->arg[0] = slot->tries;
+        rec->arg[1] = slot->pending;
+    }
+
+    slot->frameLen = 0;
+    ++ expired;
+}
+
+// Send a frame to every peer in mask, as a code to those that learned it and
+// in full to the others. Each goes out as a broadcast if that reaches all of
+// them.
+// Returns the number of packets ESP-NOW took.
+static uint8_t deliveryTransmit( struct_delivery_slot *slot, uint8_t mask )
+{
+    uint8_t *targets[PEER_MAX];
+    uint8_t n = peersTargets( mask & slot->byCode, targets );
+    uint8_t fragments = ( slot->frameLen + IRFRAGMENT_MAX_DATA - 1 ) / IRFRAGMENT_MAX_DATA;
+    uint8_t sends = 0;
+
+    for( uint8_t i = 0; i < n; i++ )
+    {
+        if( irFrameSendCode( targets[i], slot->frameId, slot->captureUs, slot->code ))
+            ++ sends;
+    }
+
+    n = peersTargets( mask & ~slot->byCode, targets );
+
+    for( uint8_t i = 0; i < n; i++ )
+    {
+        if( irFrameSend( targets[i], slot->frameId, slot->captureUs, slot->buf, slot->frameLen ))
+            sends += fragments;
+    }
+
+    // deliveryPoll() looks at it again once its ACK is overdue, millis()
+    // may tick over one more time by then
+    eventWakeIn(( ackTimeout + 1 ) * 1000 );
+
+    return sends;
+}
+
+// A frame that isn't acknowledged within ackTimeoutMs is sent again, until
+// deadlineMs after it was captured.
+void deliveryInit( uint32_t ackTimeoutMs, uint32_t deadlineMs )
+{
+    ackTimeout = ackTimeoutMs;
+    deadline = deadlineMs;
+}
+
+// Buffer of IRFRAME_MAX_LEN bytes to serialize the next frame into. If it
+// still holds a frame waiting for an ACK, that one is given up on.
+uint8_t *deliveryBuffer( void )
+{
+    struct_delivery_slot *slot = &slots[next];
+
+    if( slot->frameLen != 0 )
+        deliveryExpire( slot );
+
+    return slot->buf;
+}
+
+// Send the frame serialized into deliveryBuffer() to the peers in mask, under
+// the frameId it was streamed under, or a new one if streamId is -1. Its
+// capture was over at micros() captureUs.
+// Returns the number of packets ESP-NOW took, 0 if it refused all of them.
+// The frame is still retransmitted then.
+uint8_t deliverySend( uint16_t frameLen, uint32_t captureTime, uint32_t captureUs, uint8_t mask, int16_t streamId )
+{
+    struct_delivery_slot *slot = &slots[next];
+
+    slot->frameId = ( streamId >= 0 ) ? streamId : irFrameNewId();
+    slot->frameLen = frameLen;
+    slot->pending = mask;
+    slot->code = irCodeKey( slot->buf, frameLen );
+    slot->byCode = codeDictPeers( slot->code ) & mask;
+    slot->tries = 1;
+    slot->captureTime = captureTime;
+    slot->captureUs = captureUs;
+    slot->sentAt = millis();
+
+    next = (next + 1) % DELIVERY_SLOTS;
+    lastPeers = mask;
+
+    if( slot->byCode == mask )
+        ++ coded;
+
+    return deliveryTransmit( slot, mask );
+}
+
+// Send a repeat of the last frame to the peers that frame went to, its
+// capture was over at micros() captureUs.
+// Returns the number of packets ESP-NOW took.
+uint8_t deliverySendRepeat( const decode_results *results, uint8_t count, uint32_t captureUs )
+{
+    uint8_t *targets[PEER_MAX];
+    uint8_t n = peersTargets( lastPeers, targets );
+    uint8_t sends = 0;
+
+    for( uint8_t i = 0; i < n; i++ )
+    {
+        if( irFrameSendRepeat( targets[i], results, count, captureUs ))
+            ++ sends;
+    }
+
+    return sends;
+}
+
+// Peer number peer has the frame, called from OnDataRecv()
+void deliveryAck( uint8_t peer, uint8_t frameId )
+{
+    for( uint8_t i = 0; i < DELIVERY_SLOTS; i++ )
+    {
+        if( slots[i].frameLen != 0 && slots[i].frameId == frameId )
+        {
+            // It has the frame now, next time the code will do
+            if( !( slots[i].byCode & ( 1 << peer )))
+                codeDictLearned( slots[i].code, peer );
+
+            slots[i].pending &= ~( 1 << peer );
+
+            if( slots[i].pending == 0 )
+            {
+                slots[i].frameLen = 0;
+                ++ acked;
+            }
+        }
+    }
+}
+
+// Peer number peer doesn't have the code of frameId, send it the frame in
+// full. Called from OnDataRecv().
+void deliveryMiss( uint8_t peer, uint8_t frameId )
+{
+    for( uint8_t i = 0; i < DELIVERY_SLOTS; i++ )
+    {
+        struct_delivery_slot *slot = &slots[i];
+
+        if( slot->frameLen != 0 && slot->frameId == frameId && ( slot->pending & slot->byCode & ( 1 << peer )))
+        {
+            codeDictForget( slot->code, peer );
+            slot->byCode &= ~( 1 << peer );
+            slot->sentAt = millis();
+            ++ misses;
+            deliveryTransmit( slot, 1 << peer );
+        }
+    }
+}
+
+// Retransmit frames whose ACK is overdue, or drop them when it's too late
+void deliveryPoll( uint32_t now )
+{
+    for( uint8_t i = 0; i < DELIVERY_SLOTS; i++ )
+    {
+        struct_delivery_slot *slot = &slots[i];
+
+        if( slot->frameLen == 0 || now - slot->sentAt < ackTimeout )
+            continue;
+
+        // A retransmit needs about as long as the first send took to be acknowledged
+        if( now + ackTimeout - slot->captureTime > deadline )
+        {
+            deliveryExpire( slot );
+            continue;
+        }
+
+        struct_logrec *rec = logNew( LOG_DEBUG, LOG_EV_RETRY );
+
+        if( rec != NULL )
+        {
+            rec->frameId = slot->frameId;
+            rec->arg[0] = slot->tries;
+        }
+
+        ++ slot->tries;
+        ++ retries;
+        slot->sentAt = now;
+        peersRetransmit( slot->pending );
+        deliveryTransmit( slot, slot->pending );
+    }
+}
+
+void deliveryPrint( void )
+{
+    Serial.printf("IRrecv delivery: %u acknowledged, %u retransmits, %u given up, %u sent as a code, %u codes missed\n",
+                  acked, retries, expired, coded, misses);
+}
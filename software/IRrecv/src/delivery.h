@@ -0,0 +1,22 @@
+/*
+ *  IRrecv:  delivery.h - Acknowledged delivery of IR frames to the IRsend nodes.
+*/
+#ifndef DELIVERY_H
+#define DELIVERY_H
+
+#include <Arduino.h>
+#include <IRrecv.h>
+
+// Number of frames that can wait for their MSG_IR_ACK at the same time
+#define DELIVERY_SLOTS  2
+
+void deliveryInit( uint32_t ackTimeoutMs, uint32_t deadlineMs );
+uint8_t *deliveryBuffer( void );
+uint8_t deliverySend( uint16_t frameLen, uint32_t captureTime, uint32_t captureUs, uint8_t mask, int16_t streamId );
+uint8_t deliverySendRepeat( const decode_results *results, uint8_t count, uint32_t captureUs );
+void deliveryAck( uint8_t peer, uint8_t frameId );
+void deliveryMiss( uint8_t peer, uint8_t frameId );
+void deliveryPoll( uint32_t now );
+void deliveryPrint( void );
+
+#endif  // DELIVERY_H
@@ -0,0 +1,222 @@
+/*
+ *  IRrecv:  frameend.cpp - Early detection of the end of IR frames.
+ *
+ *  The ISR only declares a frame over once there were no edges for kTimeout,
+ *  which every relayed frame has to wait out. Most remotes use protocols
+ *  whose frames have a fixed number of edges, though. The capture is watched
+ *  as it grows: once its header and every mark and space so far fit such a
+ *  protocol, it has that protocol's number of edges and no edge followed for
+ *  kQuietUs, the capture is stopped at its last edge, as if the timeout had
+ *  expired. kQuietUs is still far less than kTimeout.
+ *
+ *  The quiet is waited for even when no protocol listed here has longer
+ *  frames with that header. A/C protocols that aren't listed borrow the
+ *  headers and bit timings of NEC (Gree, Kelvinator) or Samsung (Midea,
+ *  Coolix) and go on past their edge count, without the quiet they would
+ *  be cut off there. Anything else, UNKNOWN frames and Manchester coded
+ *  protocols (RC5, RC6) whose number of edges depends on the data, waits
+ *  for the timeout.
+ *
+ *  The ISR state lives in the library's _IRrecv namespace. It is only read
+ *  here, except for rcvstate which is set to kStopState with interrupts off,
+ *  just like the library's own timeout does.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include <IRutils.h>
+#include "frameend.h"
+
+namespace _IRrecv
+{
+extern volatile irparams_t params;
+}
+
+// No edge for this long closes a frame that has the edges of a protocol. The
+// longest mark or space inside a frame of those protocols, or of the longer
+// A/C frames that share their timings, is well below.
+const uint32_t kQuietUs = 3000;
+
+#define FRAMEEND_LENGTHS    3
+
+// Layout of a fixed length protocol: header mark and space, then a mark and
+// a space per bit and a final mark. The first space of Sony is a bit space.
+typedef struct struct_frameend_protocol
+{
+    decode_type_t protocol;
+    uint16_t hdrMark, hdrSpace;
+    uint16_t zeroMark, oneMark;
+    uint16_t zeroSpace, oneSpace;
+    uint16_t lengths[FRAMEEND_LENGTHS];     // rawlen of a whole frame, 0 if unused
+} struct_frameend_protocol;
+
+static const struct_frameend_protocol protocols[] =
+{
+    //                           header      marks        spaces       rawlen
+    { decode_type_t::NEC,        9000, 4500,  560,  560,  560, 1690, { 68 } },
+    { decode_type_t::NEC,        9000, 2250,  560,  560,  560,  560, { 4 } },     // repeat code
+    { decode_type_t::SAMSUNG,    4480, 4480,  560,  560,  560, 1680, { 68 } },
+    { decode_type_t::LG,         8500, 4250,  550,  550,  550, 1600, { 60 } },
+    { decode_type_t::JVC,        8400, 4200,  525,  525,  525, 1575, { 36 } },
+    { decode_type_t::PANASONIC,  3456, 1728,  432,  432,  432, 1296, { 100 } },
+    { decode_type_t::SONY,       2400,  600,  600, 1200,  600,  600, { 26, 32, 42 } },
+};
+
+#define FRAMEEND_PROTOCOLS  ( sizeof(protocols) / sizeof(protocols[0]) )
+
+static bool enabled = false;
+static uint8_t tolerance;
+static uint16_t lastLen = 0;        // rawlen when the capture was last looked at
+static uint32_t lastChange;         // micros() when it was seen to grow
+static bool pending = false;        // lastLen completes a frame, waiting for quiet
+static int8_t pendingMatch;         // protocols[] entry of that frame
+static int8_t closedBy = -1;        // protocols[] entry that closed the capture
+
+static uint32_t closed[FRAMEEND_PROTOCOLS];
+static uint32_t timeouts = 0;
+
+// Does a duration in ticks match the expected usecs? Marks come out of the
+// detector kMarkExcess longer than they were sent, spaces that much shorter.
+static bool frameEndMatch( uint16_t ticks, uint16_t usecs, bool mark )
+{
+    uint32_t measured = ticks * kRawTick;
+    uint32_t expected = mark ? usecs + kMarkExcess : usecs - kMarkExcess;
+    uint32_t delta = ( measured > expected ) ? measured - expected : expected - measured;
+
+    return delta * 100 <= expected * tolerance;
+}
+
+// Do the first len entries of rawbuf fit protocol p?
+static bool frameEndFits( const struct_frameend_protocol *p, const uint16_t *rawbuf, uint16_t len )
+{
+    if( len > 1 && !frameEndMatch( rawbuf[1], p->hdrMark, true ))
+        return false;
+
+    if( len > 2 && !frameEndMatch( rawbuf[2], p->hdrSpace, false ))
+        return false;
+
+    for( uint16_t i = 3; i < len; i++ )
+    {
+        bool mark = ( i & 1 );
+
+        if( !frameEndMatch( rawbuf[i], mark ? p->zeroMark : p->zeroSpace, mark ) &&
+            !frameEndMatch( rawbuf[i], mark ? p->oneMark : p->oneSpace, mark ))
+            return false;
+    }
+
+    return true;
+}
+
+// Look at the capture again whenever it grew.
+// Returns the protocols[] entry of a frame it now completes, -1 if none.
+static int8_t frameEndScan( const uint16_t *rawbuf, uint16_t len )
+{
+    int8_t match = -1;
+
+    for( uint8_t i = 0; i < FRAMEEND_PROTOCOLS; i++ )
+    {
+        const struct_frameend_protocol *p = &protocols[i];
+
+        if( !frameEndFits( p, rawbuf, len ))
+            continue;
+
+        for( uint8_t j = 0; j < FRAMEEND_LENGTHS && p->lengths[j] != 0; j++ )
+        {
+            if( p->lengths[j] == len && match < 0 )
+                match = i;
+        }
+    }
+
+    return match;
+}
+
+// Stop the capture where it is, unless the ISR already did or an edge came
+// in since it was looked at.
+// Returns true if it was stopped.
+static bool frameEndClose( uint16_t len )
+{
+    volatile irparams_t &params = _IRrecv::params;
+    bool stopped = false;
+
+    noInterrupts();
+
+    if( params.rawlen == len && params.rcvstate != kStopState )
+    {
+        params.rcvstate = kStopState;
+        stopped = true;
+    }
+
+    interrupts();
+
+    return stopped;
+}
+
+static void frameEndReset( void )
+{
+    closedBy = -1;
+    lastLen = 0;
+    pending = false;
+}
+
+// Watch for frames that are complete before the timeout, tolerance is the
+// matching tolerance in %
+void frameEndInit( uint8_t tolerancePercent )
+{
+    tolerance = tolerancePercent;
+    enabled = true;
+}
+
+// Stop the capture if it holds a complete frame. Called before every decode().
+void frameEndCheck( void )
+{
+    volatile irparams_t &params = _IRrecv::params;
+    uint16_t len = params.rawlen;
+    uint32_t now = micros();
+
+    if( !enabled || params.rcvstate == kStopState )
+        return;
+
+    // A new capture, decode() dropped the last one
+    if( len < lastLen )
+        frameEndReset();
+
+    if( len != lastLen )
+    {
+        int8_t match = frameEndScan( (const uint16_t *)params.rawbuf, len );
+
+        lastLen = len;
+        lastChange = now;
+        pending = ( match >= 0 );
+        pendingMatch = match;
+    }
+    else if( pending && now - lastChange >= kQuietUs )
+    {
+        pending = false;
+
+        if( frameEndClose( len ))
+            closedBy = pendingMatch;
+    }
+}
+
+// decode() copied a capture out, whatever ended it
+void frameEndCaptured( void )
+{
+    if( closedBy >= 0 )
+        ++ closed[closedBy];
+    else
+        ++ timeouts;
+
+    frameEndReset();
+}
+
+void frameEndPrint( void )
+{
+    Serial.printf("Frame end: %u captures waited for the timeout, closed early:", timeouts);
+
+    for( uint8_t i = 0; i < FRAMEEND_PROTOCOLS; i++ )
+    {
+        if( closed[i] != 0 )
+            Serial.printf(" %s %u", typeToString( protocols[i].protocol, protocols[i].lengths[0] == 4 ).c_str(), closed[i]);
+    }
+
+    Serial.println();
+}
@@ -0,0 +1,14 @@
+/*
+ *  IRrecv:  frameend.h - Early detection of the end of IR frames.
+*/
+#ifndef FRAMEEND_H
+#define FRAMEEND_H
+
+#include <Arduino.h>
+
+void frameEndInit( uint8_t tolerance );
+void frameEndCheck( void );
+void frameEndCaptured( void );
+void frameEndPrint( void );
+
+#endif  // FRAMEEND_H
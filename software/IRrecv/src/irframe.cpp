@@ -0,0 +1,197 @@
+/*
+ *  IRrecv:  irframe.cpp - Serialization of IR captures into frames and their fragmentation over ESP-NOW.
+ *
+ *  A decode_results can't be sent as is: its rawbuf is a pointer into our own
+ *  memory and the whole struct is larger than an ESP-NOW packet. The capture is
+ *  therefore written into a flat frame (see messages.h) that carries the raw
+ *  timings inline, and the frame is sent as a numbered series of fragments.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include <IRutils.h>
+#include <espnow.h>
+#include "messages.h"
+#include "irframe.h"
+#include "link.h"
+#include "rawpack.h"
+
+// Id of the next frame, lets IRsend tell fragments of different frames apart
+// and recognize retransmits
+static uint8_t nextFrameId = 0;
+
+// Id of the last frame sent in full, repeats refer to it
+static uint8_t lastFrameId = 0;
+
+// Serialize a capture into buf. Raw timings are only added when withRaw is set,
+// decoded protocols don't need them to be regenerated. With pack set they are
+// packed if that makes the frame shorter.
+// Returns the length of the frame, or 0 if buf is too small.
+uint16_t irFrameEncode( const decode_results *results, bool withRaw, bool pack, uint8_t *buf, uint16_t bufSize )
+{
+    struct_IRframe_hdr *hdr = (struct_IRframe_hdr *)buf;
+    uint16_t len = sizeof(struct_IRframe_hdr);
+    uint8_t stateLen = 0;
+
+    if( bufSize < len )
+        return 0;
+
+    hdr->protocol = results->decode_type;
+    hdr->bits = results->bits;
+    hdr->value = results->value;
+    hdr->address = results->address;
+    hdr->command = results->command;
+    hdr->flags = 0;
+
+    if( results->repeat )
+        hdr->flags |= IRFRAME_FLAG_REPEAT;
+
+    if( results->overflow )
+        hdr->flags |= IRFRAME_FLAG_OVERFLOW;
+
+    // Protocols with a state[] carry it in full, padded so the timings stay aligned
+    if( hasACState( results->decode_type ))
+    {
+        if( results->bits / 8 > kStateSizeMax )
+            stateLen = kStateSizeMax;
+        else
+            stateLen = results->bits / 8;
+
+        if( len + stateLen + 1 > bufSize )
+            return 0;
+
+        memcpy( buf + len, results->state, stateLen );
+        len += stateLen;
+
+        if( stateLen & 1 )
+            buf[len++] = 0;
+    }
+
+    hdr->stateLen = stateLen;
+    hdr->rawLen = 0;
+
+    if( withRaw )
+    {
+        // Convert the ticks to usecs the same way resultToRawArray() does, but
+        // straight into the frame instead of a newly allocated array.
+        uint16_t *raw = (uint16_t *)(buf + len);
+        uint16_t maxRaw = (bufSize - len) / 2;
+        uint16_t rawLen = 0;
+
+        for( uint16_t i = 1; i < results->rawlen; i++ )
+        {
+            uint32_t usecs = results->rawbuf[i] * kRawTick;
+
+            while( usecs > UINT16_MAX && rawLen + 2 < maxRaw )
+            {
+                raw[rawLen++] = UINT16_MAX;
+                raw[rawLen++] = 0;
+                usecs -= UINT16_MAX;
+            }
+
+            if( usecs > UINT16_MAX || rawLen >= maxRaw )
+            {
+                hdr->flags |= IRFRAME_FLAG_OVERFLOW;
+                break;
+            }
+
+            raw[rawLen++] = usecs;
+        }
+
+        uint16_t packedLen = pack ? rawPack( raw, rawLen ) : 0;
+
+        if( packedLen != 0 )
+        {
+            hdr->flags |= IRFRAME_FLAG_PACKED;
+            len += packedLen;
+        }
+        else
+            len += rawLen * 2;
+
+        hdr->rawLen = rawLen;
+    }
+
+    return len;
+}
+
+// Take the id of a new frame, its repeats will refer to it
+uint8_t irFrameNewId( void )
+{
+    lastFrameId = nextFrameId++;
+
+    return lastFrameId;
+}
+
+// Split a serialized frame into fragments and send them to peer. A retransmit
+// uses the same frameId, so IRsend can tell it's a frame it may already have.
+// captureUs is the micros() the capture was over at, IRsend can emit it at a
+// fixed time after that.
+// Returns false if ESP-NOW refused any of the fragments.
+bool irFrameSend( uint8_t *peer, uint8_t frameId, uint32_t captureUs, const uint8_t *frame, uint16_t frameLen )
+{
+    uint8_t packet[ESPNOW_MAX_PAYLOAD];
+    struct_IRfragment_hdr *hdr = (struct_IRfragment_hdr *)packet;
+    bool success = true;
+
+    hdr->msg_type = MSG_IR;
+    hdr->frameId = frameId;
+    hdr->fragCount = (frameLen + IRFRAGMENT_MAX_DATA - 1) / IRFRAGMENT_MAX_DATA;
+    hdr->frameLen = frameLen;
+    hdr->captureUs = captureUs;
+
+    for( uint8_t i = 0; i < hdr->fragCount; i++ )
+    {
+        uint16_t offset = i * IRFRAGMENT_MAX_DATA;
+        uint16_t size = frameLen - offset;
+
+        if( size > IRFRAGMENT_MAX_DATA )
+            size = IRFRAGMENT_MAX_DATA;
+
+        hdr->fragIndex = i;
+        memcpy( packet + sizeof(struct_IRfragment_hdr), frame + offset, size );
+
+        if( !linkSend( peer, packet, sizeof(struct_IRfragment_hdr) + size ) )
+            success = false;
+    }
+
+    return success;
+}
+
+// Send the code of a frame IRsend has learned instead of the frame itself.
+// Returns false if ESP-NOW refused it.
+bool irFrameSendCode( uint8_t *peer, uint8_t frameId, uint32_t captureUs, uint32_t code )
+{
+    struct_IRcode_hdr hdr;
+
+    hdr.msg_type = MSG_IR_CODE;
+    hdr.frameId = frameId;
+    hdr.code = code;
+    hdr.captureUs = captureUs;
+
+    return linkSend( peer, &hdr, sizeof(hdr) );
+}
+
+// Send a repeat of the last frame sent in full by irFrameSend(). The timings of
+// a protocol repeat code (results->repeat) go along with it, anything else is
+// regenerated by IRsend from the full frame.
+bool irFrameSendRepeat( uint8_t *peer, const decode_results *results, uint8_t count, uint32_t captureUs )
+{
+    uint16_t packet[(sizeof(struct_IRrepeat_hdr) + 2 * IRREPEAT_MAX_RAW) / 2];
+    struct_IRrepeat_hdr *hdr = (struct_IRrepeat_hdr *)packet;
+    uint16_t *raw = packet + sizeof(struct_IRrepeat_hdr) / 2;
+    uint8_t rawLen = 0;
+
+    hdr->msg_type = MSG_IR_REPEAT;
+    hdr->frameId = lastFrameId;
+    hdr->count = count;
+    hdr->captureUs = captureUs;
+
+    if( results->repeat )
+    {
+        for( uint16_t i = 1; i < results->rawlen && rawLen < IRREPEAT_MAX_RAW; i++ )
+            raw[rawLen++] = results->rawbuf[i] * kRawTick;
+    }
+
+    hdr->rawLen = rawLen;
+
+    return linkSend( peer, packet, sizeof(struct_IRrepeat_hdr) + rawLen * 2 );
+}
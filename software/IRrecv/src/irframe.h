@@ -0,0 +1,15 @@
+/*
+ *  IRrecv:  irframe.h - Serialization of IR captures into frames and their fragmentation over ESP-NOW.
+*/
+#ifndef IRFRAME_H
+#define IRFRAME_H
+
+#include <IRrecv.h>
+
+uint16_t irFrameEncode( const decode_results *results, bool withRaw, bool pack, uint8_t *buf, uint16_t bufSize );
+uint8_t irFrameNewId( void );
+bool irFrameSend( uint8_t *peer, uint8_t frameId, uint32_t captureUs, const uint8_t *frame, uint16_t frameLen );
+bool irFrameSendCode( uint8_t *peer, uint8_t frameId, uint32_t captureUs, uint32_t code );
+bool irFrameSendRepeat( uint8_t *peer, const decode_results *results, uint8_t count, uint32_t captureUs );
+
+#endif  // IRFRAME_H
@@ -14,8 +14,24 @@
 #include <espnow.h>
 #include "messages.h"
 #include "callbacks.h"
-
-#define HEARTBEAT_1_SEC     1000    // Sync up with IRrecv once every second
+#include "irframe.h"
+#include "capture.h"
+#include "frameend.h"
+#include "stream.h"
+#include "noise.h"
+#include "profile.h"
+#include "repeat.h"
+#include "latency.h"
+#include "logring.h"
+#include "heapstats.h"
+#include "delivery.h"
+#include "peers.h"
+#include "link.h"
+#include "trace.h"
+#include "events.h"
+
+// The IRsend nodes are asked for their stats one after another, this far apart
+const uint32_t kStatsGapMs = 100;
 
 // ==================== start of TUNEABLE PARAMETERS ====================
 
@@ -56,6 +72,18 @@ const uint16_t kCaptureBufferSize = 1024;  // 1024 == ~511 bits
 // NOTE: Don't exceed kMaxTimeoutMs. Typically 130ms.
 const uint8_t kTimeout = 15;
 
+// Close frames of the fixed length protocols frameend.cpp knows (NEC, Sony,
+// Samsung...) at their last edge instead of waiting out kTimeout. Anything
+// else still waits for it.
+const bool kEarlyFrameEnd = true;
+
+// Captures that grow past kStreamStartEdges edges, longer than the frames of
+// any TV remote, are streamed to IRsend while they are still coming in, in
+// chunks of about kStreamChunkUs of timings (see stream.cpp). IRsend starts
+// emitting them before they are over. 0 turns streaming off.
+const uint16_t kStreamStartEdges = 160;
+const uint32_t kStreamChunkUs = 8000;
+
 // Set the smallest sized "UNKNOWN" message packets we actually care about.
 // This value helps reduce the false-positive detection rate of IR background
 // noise as real messages. The chances of background IR noise getting detected
@@ -70,6 +98,11 @@ const uint8_t kTimeout = 15;
 // NOTE: Set this value very high to effectively turn off UNKNOWN detection.
 const uint16_t kMinUnknownSize = 12;
 
+// Drop captures that are ambient IR noise (glitches, daylight, marks and
+// spaces of too many widths) before they are decoded, see noise.cpp.
+// Turn off if a remote's frames show up as rejected in the s dump.
+const bool kNoiseFilter = true;
+
 // How much percentage lee way do we give to incoming signals in order to match
 // it?
 // e.g. +/- 25% (default) to an expected value of 500 would mean matching a
@@ -80,34 +113,122 @@ const uint16_t kMinUnknownSize = 12;
 //       your remote's message some of the time, but not all of the time.
 const uint8_t kTolerancePercentage = kTolerance;  // kTolerance is normally 25%
 
+// In passthrough mode (build with -D IR_PASSTHROUGH, see platformio.ini) every
+// capture is forwarded with its raw timings and IRsend replays those instead of
+// regenerating the frame. Decoding is limited to the DECODE_xxx protocols
+// enabled in the build, so decode() is little more than a copy of the buffer.
+#ifdef IR_PASSTHROUGH
+const bool kPassthrough = true;
+#else  // IR_PASSTHROUGH
+const bool kPassthrough = false;
+#endif  // IR_PASSTHROUGH
+
+// Send the raw timings along with frames of decoded protocols too. IRsend
+// compiles them into a waveform once and replays that for the repeats and
+// later presses (see IRsend waveform.cpp) instead of running the protocol
+// encoder every time. Only the first press of a code is sent in full.
+const bool kSendWaveforms = true;
+
+// Pack the raw timings that go along with a frame into a few bits each (see
+// rawpack.cpp), a learned code then mostly fits into a single packet.
+const bool kPackRaw = true;
+
+// A frame IRsend doesn't acknowledge within kAckTimeoutMs is sent again, for
+// as long as it can still arrive within kDeliveryDeadlineMs of its capture.
+// Past that a lost frame is dropped, a late "power" is worse than a lost one.
+const uint32_t kAckTimeoutMs = 30;
+const uint32_t kDeliveryDeadlineMs = 300;
+
+// loop() idles between events (see events.cpp). Heartbeats, the LED and the
+// stats requests are looked after every kEventTickMs, a timeout that needs
+// to be met more closely asks to be woken up for it.
+const uint32_t kEventTickMs = 10;
+
+// MAC Addresses of the IRsend nodes - edit as required, up to PEER_MAX of them
+const uint8_t kPeers[][6] =
+{
+    { 0x18, 0xFE, 0x34, 0xD9, 0x41, 0x7C },
+};
+
+// Which IRsend nodes each frame goes to, the first route that matches wins
+// and a frame no route matches isn't sent. peers is a mask of kPeers[], bit 0
+// is the first node. A frame for every node goes out as a single broadcast.
+// e.g. to send a Samsung TV's frames only to the second node:
+//    { decode_type_t::SAMSUNG, ROUTE_MATCH_ADDRESS, 0x07, 0, 0x02 },
+const struct_route kRoutes[] =
+{
+    { ROUTE_ANY, 0, 0, 0, PEERS_ALL },      // everything else to every node
+};
+
 // Legacy (No longer supported!)
 //
 // Change to `true` if you miss/need the old "Raw Timing[]" display.
 #define LEGACY_TIMING_INFO false
 // ==================== end of TUNEABLE PARAMETERS ====================
 
-// The IR receiver.
-IRrecv irrecv(kRecvPin, kCaptureBufferSize, kTimeout, true);
+// The IR receiver. Captures are copied out into the slots of capture.cpp, so
+// IRrecv doesn't need its own save buffer.
+IRrecv irrecv(kRecvPin, kCaptureBufferSize, kTimeout, false);
 
 // ==================== begin of WiFi related data ====================
-// MAC Address of responder - edit as required
-uint8_t broadcastAddress[] = 
-{
-  0x18, 0xFE, 0x34, 0xD9, 0x41, 0x7C
-};
+// Latency histograms an IRsend sent back, printed by loop()
+static uint8_t peerStats[ESPNOW_MAX_PAYLOAD];
+static volatile uint8_t peerStatsLen = 0;
+static volatile uint8_t peerStatsFrom = 0;
 
-// Create a structured object for received data
-struct_message_rcv rcvData;
+// Print a record of the deferred log
+static void printLogRecord( const struct_logrec *rec )
+{
+    switch( rec->event )
+    {
+    case LOG_EV_FRAME:
+        // Display a crude timestamp & notification.
+        Serial.printf(
+            "%06u.%03u: A %d-bit %s message was %ssuccessfully retransmitted.\n",
+            rec->time / 1000, rec->time % 1000, rec->bits, typeToString((decode_type_t)rec->protocol).c_str(),
+            rec->success ? "" : "un");
 
-// Create a structured object for sent data
-struct_IRmessage_xmit xmitIRData;
-struct_message_xmit xmitData;
+        if( logLevel() >= LOG_DEBUG )
+            Serial.printf("Decode took %u us, sent %u us after the capture was copied out.\n",
+                          rec->arg[0], rec->arg[1]);
+        break;
 
-// ESP-NOW Peer info
-//esp_now_peer_info_t peerInfo;
+    case LOG_EV_REPEAT:
+        Serial.printf(
+            "%06u.%03u: A %s repeat was %ssuccessfully retransmitted.\n",
+            rec->time / 1000, rec->time % 1000, typeToString((decode_type_t)rec->protocol).c_str(),
+            rec->success ? "" : "un");
+        break;
+
+    case LOG_EV_SENT:
+        Serial.println( rec->success ? "Message sent successfully!" : "Message send error!" );
+        break;
+
+    case LOG_EV_RETRY:
+        Serial.printf("%06u.%03u: Frame %u not acknowledged after %u send(s), sending it again.\n",
+                      rec->time / 1000, rec->time % 1000, rec->frameId, rec->arg[0]);
+        break;
+
+    case LOG_EV_EXPIRED:
+        Serial.printf("%06u.%03u: Frame %u was never acknowledged by IRsend mask 0x%02X, gave up after %u send(s).\n",
+                      rec->time / 1000, rec->time % 1000, rec->frameId, rec->arg[1], rec->arg[0]);
+        break;
+
+    case LOG_EV_UNROUTED:
+        Serial.printf("%06u.%03u: A %d-bit %s message matches no route, it wasn't sent.\n",
+                      rec->time / 1000, rec->time % 1000, rec->bits, typeToString((decode_type_t)rec->protocol).c_str());
+        break;
+    }
+}
 
-// Variable for connection error  - true is error state
-static volatile bool wifiConnectError = true;
+// Events nothing posts, checked while loop() idles. Once the ISR has the
+// first edge of a capture loop() keeps going until it's grabbed, frameend.cpp,
+// noise.cpp and stream.cpp watch it grow and the end of a frame shouldn't
+// wait for the next wake-up.
+static uint8_t pollEvents( void )
+{
+    return ( captureActive() ? EVENT_CAPTURE : 0 ) | ( Serial.available() ? EVENT_SERIAL : 0 );
+}
 
 // This section of code runs only once at start-up.
 void setup()
@@ -127,9 +248,23 @@ void setup()
     assert(irutils::lowLevelSanityCheck() == 0);
 
     Serial.printf("\n" D_STR_IRRECVDUMP_STARTUP "\n", kRecvPin);
+    Serial.printf("Raw passthrough mode is %s\n", kPassthrough ? "on" : "off");
+    profilePrint();
     // Ignore messages with less than minimum on or off pulses.
     irrecv.setUnknownThreshold(kMinUnknownSize);
     irrecv.setTolerance(kTolerancePercentage);  // Override the default tolerance.
+    logInit( LOG_INFO, printLogRecord );
+    captureInit(&irrecv, kCaptureBufferSize);
+
+    if( kEarlyFrameEnd )
+        frameEndInit(kTolerancePercentage);
+
+    if( kNoiseFilter )
+        noiseInit();
+
+    if( !traceInit(kCaptureBufferSize, kTimeout) )
+        Serial.println("No LittleFS, captures can only be traced to the serial port");
+
     irrecv.enableIRIn();  // Start the receiver
     
     // Read the local MAC address and print it out.
@@ -144,15 +279,9 @@ void setup()
 
     // Initilize ESP-NOW
     if( esp_now_init() != 0 )
-    {
         Serial.println("Error initializing ESP-NOW");
-        wifiConnectError = true;
-    }
     else
-    {
         Serial.println("Initialized ESP-NOW");
-        wifiConnectError = false;
-    }
 
     // Set role to combo
     esp_now_set_self_role( ESP_NOW_ROLE_COMBO );
@@ -163,99 +292,248 @@ void setup()
     // Register the send callback
     esp_now_register_send_cb( OnDataSent );
 
-    // Register peer
-    //memcpy(peerInfo.peer_addr, broadcastAddress, 6);
-    //peerInfo.channel = 0;
-    //peerInfo.encrypt = false;
+    // Take the RSSI of what comes in
+    linkRssiInit();
 
-    // Add peer
-    if( esp_now_add_peer( broadcastAddress, ESP_NOW_ROLE_SLAVE, 0, NULL, 0 ) != 0 )
+    // Add the IRsend nodes as peers
+    if( !peersInit( kPeers, sizeof(kPeers) / sizeof(kPeers[0]), kRoutes, sizeof(kRoutes) / sizeof(kRoutes[0]) ))
     {
         Serial.println("No peer added");
-        wifiConnectError = true;
         return;
     }
     else
-    {
-        Serial.println("ESP-NOW Ready");
-        wifiConnectError = false;
-    }
-    
-    if( esp_now_is_peer_exist( broadcastAddress ))
-    {
-        Serial.println("Peer exists");
-    }
-    else
-        Serial.println("No exists");
+        Serial.printf("ESP-NOW Ready, %u IRsend node(s)\n", peersCount());
+
+    deliveryInit( kAckTimeoutMs, kDeliveryDeadlineMs );
+
+    if( kStreamStartEdges != 0 )
+        streamInit( kStreamStartEdges, kStreamChunkUs, peersRouteAlways() );
 
-    callbacksInit( &rcvData, sizeof(rcvData), &wifiConnectError );
+    callbacksInit( peerStats, &peerStatsLen, &peerStatsFrom );
+    eventInit( kEventTickMs, pollEvents );
 
-    // Enter the Loop with connectError set HIGH to avoid intial display flicker
-    wifiConnectError = true;
+    Serial.println("Type s to print the latency histograms of all nodes, l the link statistics, v to change the log level.");
+    Serial.println("Type t to trace the captures to flash or the serial port, d to dump the flash trace, e to erase it.");
 }
 
 // The repeating section of the code
 void loop()
 {
-    static uint32_t last_time = 0;
     uint32_t now;
-    static uint32_t heartbeatTime = 0;
-    static uint32_t heartbeatRate = HEARTBEAT_1_SEC;
-    static uint8_t failCount = 0;
-
-    static uint8_t pinState = LOW;
+    static uint8_t statsPeer = PEER_MAX;    // next IRsend to ask for its stats
+    static uint32_t statsTime = 0;
+    static uint8_t ledLevel = LOW;
+    uint8_t events = eventTake();   // what woke us up
     
     now = millis();     // get current time
-    heartbeatTime += now - last_time;
-    last_time = now;    // save for next loop    
 
-    // Send a message every second to montior whether IRrecv peer is present
-    if( heartbeatTime > heartbeatRate )
+    if( events & EVENT_TICK )
     {
-        heartbeatTime = 0;
-        xmitData.msg_type = MSG_HEARTBEAT;
-        xmitData.status_data = 0xAA;
-        int result = esp_now_send(broadcastAddress, (uint8_t *)&xmitData, sizeof(xmitData));
+        // The IRsend nodes hear from us through the frames we send them, those
+        // we had nothing for lately get a heartbeat instead. Each goes to the
+        // node itself, a broadcast isn't acknowledged.
+        peersHeartbeat( now );
 
-        if( wifiConnectError == true )
+        // The LED shows how the links to the nodes are doing
+        if( peersLed( now ) != ledLevel )
         {
-            ++ failCount;
+            ledLevel = !ledLevel;
+            digitalWrite( statusLedPin, ledLevel );
+        }
+    }
 
-            if( failCount > 5 )
-                pinState = LOW;
+    // Heartbeats and the like wait a little for others to the same node
+    linkPoll();
+
+    switch( ( events & EVENT_SERIAL ) && Serial.available() ? Serial.read() : -1 )
+    {
+    case 's':   // Dump our latency histograms and ask the IRsend nodes for their own
+        profilePrint();     // decode() takes as long as the decoders it runs
+        latencyDump( "IRrecv" );
+        deliveryPrint();
+        frameEndPrint();
+        noisePrint();
+        streamPrint();
+        tracePrint();
+        eventPrint();
+        peersPrint( now );
+
+        // One at a time, there is room for a single reply
+        statsPeer = 0;
+        statsTime = now - kStatsGapMs;
+        break;
+
+    case 'l':   // How the links to the IRsend nodes are doing
+        peersPrint( now );
+        break;
+
+    case 'v':   // Cycle through the log levels
+        logSetLevel( (LOG_LEVEL_E)(( logLevel() + 1 ) % ( LOG_DEBUG + 1 )));
+        Serial.printf("Log level %u\n", logLevel());
+        break;
+
+    case 't':   // Cycle the capture trace through off, to flash and to the serial port
+        traceSetSink( (TRACE_SINK_E)(( traceSink() + 1 ) % ( TRACE_SERIAL + 1 )));
+        tracePrint();
+        break;
+
+    case 'd':   // Send the flash trace, for native/trace/trace.py to record
+        traceDump();
+        break;
+
+    case 'e':
+        traceErase();
+        tracePrint();
+        break;
+    }
+
+    if( statsPeer < peersCount() && now - statsTime >= kStatsGapMs )
+    {
+        struct_stats_req_hdr req;
+
+        req.msg_type = MSG_STATS_REQ;
+        linkQueue( peersMac( statsPeer ), &req, sizeof(req) );
+        ++ statsPeer;
+        statsTime = now;
+    }
+
+    if( peerStatsLen != 0 )
+    {
+        char node[12];
+
+        snprintf( node, sizeof(node), "IRsend %u", peerStatsFrom );
+        latencyPrint( node, peerStats, peerStatsLen );
+        peerStatsLen = 0;
+    }
+    
+    // Check if an IR message has been received, copying it out re-arms the capture.
+    captureGrab();
+
+    decode_results *results = captureNext();
+
+    if( results != NULL && repeatCheck( results, now ))
+    {  // A held button, IRsend regenerates the repeat from the last full frame.
+        decode_type_t protocol = results->decode_type;
+
+        heapStatsMark();
+        latencyRecordUs( STAGE_DECODE, captureDecodeTime() );
+        captureGrab();
+        heapStatsCheck();
+
+        uint32_t sendStamp = latencyStamp();
+        uint8_t sends = deliverySendRepeat( results, 1, captureGrabTime() );
+        bool success = ( sends != 0 );
+
+        if( success )
+        {
+            linkMark();
+            latencyArm( STAGE_RADIO, sendStamp );
         }
-        else
+
+        captureRelease();
+
+        uint32_t logStamp = latencyStamp();
+        struct_logrec *rec = logNew( LOG_INFO, LOG_EV_REPEAT );
+
+        if( rec != NULL )
         {
-            failCount = 0;
-            pinState = HIGH;
+            rec->protocol = protocol;
+            rec->success = success;
         }
-        
-        digitalWrite( statusLedPin, pinState );
+
+        latencyRecord( STAGE_RECV_LOG, logStamp, latencyStamp() );
     }
-    
-    // Check if an IR message has been received.
-    if( irrecv.decode( &(xmitIRData.IRmessage_data)))
+    else if( results != NULL )
     {  // We have captured something.
-        // The capture has stopped at this point.
-        decode_type_t protocol = xmitIRData.IRmessage_data.decode_type;
-        uint16_t size = xmitIRData.IRmessage_data.bits;
-        bool success = true;
-
-        // send IR data via WiFi to IRsend
+        decode_type_t protocol = results->decode_type;
+        uint16_t size = results->bits;
+        bool success = false;
+        uint16_t frameLen = 0;
+        uint32_t decodeTime = captureDecodeTime();
+        uint32_t sendTime;
+        uint32_t sendStamp;
+        uint8_t sends = 0;
+        uint8_t route = peersRoute( results );
+        uint8_t *frameBuf = deliveryBuffer();
+
+        // Nothing up to the radio send may allocate. esp_now_send() is left
+        // out, the SDK holds on to a copy of the packet until it's sent.
+        heapStatsMark();
+
+        // Serialize the capture, the raw timings are only needed for
+        // protocols IRsend can't regenerate from the decoded value, or when
+        // it's asked to replay them or compile them into a waveform.
+        // A repeat code without the frame it repeats has nothing to send.
+        if( !results->repeat && route != 0 )
+            frameLen = irFrameEncode( results, kPassthrough || kSendWaveforms || protocol == decode_type_t::UNKNOWN, kPackRaw,
+                                      frameBuf, IRFRAME_MAX_LEN );
+
+        // Catch a frame that ended while we were decoding and encoding into
+        // the other slot before the radio send, the ISR doesn't capture again
+        // until it has been copied out.
+        captureGrab();
+
+        // Time from the end of decode() until the frame goes out, which
+        // includes any wait for the previous capture to be sent
+        sendTime = micros() - captureGrabTime();
+        latencyRecordUs( STAGE_DECODE, decodeTime );
+        latencyRecordUs( STAGE_SEND, sendTime - decodeTime );
+        sendStamp = latencyStamp();
+        heapStatsCheck();
+
+        // send IR data via WiFi to the IRsend nodes it's routed to
         // Send message via ESP-NOW
-        xmitIRData.msg_type = MSG_IR;
-        int result = esp_now_send(broadcastAddress, (uint8_t *)&xmitIRData, sizeof(xmitIRData));
+        if( frameLen != 0 )
+            sends = deliverySend( frameLen, now, captureGrabTime(), route, captureStreamId() );
 
-        // Resume capturing IR messages. It was not restarted until after we sent
-        // the message so we didn't capture our own message.
-        irrecv.resume();
+        success = ( sends != 0 );
 
-        // Display a crude timestamp & notification.
-        Serial.printf(
-            "%06u.%03u: A %d-bit %s message was %ssuccessfully retransmitted.\n",
-            now / 1000, now % 1000, size, typeToString(protocol).c_str(),
-            success ? "" : "un");
+        // The radio is done with the frame once its last fragment is reported
+        // sent to the last of the nodes. Other packets are reported meanwhile,
+        // the stage ends with the report of the one sent last.
+        if( success )
+        {
+            linkMark();
+            latencyArm( STAGE_RADIO, sendStamp );
+        }
+
+        // Only a frame that made it to IRsend can be repeated
+        if( success )
+            repeatRemember( results, now );
+        else
+            repeatForget();
+
+        captureRelease();
+
+        uint32_t logStamp = latencyStamp();
+        struct_logrec *rec = logNew( route != 0 ? LOG_INFO : LOG_DEBUG, route != 0 ? LOG_EV_FRAME : LOG_EV_UNROUTED );
+
+        if( rec != NULL )
+        {
+            rec->protocol = protocol;
+            rec->bits = size;
+            rec->success = success;
+            rec->arg[0] = decodeTime;
+            rec->arg[1] = sendTime;
+        }
+
+        latencyRecord( STAGE_RECV_LOG, logStamp, latencyStamp() );
+    }
+
+    // Send frames IRsend didn't acknowledge in time again
+    deliveryPoll( millis() );
+
+    // Print the log once there is nothing left to relay, but not amid a trace
+    // record that is half out on the serial port
+    if( captureNext() == NULL )
+    {
+        if( !traceDrain() )
+            logDrain();
     }
-  
-    yield();  // Or delay(milliseconds); This ensures the ESP doesn't WDT reset.
+    else
+        eventWakeIn( 0 );
+
+    // Hand the CPU to the SDK until there is something to do, this also
+    // ensures the ESP doesn't WDT reset
+    eventIdle();
 }
\ No newline at end of file
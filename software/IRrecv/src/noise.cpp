@@ -0,0 +1,233 @@
+/*
+ *  IRrecv:  noise.cpp - Rejection of ambient IR noise before it is decoded and sent.
+ *
+ *  Sunlight, CFLs and plasma TVs make the IR detector put out bursts of edges
+ *  that the ISR captures like any frame. kMinUnknownSize only turns away the
+ *  shortest of them, and only after decode() ran every decoder on them. The
+ *  rest go out over the radio and take IRsend's slot from real frames.
+ *
+ *  The capture is scanned as it grows, a few edges at a time, and each mark
+ *  and space is only looked at once. What a remote sends has marks and
+ *  spaces of a few widths, all multiples of its carrier period, and none
+ *  shorter than a few dozen carrier cycles. Noise has glitches of a cycle or
+ *  two, marks a detector only puts out in daylight, and widths all over the
+ *  place. Once the ISR stopped the capture, noiseReject() tells whether it is
+ *  noise, which is then dropped without being decoded.
+ *
+ *  The detector demodulates, so the carrier itself never reaches the GPIO.
+ *  Its consistency shows in how few widths the marks and spaces come in.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include "noise.h"
+
+namespace _IRrecv
+{
+extern volatile irparams_t params;
+}
+
+// The shortest frame there is, the NEC repeat code, has this many edges
+const uint16_t kMinEdges = 3;
+
+// No remote sends a mark or space this short, the detector's output is
+// lengthened to at least this much even for a short burst of carrier
+const uint32_t kGlitchUs = 100;
+
+// A capture with more than one glitch per this many edges is noise
+const uint16_t kGlitchShare = 16;
+
+// Longer than the header mark of any protocol, the detector only puts out a
+// mark this long when it's blinded by light
+const uint32_t kMaxMarkUs = 12000;
+
+// Widths within kClassPercent of each other are a class, tighter than the
+// decoders' tolerance as a remote's timings jitter by a few % at most. A
+// capture with at least kClassedEdges edges is noise if more than one in
+// kIrregularShare of them are outside its kRegularClasses fullest classes.
+#define NOISE_CLASSES   8
+const uint8_t kClassPercent = 15;
+const uint8_t kRegularClasses = 4;
+const uint16_t kClassedEdges = 12;
+const uint16_t kIrregularShare = 4;
+
+typedef enum
+{
+    NOISE_RUNT = 0,         // fewer edges than any frame
+    NOISE_GLITCH,           // too many edges shorter than kGlitchUs
+    NOISE_WIDTH,            // a mark longer than kMaxMarkUs
+    NOISE_IRREGULAR,        // marks and spaces of too many widths
+    NOISE_REASONS
+} NOISE_REASON_E;
+
+typedef struct struct_noise_class
+{
+    uint32_t centreUs;      // rolling average of its widths
+    uint16_t count;
+} struct_noise_class;
+
+static bool enabled = false;
+
+// Scan of the capture the ISR is filling
+static uint16_t scanned = 1;        // rawbuf[] entries looked at, rawbuf[0] is the gap before it
+static uint16_t glitches;
+static uint16_t overlong;
+static uint16_t unclassed;          // edges that found all the classes taken
+static uint8_t classCount;
+static struct_noise_class classes[NOISE_CLASSES];
+
+static uint32_t checked = 0;
+static uint32_t rejected[NOISE_REASONS];
+
+// Drop captures that are noise
+void noiseInit( void )
+{
+    enabled = true;
+}
+
+static void noiseReset( void )
+{
+    scanned = 1;
+    glitches = 0;
+    overlong = 0;
+    unclassed = 0;
+    classCount = 0;
+}
+
+// Count a mark or space into the class of its width
+static void noiseClassify( uint32_t us )
+{
+    for( uint8_t i = 0; i < classCount; i++ )
+    {
+        struct_noise_class *c = &classes[i];
+        uint32_t delta = ( us > c->centreUs ) ? us - c->centreUs : c->centreUs - us;
+
+        if( delta * 100 <= c->centreUs * kClassPercent )
+        {
+            c->centreUs += ( (int32_t)us - (int32_t)c->centreUs ) / 8;
+            ++ c->count;
+            return;
+        }
+    }
+
+    if( classCount < NOISE_CLASSES )
+    {
+        classes[classCount].centreUs = us;
+        classes[classCount].count = 1;
+        ++ classCount;
+    }
+    else
+        ++ unclassed;
+}
+
+// Edges outside the kRegularClasses fullest classes
+static uint16_t noiseIrregular( uint16_t edges )
+{
+    uint16_t regular = 0;
+    uint8_t taken = 0;      // bit i: classes[i] is one of the fullest
+
+    for( uint8_t n = 0; n < kRegularClasses && n < classCount; n++ )
+    {
+        int8_t fullest = -1;
+
+        for( uint8_t i = 0; i < classCount; i++ )
+        {
+            if( !( taken & ( 1 << i )) && ( fullest < 0 || classes[i].count > classes[fullest].count ))
+                fullest = i;
+        }
+
+        taken |= 1 << fullest;
+        regular += classes[fullest].count;
+    }
+
+    return edges - regular;
+}
+
+// What the edges scanned so far say about the capture, a NOISE_REASON_E or
+// -1 if it looks like a frame. Too few edges only count once it's over.
+static int8_t noiseVerdict( uint16_t edges, bool over )
+{
+    if( edges < kMinEdges )
+        return over ? NOISE_RUNT : -1;
+
+    if( glitches > edges / kGlitchShare )
+        return NOISE_GLITCH;
+
+    if( overlong != 0 )
+        return NOISE_WIDTH;
+
+    if( edges >= kClassedEdges && noiseIrregular( edges ) > edges / kIrregularShare )
+        return NOISE_IRREGULAR;
+
+    return -1;
+}
+
+// Look at the marks and spaces that came in since the last call. Called
+// before every decode().
+void noiseScan( void )
+{
+    volatile irparams_t &params = _IRrecv::params;
+    uint16_t len = params.rawlen;
+
+    if( !enabled )
+        return;
+
+    // A new capture, decode() dropped the last one
+    if( len < scanned )
+        noiseReset();
+
+    for( ; scanned < len; scanned++ )
+    {
+        uint32_t us = params.rawbuf[scanned] * kRawTick;
+
+        if( us < kGlitchUs )
+            ++ glitches;
+        else
+        {
+            if(( scanned & 1 ) && us > kMaxMarkUs )
+                ++ overlong;
+
+            noiseClassify( us );
+        }
+    }
+}
+
+// Does the capture look like noise so far? stream.cpp doesn't start
+// streaming one that does.
+bool noiseSuspect( void )
+{
+    return enabled && noiseVerdict( scanned - 1, false ) >= 0;
+}
+
+// Judge the capture the ISR stopped, before it's decoded.
+// Returns true if it is noise, it is to be dropped without decoding it.
+bool noiseReject( void )
+{
+    if( !enabled )
+        return false;
+
+    noiseScan();
+
+    int8_t reason = noiseVerdict( scanned - 1, true );
+
+    ++ checked;
+    noiseReset();
+
+    if( reason < 0 )
+        return false;
+
+    ++ rejected[reason];
+
+    return true;
+}
+
+void noisePrint( void )
+{
+    uint32_t total = 0;
+
+    for( uint8_t i = 0; i < NOISE_REASONS; i++ )
+        total += rejected[i];
+
+    Serial.printf("Noise: %u of %u captures rejected, %u too short, %u glitches, %u too long marks, %u irregular\n",
+                  total, checked, rejected[NOISE_RUNT], rejected[NOISE_GLITCH], rejected[NOISE_WIDTH],
+                  rejected[NOISE_IRREGULAR]);
+}
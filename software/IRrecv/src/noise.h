@@ -0,0 +1,15 @@
+/*
+ *  IRrecv:  noise.h - Rejection of ambient IR noise before it is decoded and sent.
+*/
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <Arduino.h>
+
+void noiseInit( void );
+void noiseScan( void );
+bool noiseSuspect( void );
+bool noiseReject( void );
+void noisePrint( void );
+
+#endif  // NOISE_H
@@ -0,0 +1,231 @@
+/*
+ *  IRrecv:  peers.cpp - Table of IRsend nodes, routing of frames to them and their link health.
+ *
+ *  Each frame goes to the IRsend nodes of the first route it matches. When
+ *  that is every node, a single ESP-NOW broadcast carries it to all of them
+ *  at once. Otherwise it is sent to each of them in turn. Broadcasts aren't
+ *  acknowledged by the radio, so link health is tracked per node from what
+ *  is heard back from it (ACKs, heartbeats) and from its unicast send status,
+ *  see link.cpp.
+*/
+#include <Arduino.h>
+#include <espnow.h>
+#include <IRrecv.h>
+#include "peers.h"
+#include "link.h"
+
+typedef struct struct_peer
+{
+    uint8_t mac[6];
+    struct_link link;
+} struct_peer;
+
+static uint8_t broadcastMac[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static struct_peer peers[PEER_MAX];
+static uint8_t count = 0;
+static const struct_route *routes_p;
+static uint8_t routes = 0;
+
+// Add the IRsend nodes as ESP-NOW peers, and the broadcast address if there
+// is more than one of them.
+// Returns false if any of them couldn't be added.
+bool peersInit( const uint8_t (*macs)[6], uint8_t macCount, const struct_route *routeTable, uint8_t routeCount )
+{
+    bool success = true;
+
+    count = ( macCount > PEER_MAX ) ? PEER_MAX : macCount;
+    routes_p = routeTable;
+    routes = routeCount;
+
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        memcpy( peers[i].mac, macs[i], 6 );
+        linkInit( &peers[i].link );
+
+        if( esp_now_add_peer( peers[i].mac, ESP_NOW_ROLE_SLAVE, 0, NULL, 0 ) != 0 )
+            success = false;
+    }
+
+    if( count > 1 && esp_now_add_peer( broadcastMac, ESP_NOW_ROLE_SLAVE, 0, NULL, 0 ) != 0 )
+        success = false;
+
+    return success;
+}
+
+uint8_t peersCount( void )
+{
+    return count;
+}
+
+// Mask of every node
+uint8_t peersAll( void )
+{
+    return ( 1 << count ) - 1;
+}
+
+uint8_t *peersMac( uint8_t index )
+{
+    return peers[index].mac;
+}
+
+// Index of the node with this MAC address, -1 if it isn't one of ours
+int8_t peersFind( const uint8_t *mac )
+{
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        if( memcmp( peers[i].mac, mac, 6 ) == 0 )
+            return i;
+    }
+
+    return -1;
+}
+
+// Mask of the nodes a capture goes to, 0 if no route matches it
+uint8_t peersRoute( const decode_results *results )
+{
+    for( uint8_t i = 0; i < routes; i++ )
+    {
+        const struct_route *route = &routes_p[i];
+
+        if( route->protocol != ROUTE_ANY && route->protocol != results->decode_type )
+            continue;
+
+        if( ( route->match & ROUTE_MATCH_ADDRESS ) && route->address != results->address )
+            continue;
+
+        if( ( route->match & ROUTE_MATCH_COMMAND ) && route->command != results->command )
+            continue;
+
+        return route->peers & peersAll();
+    }
+
+    return 0;
+}
+
+// Mask of the nodes every frame goes to, whatever it decodes as: those of
+// each route up to the first one that matches anything
+uint8_t peersRouteAlways( void )
+{
+    uint8_t mask = peersAll();
+
+    for( uint8_t i = 0; i < routes; i++ )
+    {
+        mask &= routes_p[i].peers;
+
+        if( routes_p[i].protocol == ROUTE_ANY && routes_p[i].match == 0 )
+            return mask;
+    }
+
+    return 0;
+}
+
+// Addresses to send to so every node in mask gets a packet: the broadcast
+// address if that's all of them, else each of them.
+// Returns the number of addresses.
+uint8_t peersTargets( uint8_t mask, uint8_t **targets )
+{
+    uint8_t n = 0;
+
+    if( count > 1 && mask == peersAll() )
+    {
+        targets[n++] = broadcastMac;
+        return n;
+    }
+
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        if( mask & ( 1 << i ))
+            targets[n++] = peers[i].mac;
+    }
+
+    return n;
+}
+
+// Status of a packet sent, sendUs after it was, called from OnDataSent().
+// Broadcasts always report success, they say nothing about the nodes.
+void peersSent( const uint8_t *mac, uint8_t status, uint32_t sendUs, uint32_t now )
+{
+    if( memcmp( mac, broadcastMac, 6 ) == 0 )
+    {
+        for( uint8_t i = 0; i < count; i++ )
+            linkSent( &peers[i].link, now );
+
+        return;
+    }
+
+    int8_t i = peersFind( mac );
+
+    if( i < 0 )
+        return;
+
+    linkSent( &peers[i].link, now );
+    linkDelivered( &peers[i].link, status == 0, sendUs );
+}
+
+// A packet came in from peer
+void peersHeard( uint8_t peer, const uint8_t *data, uint8_t len, uint32_t now )
+{
+    linkHeard( &peers[peer].link, peers[peer].mac, data, len, now );
+}
+
+// The frame had to be sent again to the nodes in mask
+void peersRetransmit( uint8_t mask )
+{
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        if( mask & ( 1 << i ))
+            linkRetransmit( &peers[i].link );
+    }
+}
+
+// Send a heartbeat to the nodes we had nothing else for lately
+void peersHeartbeat( uint32_t now )
+{
+    for( uint8_t i = 0; i < count; i++ )
+        linkHeartbeat( peers[i].mac, &peers[i].link, now );
+}
+
+// Mask of the nodes whose link is up
+uint8_t peersUp( uint32_t now )
+{
+    uint8_t mask = 0;
+
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        if( linkQuality( &peers[i].link, now ) != LINK_DOWN )
+            mask |= 1 << i;
+    }
+
+    return mask;
+}
+
+// Level of the status LED, see linkLed()
+uint8_t peersLed( uint32_t now )
+{
+    LINK_QUALITY_E worst = LINK_GOOD;
+    LINK_QUALITY_E best = LINK_DOWN;
+
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        LINK_QUALITY_E quality = linkQuality( &peers[i].link, now );
+
+        worst = min( worst, quality );
+        best = max( best, quality );
+    }
+
+    return linkLed( worst, best, now );
+}
+
+void peersPrint( uint32_t now )
+{
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        const struct_peer *p = &peers[i];
+
+        Serial.printf("IRsend %u %02X:%02X:%02X:%02X:%02X:%02X: ",
+                      i, p->mac[0], p->mac[1], p->mac[2], p->mac[3], p->mac[4], p->mac[5]);
+        linkPrint( &p->link, now );
+    }
+
+    linkPrintBatches();
+}
@@ -0,0 +1,47 @@
+/*
+ *  IRrecv:  peers.h - Table of IRsend nodes, routing of frames to them and their link health.
+*/
+#ifndef PEERS_H
+#define PEERS_H
+
+#include <Arduino.h>
+#include <IRrecv.h>
+
+// Largest number of IRsend nodes, peer masks have one bit per node
+#define PEER_MAX                4
+#define PEERS_ALL               0xFF
+
+// struct_route.protocol that matches every protocol
+#define ROUTE_ANY               -1
+
+// struct_route.match, what has to match besides the protocol
+#define ROUTE_MATCH_ADDRESS     0x01
+#define ROUTE_MATCH_COMMAND     0x02
+
+// Sends the frames that match to the IRsend nodes in peers
+typedef struct struct_route
+{
+    int16_t  protocol;      // decode_type_t, or ROUTE_ANY
+    uint8_t  match;         // ROUTE_MATCH_xxx
+    uint32_t address;       // decode_results.address
+    uint32_t command;       // decode_results.command
+    uint8_t  peers;         // bit i sends to peer i, or PEERS_ALL
+} struct_route;
+
+bool peersInit( const uint8_t (*macs)[6], uint8_t count, const struct_route *routes, uint8_t routeCount );
+uint8_t peersCount( void );
+uint8_t peersAll( void );
+uint8_t *peersMac( uint8_t index );
+int8_t peersFind( const uint8_t *mac );
+uint8_t peersRoute( const decode_results *results );
+uint8_t peersRouteAlways( void );
+uint8_t peersTargets( uint8_t mask, uint8_t **targets );
+void peersSent( const uint8_t *mac, uint8_t status, uint32_t sendUs, uint32_t now );
+void peersHeard( uint8_t peer, const uint8_t *data, uint8_t len, uint32_t now );
+void peersRetransmit( uint8_t mask );
+void peersHeartbeat( uint32_t now );
+uint8_t peersUp( uint32_t now );
+uint8_t peersLed( uint32_t now );
+void peersPrint( uint32_t now );
+
+#endif  // PEERS_H
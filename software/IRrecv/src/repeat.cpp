@@ -0,0 +1,75 @@
+/*
+ *  IRrecv:  repeat.cpp - Detection of held buttons, whose frames are sent as short repeats.
+ *
+ *  While a button is held the remote either sends a protocol repeat code (e.g.
+ *  NEC, decoded with the repeat flag set) or sends the same frame over and
+ *  over. Both only repeat the last frame and IRsend can regenerate them from
+ *  the frame it already has, so there is no need to send them in full.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include <IRutils.h>
+#include "repeat.h"
+
+// Longest gap between two frames of a held button. Anything later is a new
+// press and is sent in full again.
+const uint32_t kRepeatWindowMs = 250;
+
+// The last frame sent in full
+static bool lastValid = false;
+static decode_type_t lastProtocol;
+static uint16_t lastBits;
+static uint8_t lastState[kStateSizeMax];    // state[], or value, address & command
+static uint32_t lastTime;                   // time the held button was last seen
+
+// Does the capture only repeat the last frame sent in full?
+bool repeatCheck( const decode_results *results, uint32_t now )
+{
+    if( !lastValid || now - lastTime > kRepeatWindowMs ||
+        results->decode_type != lastProtocol )
+        return false;
+
+    if( results->repeat )
+    {   // Protocol repeat code, it has no value of its own
+        lastTime = now;
+        return true;
+    }
+
+    // Same frame again? For UNKNOWN captures the value is a hash of the timings.
+    if( results->bits != lastBits || results->overflow )
+        return false;
+
+    if( hasACState( results->decode_type ))
+    {
+        if( memcmp( results->state, lastState, results->bits / 8 ) != 0 )
+            return false;
+    }
+    else if( memcmp( &results->value, lastState, sizeof(results->value) ) != 0 )
+        return false;
+
+    lastTime = now;
+    return true;
+}
+
+// Remember the frame that was just sent in full
+void repeatRemember( const decode_results *results, uint32_t now )
+{
+    // A repeat code on its own can't be repeated, there is no frame to go with it
+    if( results->repeat || results->bits / 8 > kStateSizeMax )
+    {
+        lastValid = false;
+        return;
+    }
+
+    lastValid = true;
+    lastProtocol = results->decode_type;
+    lastBits = results->bits;
+    lastTime = now;
+    memcpy( lastState, results->state, sizeof(lastState) );
+}
+
+// The last frame didn't make it to IRsend, so it can't be repeated
+void repeatForget( void )
+{
+    lastValid = false;
+}
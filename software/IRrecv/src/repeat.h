@@ -0,0 +1,13 @@
+/*
+ *  IRrecv:  repeat.h - Detection of held buttons, whose frames are sent as short repeats.
+*/
+#ifndef REPEAT_H
+#define REPEAT_H
+
+#include <IRrecv.h>
+
+bool repeatCheck( const decode_results *results, uint32_t now );
+void repeatRemember( const decode_results *results, uint32_t now );
+void repeatForget( void );
+
+#endif  // REPEAT_H
@@ -0,0 +1,162 @@
+/*
+ *  IRrecv:  stream.cpp - Cut-through streaming of long captures while they are still coming in.
+ *
+ *  An A/C frame can be on the air for a few hundred ms. Relaying it only once
+ *  it's complete more than doubles that: the capture, the timeout, the radio
+ *  and then the whole emission. Once a capture has grown past the length of
+ *  any remote control frame, its timings are sent on in MSG_IR_STREAM chunks
+ *  as they come in, and IRsend starts emitting them after a short jitter
+ *  buffer, while the capture is still going on.
+ *
+ *  The stream isn't acknowledged or retransmitted. Once the capture is over
+ *  it's decoded and sent as usual, under the frameId of the stream: IRsend
+ *  takes it as the stream's frame if it emitted the stream, and emits it if
+ *  the stream failed.
+ *
+ *  The ISR state is watched the same way frameend.cpp does, and the stream
+ *  only goes to the nodes every frame is routed to, whatever it decodes as.
+ *  A capture that looks like noise so far isn't streamed.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include <espnow.h>
+#include "messages.h"
+#include "irframe.h"
+#include "peers.h"
+#include "link.h"
+#include "stream.h"
+#include "noise.h"
+
+namespace _IRrecv
+{
+extern volatile irparams_t params;
+}
+
+static uint16_t startLen = 0;       // rawlen a capture is streamed from, 0 when off
+static uint32_t chunkAir;           // usecs of timings sent in a chunk
+static uint8_t streamMask;
+
+static bool active = false;         // the capture is being streamed
+static uint8_t frameId;
+static uint16_t sent;               // timings of the capture sent so far
+static bool ended;                  // its last chunk was sent
+static uint16_t lastLen = 0;        // rawlen when the capture was last looked at
+
+static uint32_t streams = 0;        // captures streamed
+static uint32_t chunks = 0;         // chunks sent
+static uint32_t refused = 0;        // chunks ESP-NOW didn't take
+
+// Send the timings of rawbuf from index sent + 1 up to len as chunks
+static void streamSend( const volatile uint16_t *rawbuf, uint16_t len, bool end )
+{
+    uint16_t packet[( sizeof(struct_IRstream_hdr) + 2 * IRSTREAM_MAX_RAW + 1 ) / 2];
+    struct_IRstream_hdr *hdr = (struct_IRstream_hdr *)packet;
+    uint16_t *raw = (uint16_t *)( (uint8_t *)packet + sizeof(struct_IRstream_hdr) );
+    uint8_t *targets[PEER_MAX];
+    uint8_t n = peersTargets( streamMask, targets );
+
+    hdr->msg_type = MSG_IR_STREAM;
+    hdr->frameId = frameId;
+
+    do
+    {
+        uint8_t count = 0;
+
+        hdr->offset = sent;
+
+        while( count < IRSTREAM_MAX_RAW && sent + 1 < len )
+        {
+            uint32_t usecs = rawbuf[1 + sent++] * kRawTick;
+
+            raw[count++] = ( usecs > UINT16_MAX ) ? UINT16_MAX : usecs;
+        }
+
+        hdr->count = count;
+        hdr->flags = 0;
+
+        if( end && sent + 1 >= len )
+        {
+            hdr->flags = IRSTREAM_FLAG_END;
+            ended = true;
+        }
+
+        for( uint8_t i = 0; i < n; i++ )
+        {
+            if( !linkSend( targets[i], packet, sizeof(struct_IRstream_hdr) + count * 2 ) )
+                ++ refused;
+        }
+
+        ++ chunks;
+    } while( sent + 1 < len );
+}
+
+// Stream captures once they have startEdges edges, in chunks of about chunkUs
+// of timings, to the peers in mask. Nothing is streamed if mask is 0.
+void streamInit( uint16_t startEdges, uint32_t chunkUs, uint8_t mask )
+{
+    startLen = ( mask != 0 ) ? startEdges : 0;
+    chunkAir = chunkUs;
+    streamMask = mask;
+}
+
+// Send on what came in of a long capture. Called before every decode(), which
+// resumes the capture.
+void streamPoll( void )
+{
+    volatile irparams_t &params = _IRrecv::params;
+    uint16_t len = params.rawlen;
+    bool stopped = ( params.rcvstate == kStopState );
+
+    if( startLen == 0 )
+        return;
+
+    // A new capture, decode() dropped the last one
+    if( len < lastLen )
+        active = false;
+
+    lastLen = len;
+
+    if( !active && !stopped && len >= startLen && !noiseSuspect() )
+    {
+        active = true;
+        frameId = irFrameNewId();
+        sent = 0;
+        ended = false;
+        ++ streams;
+    }
+
+    if( !active || ended )
+        return;
+
+    uint32_t air = 0;
+
+    for( uint16_t i = sent + 1; i < len; i++ )
+        air += params.rawbuf[i] * kRawTick;
+
+    if( stopped || ( air != 0 && air >= chunkAir ))
+        streamSend( params.rawbuf, len, stopped );
+}
+
+// decode() copied the capture out into results.
+// Returns the frameId it was streamed under, -1 if it wasn't streamed.
+int16_t streamEnd( const decode_results *results )
+{
+    lastLen = 0;
+
+    if( !active )
+        return -1;
+
+    active = false;
+
+    // The ISR stopped it after it was last looked at
+    if( !ended )
+        streamSend( results->rawbuf, results->rawlen, true );
+
+    return frameId;
+}
+
+void streamPrint( void )
+{
+    Serial.printf("Streaming: %u captures streamed in %u chunks, %u chunks refused\n",
+                  streams, chunks, refused);
+}
@@ -0,0 +1,15 @@
+/*
+ *  IRrecv:  stream.h - Cut-through streaming of long captures while they are still coming in.
+*/
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <Arduino.h>
+#include <IRrecv.h>
+
+void streamInit( uint16_t startEdges, uint32_t chunkUs, uint8_t mask );
+void streamPoll( void );
+int16_t streamEnd( const decode_results *results );
+void streamPrint( void );
+
+#endif  // STREAM_H
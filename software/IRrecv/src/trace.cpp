@@ -0,0 +1,310 @@
+/*
+ *  IRrecv:  trace.cpp - Binary trace of the captures, to flash or the serial port.
+ *
+ *  With tracing on, every capture is recorded as the ISR saw it: its raw
+ *  timings, what it decoded as and when, noise.cpp's rejects included (see
+ *  trace.h for the format). The records are queued in RAM and written out by
+ *  traceDrain() once loop() is idle, appended to a file on LittleFS or sent
+ *  to the serial port between the lines of the log. A record that doesn't
+ *  fit the queue is dropped.
+ *
+ *  The serial port only gets as much as fits into the UART FIFO at a time,
+ *  like the log, and a record takes several passes of loop(). The log waits
+ *  until the record is out in full, a line amid it would break it. A dump of
+ *  the flash trace goes out the same way.
+ *
+ *  native/trace/trace.py picks the records out of the serial output, and
+ *  the simulator replays a trace through both nodes, at the speed it was
+ *  recorded at or back to back.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include <IRutils.h>
+#include <LittleFS.h>
+#include "events.h"
+#include "trace.h"
+
+const char kTracePath[] = "/trace.bin";
+
+// The flash trace stops growing here, what is left is for everything else
+const uint32_t kTraceMaxBytes = 512 * 1024;
+
+// The UART sends about half its FIFO in this many usecs at 115200 baud, the
+// rest of a record or dump is written after that
+const uint32_t kSerialWaitUs = 5000;
+
+// Records waiting for traceDrain(), a capture of a full buffer takes ~2KB
+#define TRACE_QUEUE     4096
+
+static uint8_t queue[TRACE_QUEUE] __attribute__((aligned(4)));
+static uint16_t queueHead = 0;      // first record not written out yet
+static uint16_t queueLen = 0;
+static uint16_t headSent = 0;       // bytes of it that are on the serial port already
+static struct_trace_hdr header;
+static TRACE_SINK_E sink = TRACE_OFF;
+static TRACE_SINK_E nextSink = TRACE_OFF;   // sink to switch to once no record is half out
+static bool mounted = false;
+static File dumpFile;               // the flash trace being dumped
+
+static uint32_t recorded = 0;   // captures recorded
+static uint32_t dropped = 0;    // and those that didn't fit the queue or the flash
+
+// Queue a record of the capture in rawbuf, whose first entry is the gap
+// before it and the others are in ticks of kRawTick
+static void traceAdd( uint8_t flags, uint32_t captureUs, int16_t protocol, uint16_t bits,
+                      const void *result, uint8_t resultLen, const volatile uint16_t *rawbuf, uint16_t rawlen )
+{
+    uint16_t rawLen = rawlen > 1 ? rawlen - 1 : 0;
+    uint16_t len = resultLen + rawLen * 2;
+
+    if( sink == TRACE_OFF )
+        return;
+
+    // Make room behind the records still waiting
+    if( queueHead != 0 && queueLen + sizeof(struct_trace_rec) + len > TRACE_QUEUE )
+    {
+        memmove( queue, queue + queueHead, queueLen - queueHead );
+        queueLen -= queueHead;
+        queueHead = 0;
+    }
+
+    if( queueLen + sizeof(struct_trace_rec) + len > TRACE_QUEUE )
+    {
+        ++ dropped;
+        return;
+    }
+
+    struct_trace_rec *rec = (struct_trace_rec *)( queue + queueLen );
+    uint8_t *data = queue + queueLen + sizeof(struct_trace_rec);
+
+    rec->sync = TRACE_SYNC;
+    rec->flags = flags;
+    rec->len = len;
+    rec->captureUs = captureUs;
+    rec->protocol = protocol;
+    rec->bits = bits;
+    rec->resultLen = resultLen;
+    rec->rawLen = rawLen;
+
+    memcpy( data, result, resultLen );
+    data += resultLen;
+
+    // The records are packed, the timings may not be aligned
+    for( uint16_t i = 0; i < rawLen; i++ )
+    {
+        uint32_t ticks = rawbuf[i + 1];
+        uint16_t usecs = ticks * kRawTick < UINT16_MAX ? ticks * kRawTick : UINT16_MAX;
+
+        memcpy( data + i * 2, &usecs, 2 );
+    }
+
+    queueLen += sizeof(struct_trace_rec) + len;
+    ++ recorded;
+}
+
+// Mount the file system for the flash trace, the node's capture buffer and
+// timeout go into the header of the trace.
+// Returns false without LittleFS, only the serial trace works then.
+bool traceInit( uint16_t bufSize, uint8_t timeout )
+{
+    memset( &header, 0, sizeof(header) );
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.hdrLen = sizeof(header);
+    header.bufSize = bufSize;
+    header.timeout = timeout;
+
+    mounted = LittleFS.begin();
+
+    return mounted;
+}
+
+// Start recording to sink, or stop. A serial trace starts with its header,
+// a flash trace has it at the start of its file. The records queued so far
+// still go to the old sink, traceDrain() switches once they are out.
+void traceSetSink( TRACE_SINK_E newSink )
+{
+    if( newSink == TRACE_FLASH && !mounted )
+        newSink = TRACE_OFF;
+
+    nextSink = newSink;
+    traceDrain();
+}
+
+TRACE_SINK_E traceSink( void )
+{
+    return nextSink;
+}
+
+// Record a capture that was decoded, copied out at micros() captureUs
+void traceCapture( const decode_results *results, uint32_t captureUs )
+{
+    uint8_t flags = ( results->overflow ? TRACE_FLAG_OVERFLOW : 0 ) | ( results->repeat ? TRACE_FLAG_REPEAT : 0 );
+
+    if( hasACState( results->decode_type ))
+        traceAdd( flags | TRACE_FLAG_STATE, captureUs, results->decode_type, results->bits, results->state,
+                  results->bits / 8 < kStateSizeMax ? results->bits / 8 : kStateSizeMax, results->rawbuf, results->rawlen );
+    else
+        traceAdd( flags, captureUs, results->decode_type, results->bits, &results->value,
+                  sizeof(results->value), results->rawbuf, results->rawlen );
+}
+
+// Record a capture noise.cpp rejected, still in the ISR's buffer
+void traceNoise( const volatile uint16_t *rawbuf, uint16_t rawlen, bool overflow, uint32_t captureUs )
+{
+    traceAdd( TRACE_FLAG_NOISE | ( overflow ? TRACE_FLAG_OVERFLOW : 0 ), captureUs, decode_type_t::UNKNOWN, 0,
+              NULL, 0, rawbuf, rawlen );
+}
+
+// Send what of the flash trace fits into the UART FIFO.
+// Returns false once it's all out.
+static bool traceDumpSome( void )
+{
+    uint8_t buf[128];
+    int room;
+    size_t len;
+
+    while(( room = Serial.availableForWrite() ) > 0 )
+    {
+        len = dumpFile.read( buf, min( (size_t)room, sizeof(buf) ));
+
+        if( len == 0 )
+        {
+            dumpFile.close();
+            return false;
+        }
+
+        Serial.write( buf, len );
+    }
+
+    return true;
+}
+
+// Send what of the queued records fits into the UART FIFO.
+// Returns false once they are all out.
+static bool traceSendSome( void )
+{
+    int room;
+
+    while( queueHead < queueLen && ( room = Serial.availableForWrite() ) > 0 )
+    {
+        const struct_trace_rec *rec = (const struct_trace_rec *)( queue + queueHead );
+        uint16_t recLen = sizeof(struct_trace_rec) + rec->len;
+        uint16_t n = min( (uint16_t)room, (uint16_t)( recLen - headSent ));
+
+        Serial.write( queue + queueHead + headSent, n );
+        headSent += n;
+
+        if( headSent == recLen )
+        {
+            queueHead += recLen;
+            headSent = 0;
+
+            // A dump waited for the record to be out
+            if( dumpFile )
+                break;
+        }
+    }
+
+    return queueHead < queueLen;
+}
+
+// Append the queued records to the flash trace
+static void traceAppend( void )
+{
+    File f = LittleFS.open( kTracePath, "a" );
+    size_t size = f ? f.size() : 0;
+
+    if( !f || size + sizeof(header) + queueLen - queueHead > kTraceMaxBytes )
+        ++ dropped;
+    else
+    {
+        if( size == 0 )
+            f.write( (const uint8_t *)&header, sizeof(header) );
+
+        f.write( queue + queueHead, queueLen - queueHead );
+    }
+
+    if( f )
+        f.close();
+
+    queueHead = queueLen;
+}
+
+// Write the queued records out and go on with a dump, called from loop()
+// while it's idle. What doesn't fit into the UART FIFO is left for later
+// passes, loop() is woken up for them.
+// Returns true while a record or the dump is half out on the serial port,
+// nothing else may be printed then.
+bool traceDrain( void )
+{
+    bool more = false;
+
+    if( dumpFile && headSent == 0 )
+        more = traceDumpSome();
+    else if( sink == TRACE_SERIAL )
+        more = traceSendSome();
+    else if( sink == TRACE_FLASH && queueHead < queueLen )
+        traceAppend();
+
+    // The switch to another sink waits until the old one has it all
+    if( !more && nextSink != sink )
+    {
+        if( nextSink != TRACE_SERIAL )
+            sink = nextSink;
+        else if( Serial.availableForWrite() >= (int)sizeof(header) )
+        {
+            Serial.write( (const uint8_t *)&header, sizeof(header) );
+            sink = nextSink;
+        }
+        else
+            more = true;
+    }
+
+    if( queueHead == queueLen )
+        queueHead = queueLen = 0;
+
+    if( more )
+        eventWakeIn( kSerialWaitUs );
+
+    return headSent != 0 || (bool)dumpFile;
+}
+
+// Send the flash trace to the serial port as it is, traceDrain() sends it
+// bit by bit
+void traceDump( void )
+{
+    if( dumpFile )
+        return;
+
+    dumpFile = mounted ? LittleFS.open( kTracePath, "r" ) : File();
+
+    if( !dumpFile )
+    {
+        Serial.println("No trace in flash");
+        return;
+    }
+
+    traceDrain();
+}
+
+void traceErase( void )
+{
+    if( dumpFile )
+        dumpFile.close();
+
+    if( mounted )
+        LittleFS.remove( kTracePath );
+}
+
+void tracePrint( void )
+{
+    static const char *sinks[] = { "off", "to flash", "to serial" };
+    File f = mounted ? LittleFS.open( kTracePath, "r" ) : File();
+
+    Serial.printf("Trace %s: %u captures recorded, %u dropped, %u bytes in flash\n",
+                  sinks[nextSink], recorded, dropped, f ? (unsigned)f.size() : 0);
+
+    if( f )
+        f.close();
+}
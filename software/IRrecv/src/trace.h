@@ -0,0 +1,71 @@
+/*
+ *  IRrecv:  trace.h - Binary trace of the captures, to flash or the serial port.
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include <IRrecv.h>
+
+// ==================== begin of trace format ====================
+// A trace is a struct_trace_hdr followed by a record for every capture: a
+// struct_trace_rec, then what it decoded as (value or state[]) and then its
+// raw timings. A trace is only ever appended to. Fields are little-endian.
+// NOTE: Keep this section in sync with native/IRsim/corpus.cpp and
+// native/trace/trace.py.
+
+#define TRACE_MAGIC             0x52545249      // "IRTR"
+#define TRACE_VERSION           1
+
+// First byte of every record. It's never in the text the node prints, so the
+// records can be picked out of its serial output.
+#define TRACE_SYNC              0xA5
+
+// struct_trace_rec.flags
+#define TRACE_FLAG_NOISE        0x01    // rejected as noise, never decoded
+#define TRACE_FLAG_OVERFLOW     0x02    // the capture didn't fit the buffer
+#define TRACE_FLAG_REPEAT       0x04    // decoded as a repeat code
+#define TRACE_FLAG_STATE        0x08    // the result is a state[], not a value
+
+typedef struct __attribute__((packed)) struct_trace_hdr
+{
+    uint32_t magic;         // TRACE_MAGIC
+    uint8_t  version;       // TRACE_VERSION
+    uint8_t  hdrLen;        // sizeof(struct_trace_hdr), the first record follows
+    uint16_t bufSize;       // capture buffer of the node, in timings
+    uint8_t  timeout;       // msecs of silence that end a capture
+    uint8_t  reserved[3];
+} struct_trace_hdr;
+
+typedef struct __attribute__((packed)) struct_trace_rec
+{
+    uint8_t  sync;          // TRACE_SYNC
+    uint8_t  flags;         // TRACE_FLAG_xxx
+    uint16_t len;           // bytes following this header, up to the next record
+    uint32_t captureUs;     // micros() when the capture was copied out
+    int16_t  protocol;      // decode_type_t it decoded as, UNKNOWN for noise
+    uint16_t bits;
+    uint8_t  resultLen;     // bytes of value or state[] following
+    uint16_t rawLen;        // mark/space timings in usecs following those
+} struct_trace_rec;
+
+// ==================== end of trace format ====================
+
+typedef enum
+{
+    TRACE_OFF = 0,
+    TRACE_FLASH,            // appended to kTracePath on LittleFS
+    TRACE_SERIAL            // written to the serial port, amid the text
+} TRACE_SINK_E;
+
+bool traceInit( uint16_t bufSize, uint8_t timeout );
+void traceSetSink( TRACE_SINK_E sink );
+TRACE_SINK_E traceSink( void );
+void traceCapture( const decode_results *results, uint32_t captureUs );
+void traceNoise( const volatile uint16_t *rawbuf, uint16_t rawlen, bool overflow, uint32_t captureUs );
+bool traceDrain( void );
+void traceDump( void );
+void traceErase( void );
+void tracePrint( void );
+
+#endif  // TRACE_H
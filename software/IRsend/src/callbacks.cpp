@@ -10,53 +10,340 @@
 #include <espnow.h>
 #include "messages.h"
 #include "callbacks.h"
+#include "irframe.h"
+#include "rxqueue.h"
+#include "latency.h"
+#include "sources.h"
+#include "codekey.h"
+#include "codecache.h"
+#include "stream.h"
+#include "link.h"
+#include "timesync.h"
+#include "events.h"
 
-// Pointer to received data
-static struct_message_rcv *rcvData_p;
-static size_t rcvDataSize = 0;
-static volatile bool *wifiConnectError;     // pointer to overall indication of whether there is a connection error (FALSE is good)
-static volatile bool *IRMessageReceived;    // pointer to overall indication of whether we received an IR data message
+// Pointer to the queue of received IR frames
+static struct_rxqueue *rxQueue_p;
+static struct_IRreassembly reassembly;      // IR frame fragments are reassembled into reassemblyBuf
+static uint8_t reassemblyBuf[IRFRAME_MAX_LEN] __attribute__((aligned(4)));
+static int16_t droppedFrameId = -1;         // last frame dropped because the queue was full
 
+// There is a single reassembly buffer. While one IRrecv's frame is being
+// reassembled, the fragments of the others are ignored until this long
+// after its last fragment. They send theirs again when no ACK comes back.
+const uint32_t kReassemblyHoldMs = 20;
 
+static int8_t reassemblySource = -1;
+static uint32_t reassemblyTime;
+
+// Repeats of the same frame from different IRrecv nodes are collapsed too,
+// their key is set apart from the frame's own
+const uint32_t kRepeatKey = 0x9E3779B9;
+
+// Tell the sender we have the frame. Sent once the packet it came in is
+// handled, loop() may be busy emitting a frame for a while.
+static void sendAck( uint8_t *mac, uint8_t frameId )
+{
+    struct_IRack_hdr ack;
+
+    ack.msg_type = MSG_IR_ACK;
+    ack.frameId = frameId;
+    linkQueue( mac, &ack, sizeof(ack) );
+}
+
+// Ask the sender for the full frame of a code we don't have
+static void sendMiss( uint8_t *mac, uint8_t frameId )
+{
+    struct_IRmiss_hdr miss;
+
+    miss.msg_type = MSG_IR_MISS;
+    miss.frameId = frameId;
+    linkQueue( mac, &miss, sizeof(miss) );
+}
+
+
+
+// Time from the end of a capture on src to its frame coming in at our
+// micros() receiveUs, once the clocks are synced
+static void recordTransit( int8_t src, uint32_t captureUs, uint32_t receiveUs )
+{
+    uint32_t localUs;
+
+    if( timeSyncLocal( src, captureUs, &localUs ))
+        latencyRecordUs( STAGE_TRANSIT, receiveUs - localUs );
+}
 
 // Setup needed callback function data
-void callbacksInit( struct_message_rcv *ptr, size_t size, volatile bool *connectError, volatile bool *messageReceived )
+void callbacksInit( struct_rxqueue *queue )
 {
-    rcvData_p = ptr;
-    rcvDataSize = size;
-    wifiConnectError = connectError;
-    IRMessageReceived = messageReceived;
+    rxQueue_p = queue;
+    irFrameReassemblyInit( &reassembly, reassemblyBuf );
 }
 
 // Callback function called when data is sent
 void OnDataSent( uint8_t *mac_addr, uint8_t status )
 {
-    if( status == 0 )
+    bool marked;
+
+    sourcesSent( mac_addr, status, linkSendDone( &marked ), millis() );
+
+    return;
+}
+
+// Handle one message from the IRrecv src, on its own or out of a batch
+static void receive( uint8_t *mac, int8_t src, const uint8_t *incomingData, uint8_t len,
+                     uint32_t receiveUs, uint32_t now )
+{
+    // Reply with our latency histograms right away, like the ACKs
+    if( len == sizeof(struct_stats_req_hdr) && incomingData[0] == MSG_STATS_REQ )
     {
-        *wifiConnectError = false;
+        uint8_t stats[ESPNOW_MAX_PAYLOAD];
+
+        linkSend( mac, stats, latencyEncode( stats, sizeof(stats) ));
+        return;
     }
-    else
+
+    if( len != 0 && incomingData[0] == MSG_TIME )
     {
-        *wifiConnectError = true;
+        timeSyncReceive( src, incomingData, len, receiveUs );
+        return;
     }
 
-    return;
-}
+    if( len != 0 && incomingData[0] == MSG_IR_STREAM )
+    {
+        streamReceive( src, incomingData, len, now );
+        return;
+    }
 
-// Callback function executed when data is received
-void OnDataRecv( uint8_t *mac, uint8_t *incomingData, uint8_t len )
-{
-    // Get receievd data
-    memcpy(rcvData_p, incomingData, rcvDataSize );
-    
-    if( rcvData_p->msg_type == MSG_IR )
+    // Only IR frames need to be handled, the heartbeat was taken in above
+    if( len == 0 || ( incomingData[0] != MSG_IR && incomingData[0] != MSG_IR_REPEAT && incomingData[0] != MSG_IR_CODE ))
+        return;
+
+    const struct_IRfragment_hdr *hdr = (const struct_IRfragment_hdr *)incomingData;
+
+    if( incomingData[0] == MSG_IR_CODE )
     {
-        rcvData_p->newMessage = true;
+        const struct_IRcode_hdr *code = (const struct_IRcode_hdr *)incomingData;
+
+        if( len != sizeof(struct_IRcode_hdr) )
+            return;
+
+        if( sourcesIsRetransmit( src, code->frameId, now ))
+        {
+            sourcesTally( src, SOURCE_RETRANSMITS );
+            sendAck( mac, code->frameId );
+            return;
+        }
+
+        if( !codeCacheHas( code->code ))
+        {
+            sendMiss( mac, code->frameId );
+            return;
+        }
+
+        struct_rxslot *slot = rxQueueReserve( rxQueue_p );
+
+        if( slot == NULL )
+        {
+            rxQueue_p->drops = rxQueue_p->drops + 1;
+            return;
+        }
+
+        sourcesRemember( src, code->frameId, code->code, now );
+
+        if( sourcesIsDuplicate( src, code->code, now ))
+            sourcesTally( src, SOURCE_DUPLICATES );
+        else
+        {   // loop() loads the frame from the code cache
+            slot->src = src;
+            slot->frameId = code->frameId;
+            slot->key = code->code;
+            slot->repeatCount = 0;
+            slot->frameLen = 0;
+            slot->captureUs = code->captureUs;
+            slot->rxStamp = latencyStamp();
+            rxQueuePublish( rxQueue_p );
+            recordTransit( src, code->captureUs, receiveUs );
+            sourcesTally( src, SOURCE_FRAMES );
+        }
+
+        sendAck( mac, code->frameId );
+        return;
     }
-    else
+
+    // A retransmit of a frame we already have, our ACK must have been lost.
+    // Acknowledge it again once all of its fragments went by.
+    if( incomingData[0] == MSG_IR && len >= sizeof(struct_IRfragment_hdr) && sourcesIsRetransmit( src, hdr->frameId, now ))
     {
-        rcvData_p->newMessage = false;
+        if( hdr->fragIndex + 1 == hdr->fragCount )
+        {
+            sourcesTally( src, SOURCE_RETRANSMITS );
+            sendAck( mac, hdr->frameId );
+        }
+
+        return;
+    }
+
+    struct_rxslot *slot = rxQueueReserve( rxQueue_p );
+
+    // Every slot still holds a frame loop() hasn't retransmitted yet. The
+    // frame isn't acknowledged, so IRrecv sends it again a little later.
+    if( slot == NULL )
+    {   // Count each lost frame once, not once per fragment
+        if( len >= sizeof(struct_IRfragment_hdr) && hdr->frameId != droppedFrameId )
+        {
+            droppedFrameId = hdr->frameId;
+            rxQueue_p->drops = rxQueue_p->drops + 1;
+        }
+
+        return;
+    }
+
+    if( incomingData[0] == MSG_IR_REPEAT )
+    {
+        const struct_IRrepeat_hdr *repeat = (const struct_IRrepeat_hdr *)incomingData;
+
+        if( len < sizeof(struct_IRrepeat_hdr) || repeat->count == 0 || repeat->rawLen > IRREPEAT_MAX_RAW ||
+            len != sizeof(struct_IRrepeat_hdr) + repeat->rawLen * 2 )
+            return;
+
+        // The frame it repeats, whichever IRrecv's copy of it was queued
+        uint32_t key = sourcesFrameKey( src, repeat->frameId, now );
+
+        if( key != 0 && sourcesIsDuplicate( src, key ^ kRepeatKey, now ))
+        {
+            sourcesTally( src, SOURCE_DUPLICATES );
+            return;
+        }
+
+        // Copy the repeat code, if any, so its timings are aligned for sendRaw()
+        memcpy( slot->buf, incomingData + sizeof(struct_IRrepeat_hdr), repeat->rawLen * 2 );
+        slot->frame.raw = (const uint16_t *)slot->buf;
+        slot->frame.packed = NULL;
+        slot->frame.rawLen = repeat->rawLen;
+        slot->src = src;
+        slot->frameId = repeat->frameId;
+        slot->key = key;
+        slot->repeatCount = repeat->count;
+        slot->frameLen = repeat->rawLen * 2;
+        slot->captureUs = repeat->captureUs;
+        slot->rxStamp = latencyStamp();
+        rxQueuePublish( rxQueue_p );
+        recordTransit( src, repeat->captureUs, receiveUs );
+        sourcesTally( src, SOURCE_REPEATS );
+
+        return;
+    }
+
+    if( reassembly.active && reassemblySource != src && now - reassemblyTime < kReassemblyHoldMs )
+    {
+        sourcesTally( src, SOURCE_BUSY );
+        return;
+    }
+
+    // Whatever was left of another IRrecv's frame is abandoned
+    if( reassemblySource != src )
+        irFrameReassemblyInit( &reassembly, reassemblyBuf );
+
+    reassemblySource = src;
+    reassemblyTime = now;
+
+    // Repeats and codes are published in the free slot while a frame's
+    // fragments still come in, the frame only goes into it once it's whole
+    uint16_t frameLen = irFrameReassemble( &reassembly, incomingData, len );
+
+    if( frameLen != 0 )
+        memcpy( slot->buf, reassemblyBuf, frameLen );
+
+    // Frames that don't parse have nothing we could retransmit
+    if( frameLen != 0 && irFrameParse( slot->buf, frameLen, &slot->frame ))
+    {
+        uint32_t key = irCodeKey( slot->buf, frameLen );
+
+        sourcesRemember( src, reassembly.frameId, key, now );
+
+        // Another IRrecv relayed the same press first
+        if( sourcesIsDuplicate( src, key, now ))
+            sourcesTally( src, SOURCE_DUPLICATES );
+        else
+        {
+            slot->src = src;
+            slot->frameId = reassembly.frameId;
+            slot->key = key;
+            slot->repeatCount = 0;
+            slot->frameLen = frameLen;
+            slot->captureUs = hdr->captureUs;
+            slot->rxStamp = latencyStamp();
+            rxQueuePublish( rxQueue_p );
+            recordTransit( src, hdr->captureUs, receiveUs );
+            sourcesTally( src, SOURCE_FRAMES );
+        }
+
+        sendAck( mac, reassembly.frameId );
     }
 
     return;
-}
\ No newline at end of file
+}
+
+// The packet holds nothing but messages an IRrecv sends, at least their
+// headers
+static bool isIRrecvPacket( const uint8_t *data, uint8_t len )
+{
+    uint8_t offset = 0;
+    uint8_t msgLen;
+    const uint8_t *msg;
+    bool any = false;
+
+    while(( msg = linkNext( data, len, &offset, &msgLen )) != NULL )
+    {
+        uint8_t minLen;
+
+        switch( msg[0] )
+        {
+        case MSG_IR:        minLen = sizeof(struct_IRfragment_hdr); break;
+        case MSG_IR_REPEAT: minLen = sizeof(struct_IRrepeat_hdr); break;
+        case MSG_IR_CODE:   minLen = sizeof(struct_IRcode_hdr); break;
+        case MSG_IR_STREAM: minLen = sizeof(struct_IRstream_hdr); break;
+        case MSG_TIME:      minLen = sizeof(struct_time_hdr); break;
+        case MSG_HEARTBEAT: minLen = sizeof(struct_heartbeat_hdr); break;
+        case MSG_STATS_REQ: minLen = sizeof(struct_stats_req_hdr); break;
+        default:            return false;
+        }
+
+        if( msgLen < minLen )
+            return false;
+
+        any = true;
+    }
+
+    return any;
+}
+
+// Callback function executed when data is received
+void OnDataRecv( uint8_t *mac, uint8_t *incomingData, uint8_t len )
+{
+    uint32_t receiveUs = micros();
+    uint32_t now = millis();
+    int8_t src = sourcesFind( mac );
+    uint8_t offset = 0;
+    uint8_t msgLen;
+    const uint8_t *msg;
+
+    // A node we don't know yet is only taken in once it speaks our protocol
+    if( src < 0 && isIRrecvPacket( incomingData, len ))
+        src = sourcesLearn( mac, now );
+
+    if( src < 0 )
+        return;
+
+    // Anything an IRrecv sends, its heartbeat included, shows its link is up
+    sourcesHeard( src, incomingData, len, now );
+
+    while(( msg = linkNext( incomingData, len, &offset, &msgLen )) != NULL )
+        receive( mac, src, msg, msgLen, receiveUs, now );
+
+    // The ACKs for everything in the packet go back together
+    linkFlush();
+
+    // Wake loop() up for the frames queued
+    eventPost( EVENT_RADIO );
+}
@@ -7,7 +7,8 @@
   https://dronebotworkshop.com
 */
 #include <espnow.h>
+#include "rxqueue.h"
 
-void callbacksInit( struct_message_rcv *, size_t, volatile bool *, volatile bool * );
+void callbacksInit( struct_rxqueue * );
 void OnDataSent( uint8_t *, uint8_t );
 void OnDataRecv( uint8_t *mac, uint8_t *incomingData, uint8_t len );
\ No newline at end of file
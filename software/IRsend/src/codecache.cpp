@@ -0,0 +1,303 @@
+/*
+ *  IRsend:  codecache.cpp - Frames learned from IRrecv, to replay by their code id.
+ *
+ *  Every frame emitted is learned under its code id (see codekey.cpp). Once
+ *  IRrecv knows we have a code, it sends just the id in a MSG_IR_CODE and
+ *  the frame is replayed from here. Each code is a file in /codes on
+ *  LittleFS, so what was learned survives a reboot, and the codes used most
+ *  lately are held in RAM as well.
+ *
+ *  OnDataRecv() only ever looks codes up. Loading and learning them touches
+ *  the flash and is left to loop(). A frame to learn is only written once
+ *  the emitter is idle, a flash write stalls the CPU long enough to upset
+ *  the timer1 interrupts of the waveform on the air. Until then it's kept
+ *  aside and already counts as learned.
+*/
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "messages.h"
+#include "codecache.h"
+
+typedef struct struct_code
+{
+    uint32_t code;          // 0 while the entry is free
+    uint16_t len;
+    int8_t ram;             // slot holding the frame in RAM, -1 if none
+    uint32_t lastUsed;      // uses counter when it was last used
+} struct_code;
+
+typedef struct struct_code_ram
+{
+    uint8_t buf[CODECACHE_RAM_LEN] __attribute__((aligned(4)));
+    int8_t entry;           // code held, -1 if none
+} struct_code_ram;
+
+static struct_code codes[CODECACHE_SIZE];
+static struct_code_ram ram[CODECACHE_RAM];
+static bool mounted = false;
+static uint32_t uses = 0;
+
+// The frame to learn next, written by codeCacheFlush()
+static uint8_t pendingBuf[IRFRAME_MAX_LEN] __attribute__((aligned(4)));
+static uint32_t pendingCode = 0;    // 0 if none
+static uint16_t pendingLen;
+
+static uint32_t hits = 0;       // MSG_IR_CODE we had the code of
+static uint32_t misses = 0;     // and those we didn't
+static uint32_t learned = 0;    // codes stored
+
+static void codePath( uint32_t code, char *path )
+{
+    sprintf( path, "/codes/%08x", code );
+}
+
+static int8_t codeFind( uint32_t code )
+{
+    for( uint8_t i = 0; i < CODECACHE_SIZE; i++ )
+    {
+        if( codes[i].code == code && code != 0 )
+            return i;
+    }
+
+    return -1;
+}
+
+// Free entry, or the one used longest ago which is forgotten
+static int8_t codeEvict( void )
+{
+    uint8_t oldest = 0;
+
+    for( uint8_t i = 0; i < CODECACHE_SIZE; i++ )
+    {
+        if( codes[i].code == 0 )
+            return i;
+
+        if( codes[i].lastUsed < codes[oldest].lastUsed )
+            oldest = i;
+    }
+
+    char path[16];
+
+    codePath( codes[oldest].code, path );
+
+    if( mounted )
+        LittleFS.remove( path );
+
+    if( codes[oldest].ram >= 0 )
+        ram[codes[oldest].ram].entry = -1;
+
+    codes[oldest].code = 0;
+
+    return oldest;
+}
+
+// Hold a frame in RAM, in place of the one used longest ago
+static void codeHold( int8_t entry, const uint8_t *frame, uint16_t len )
+{
+    int8_t slot = 0;
+
+    if( len > CODECACHE_RAM_LEN )
+        return;
+
+    for( uint8_t i = 0; i < CODECACHE_RAM; i++ )
+    {
+        if( ram[i].entry < 0 )
+        {
+            slot = i;
+            break;
+        }
+
+        if( codes[ram[i].entry].lastUsed < codes[ram[slot].entry].lastUsed )
+            slot = i;
+    }
+
+    if( ram[slot].entry >= 0 )
+        codes[ram[slot].entry].ram = -1;
+
+    memcpy( ram[slot].buf, frame, len );
+    ram[slot].entry = entry;
+    codes[entry].ram = slot;
+}
+
+// Mount the file system and list the codes learned before. Without it codes
+// are only learned until the next reboot.
+bool codeCacheInit( void )
+{
+    for( uint8_t i = 0; i < CODECACHE_SIZE; i++ )
+    {
+        codes[i].code = 0;
+        codes[i].ram = -1;
+    }
+
+    for( uint8_t i = 0; i < CODECACHE_RAM; i++ )
+        ram[i].entry = -1;
+
+    mounted = LittleFS.begin();
+
+    if( !mounted )
+        return false;
+
+    Dir dir = LittleFS.openDir( "/codes" );
+
+    while( dir.next() )
+    {
+        uint32_t code = strtoul( dir.fileName().c_str(), NULL, 16 );
+        int8_t entry = ( code != 0 && dir.fileSize() <= IRFRAME_MAX_LEN ) ? codeEvict() : -1;
+
+        if( entry >= 0 )
+        {
+            codes[entry].code = code;
+            codes[entry].len = dir.fileSize();
+            codes[entry].lastUsed = 0;
+        }
+    }
+
+    return true;
+}
+
+// We have the code, called from OnDataRecv(). It counts as used, so it isn't
+// forgotten before loop() loads it.
+bool codeCacheHas( uint32_t code )
+{
+    int8_t entry = codeFind( code );
+
+    if( code == pendingCode && code != 0 )
+    {
+        ++ hits;
+        return true;
+    }
+
+    if( entry < 0 )
+    {
+        ++ misses;
+        return false;
+    }
+
+    codes[entry].lastUsed = ++ uses;
+    ++ hits;
+
+    return true;
+}
+
+// Copy the frame of code into buf (IRFRAME_MAX_LEN bytes).
+// Returns its length, 0 if it's gone or can't be read.
+uint16_t codeCacheLoad( uint32_t code, uint8_t *buf )
+{
+    int8_t entry = codeFind( code );
+
+    if( code == pendingCode && code != 0 )
+    {
+        memcpy( buf, pendingBuf, pendingLen );
+        return pendingLen;
+    }
+
+    if( entry < 0 )
+        return 0;
+
+    struct_code *c = &codes[entry];
+
+    c->lastUsed = ++ uses;
+
+    if( c->ram >= 0 )
+    {
+        memcpy( buf, ram[c->ram].buf, c->len );
+        return c->len;
+    }
+
+    char path[16];
+    File file;
+
+    codePath( code, path );
+
+    if( mounted )
+        file = LittleFS.open( path, "r" );
+
+    if( !file || file.read( buf, c->len ) != c->len )
+    {   // The file is gone or truncated, learn the code anew
+        if( file )
+            file.close();
+
+        c->code = 0;
+        return 0;
+    }
+
+    file.close();
+    codeHold( entry, buf, c->len );
+
+    return c->len;
+}
+
+// Write the frame of code to flash and hold it in RAM
+static void codeLearn( uint32_t code, const uint8_t *frame, uint16_t len )
+{
+    int8_t entry = codeEvict();
+    char path[16];
+
+    codePath( code, path );
+
+    if( mounted )
+    {
+        File file = LittleFS.open( path, "w" );
+
+        if( !file )
+            return;
+
+        if( file.write( frame, len ) != len )
+        {
+            file.close();
+            LittleFS.remove( path );
+            return;
+        }
+
+        file.close();
+    }
+    else if( len > CODECACHE_RAM_LEN )
+        return;     // without flash only what fits the RAM is kept
+
+    codes[entry].code = code;
+    codes[entry].len = len;
+    codes[entry].ram = -1;
+    codes[entry].lastUsed = ++ uses;
+    codeHold( entry, frame, len );
+    ++ learned;
+}
+
+// Learn the frame of code, if we don't have it yet. It's written by the next
+// codeCacheFlush(), a frame still waiting for that is replaced.
+void codeCacheStore( uint32_t code, const uint8_t *frame, uint16_t len )
+{
+    if( code == 0 || codeFind( code ) >= 0 || len > IRFRAME_MAX_LEN )
+        return;
+
+    memcpy( pendingBuf, frame, len );
+    pendingLen = len;
+    pendingCode = code;
+}
+
+// Write the frame codeCacheStore() kept aside, only while nothing is emitted
+void codeCacheFlush( void )
+{
+    if( pendingCode == 0 )
+        return;
+
+    codeLearn( pendingCode, pendingBuf, pendingLen );
+    pendingCode = 0;
+}
+
+void codeCachePrint( void )
+{
+    uint8_t count = 0;
+    uint8_t held = 0;
+
+    for( uint8_t i = 0; i < CODECACHE_SIZE; i++ )
+    {
+        if( codes[i].code != 0 )
+            ++ count;
+
+        if( codes[i].code != 0 && codes[i].ram >= 0 )
+            ++ held;
+    }
+
+    Serial.printf("IRsend code cache: %u codes (%u in RAM)%s, %u hits, %u misses, %u learned\n",
+                  count, held, mounted ? "" : ", no flash", hits, misses, learned);
+}
@@ -0,0 +1,23 @@
+/*
+ *  IRsend:  codecache.h - Frames learned from IRrecv, to replay by their code id.
+*/
+#ifndef CODECACHE_H
+#define CODECACHE_H
+
+#include <Arduino.h>
+
+// Number of codes kept in flash, and of those the ones also held in RAM.
+// Only frames up to CODECACHE_RAM_LEN bytes are held in RAM, that's any
+// decoded protocol. Long raw frames are read back from flash.
+#define CODECACHE_SIZE      64
+#define CODECACHE_RAM       16
+#define CODECACHE_RAM_LEN   96
+
+bool codeCacheInit( void );
+bool codeCacheHas( uint32_t code );
+uint16_t codeCacheLoad( uint32_t code, uint8_t *buf );
+void codeCacheStore( uint32_t code, const uint8_t *frame, uint16_t len );
+void codeCacheFlush( void );
+void codeCachePrint( void );
+
+#endif  // CODECACHE_H
@@ -0,0 +1,366 @@
+/*
+ *  IRsend:  emitter.cpp - Timer driven emission of mark/space waveforms, loop() goes on meanwhile.
+ *
+ *  IRsend::sendRaw() busy-waits through every mark and space of a frame,
+ *  more than 100 ms for an A/C, and loop() with it: no ACKs, no heartbeats,
+ *  frames pile up in the queue. Instead the emitter is handed the timings
+ *  and plays them from the timer1 interrupt. It modulates the carrier itself
+ *  by toggling the LED every half period, like the core's waveform generator
+ *  does (which shares timer1, so analogWrite() and tone() are out on IRsend).
+ *  Every edge is due at an absolute CPU cycle count, the latency of the
+ *  interrupt doesn't add up over a frame. A late interrupt, when the radio
+ *  held it up, plays what it missed straight away; how late is counted.
+ *
+ *  emitterPlay() returns once the first mark is on, emitterBusy() tells when
+ *  the frame is over and emitterLeft() how long that takes. Only one frame
+ *  is on the air at a time. Frames only the protocol's encoder can produce
+ *  still go out through IRsend::send(), which blocks.
+ *
+ *  A capture IRrecv streams starts with emitterStream() before all of it is
+ *  in, the rest is fed to the emitter as it comes in. A mark can't wait for
+ *  its timing, so running out of them before one is fatal. A space is
+ *  stretched by up to a quarter while its timing is on its way. Otherwise
+ *  the emission is abandoned, followed by a gap of silence, and
+ *  emitterResult() says how far it got.
+*/
+#include <Arduino.h>
+#include <IRsend.h>
+#include <atomic>
+#include "emitter.h"
+
+// An edge due within this many usecs is played right away, taking the
+// interrupt would make it later
+const uint32_t kIsrUs = 2;
+
+// Longest countdown of timer1, longer waits take more than one interrupt
+const uint32_t kTimerMaxTicks = 0x7FFFFF;
+
+// A space whose timing isn't in yet looks for it this often
+const uint32_t kWaitPollUs = 100;
+
+// A frame that runs late, or a stream waiting for its timings, is looked at
+// again by loop() this often
+const uint32_t kOverdueUs = 1000;
+
+static uint8_t ledPin;
+static uint16_t timings[EMITTER_MAX_RAW];
+static std::atomic<uint16_t> len;     // timings in, a stream's grow while it's played
+static volatile bool busy = false;
+
+// A stream, whose timings are fed in while it's played
+static volatile bool open = false;      // more of them are to come
+static volatile bool broken = false;    // some went missing, it can't be played in full
+static bool waiting = false;            // a space is waiting for its timing
+static bool abandoned;
+static uint32_t abortGapUs;
+
+// Where the ISR is in the waveform. Times are ESP.getCycleCount() values.
+static uint16_t pos;                // next timing to play
+static uint16_t copiesLeft;         // repeats still to play after this copy
+static uint32_t gapUs;              // space before each repeat
+static bool marking;                // the current timing is a mark
+static uint8_t level;               // of the LED
+static uint32_t segmentEnd;         // when the current timing is over
+static uint32_t carrierAt;          // when the LED is next toggled during a mark
+static uint32_t highCycles;         // of a carrier period
+static uint32_t lowCycles;
+static uint32_t cyclesPerUs;
+static uint32_t isrCycles;
+static uint8_t tickShift;           // CPU cycles to timer1 ticks, which run at 5MHz
+static uint32_t endAt;              // when the last copy is over
+
+static uint32_t played = 0;         // frames emitted
+static uint32_t streams = 0;        // of those, streamed
+static uint32_t underruns = 0;      // streams abandoned for lack of timings
+static uint32_t refused = 0;        // frames that came while busy, or didn't fit
+static uint64_t airUs = 0;          // time they were on the air
+static uint32_t maxLate = 0;        // cycles an edge was played late, at most
+
+// Give up on a stream at the start of a space, the silence that follows
+// makes the receiving device drop the partial frame
+static void IRAM_ATTR emitterAbandon( void )
+{
+    marking = false;
+    level = LOW;
+    digitalWrite( ledPin, LOW );
+
+    open = false;
+    waiting = false;
+    abandoned = true;
+    ++ underruns;
+    segmentEnd += abortGapUs * cyclesPerUs;
+}
+
+// Move on to the next timing, at segmentEnd. Returns false once the last
+// copy was played.
+static bool IRAM_ATTR emitterNext( void )
+{
+    uint32_t start = segmentEnd;
+    bool wasMarking = marking;
+    uint32_t usecs;
+
+    // The silence after an abandoned stream is over
+    if( abandoned )
+        return false;
+
+    if(( pos & 1 ) && broken )
+    {
+        emitterAbandon();
+        return true;
+    }
+
+    if( pos < len.load( std::memory_order_acquire ))
+    {
+        marking = !( pos & 1 );
+        usecs = timings[pos++];
+    }
+    else if( open && ( pos & 1 ))
+    {   // The space starts, its timing isn't in yet
+        waiting = true;
+        usecs = 0;
+        marking = false;
+    }
+    else if( open )
+    {
+        emitterAbandon();
+        return true;
+    }
+    else if( copiesLeft != 0 )
+    {   // The gap before the next copy
+        -- copiesLeft;
+        pos = 0;
+        marking = false;
+        usecs = gapUs;
+    }
+    else
+        return false;
+
+    segmentEnd += usecs * cyclesPerUs;
+
+    if( marking && !wasMarking )
+    {   // The carrier starts with the mark
+        level = HIGH;
+        digitalWrite( ledPin, HIGH );
+        carrierAt = start + highCycles;
+    }
+    else if( !marking && wasMarking )
+    {
+        level = LOW;
+        digitalWrite( ledPin, LOW );
+    }
+
+    return true;
+}
+
+// Play every edge that is due, then have timer1 call back for the next one
+static void IRAM_ATTR emitterIsr( void )
+{
+    for( ;; )
+    {
+        if( waiting )
+        {   // The space started at segmentEnd
+            uint32_t waited = ESP.getCycleCount() - segmentEnd;
+
+            if( pos < len.load( std::memory_order_acquire ))
+            {   // Its timing came in, unless that's too late
+                uint32_t space = timings[pos] * cyclesPerUs;
+
+                waiting = false;
+
+                if( waited > space + space / 4 )
+                    emitterAbandon();
+                else
+                    emitterNext();
+
+                continue;
+            }
+
+            if( !broken && waited <= ( UINT16_MAX + UINT16_MAX / 4 ) * cyclesPerUs )
+            {
+                timer1_write( ( kWaitPollUs * cyclesPerUs ) >> tickShift );
+                return;
+            }
+
+            waiting = false;
+            emitterAbandon();
+            continue;
+        }
+
+        bool toggle = marking && (int32_t)( carrierAt - segmentEnd ) < 0;
+        uint32_t due = toggle ? carrierAt : segmentEnd;
+        int32_t wait = (int32_t)( due - ESP.getCycleCount() );
+
+        if( wait > (int32_t)isrCycles )
+        {
+            uint32_t ticks = (uint32_t)wait >> tickShift;
+
+            timer1_write( ticks < kTimerMaxTicks ? ticks : kTimerMaxTicks );
+            return;
+        }
+
+        if( wait < 0 && (uint32_t)-wait > maxLate )
+            maxLate = -wait;
+
+        if( toggle )
+        {   // The next half period of the carrier
+            level = !level;
+            digitalWrite( ledPin, level );
+            carrierAt += level ? highCycles : lowCycles;
+        }
+        else if( !emitterNext() )
+        {
+            digitalWrite( ledPin, LOW );
+            timer1_disable();
+            busy = false;
+            return;
+        }
+    }
+}
+
+// The IR LED is on pin, the one IRsend drives as well
+void emitterInit( uint8_t pin )
+{
+    ledPin = pin;
+    pinMode( ledPin, OUTPUT );
+    digitalWrite( ledPin, LOW );
+}
+
+// Start playing count mark/space timings, fed is true if they are a stream
+// and more of them are fed in later
+static bool emitterStart( const uint16_t *buf, uint16_t count, uint16_t hz, uint16_t repeat, uint32_t gap, bool fed )
+{
+    if( busy || count == 0 || count > EMITTER_MAX_RAW || hz == 0 )
+    {
+        ++ refused;
+        return false;
+    }
+
+    uint8_t mhz = ESP.getCpuFreqMHz();
+    uint32_t period = mhz * 1000000 / hz;
+    uint32_t usecs = 0;
+
+    memcpy( timings, buf, count * sizeof(timings[0]) );
+
+    for( uint16_t i = 0; i < count; i++ )
+        usecs += timings[i];
+
+    usecs = usecs * ( repeat + 1 ) + gap * repeat;
+
+    len.store( count );
+    open = fed;
+    broken = false;
+    waiting = false;
+    abandoned = false;
+    pos = 0;
+    copiesLeft = repeat;
+    gapUs = gap;
+    marking = false;
+    level = LOW;
+    highCycles = period * kDutyDefault / 100;
+    lowCycles = period - highCycles;
+    cyclesPerUs = mhz;
+    isrCycles = kIsrUs * mhz;
+    tickShift = mhz > 80 ? 5 : 4;
+
+    ++ played;
+    airUs += usecs;
+    busy = true;
+
+    timer1_attachInterrupt( emitterIsr );
+    timer1_enable( TIM_DIV16, TIM_EDGE, TIM_SINGLE );
+
+    // The timer isn't running yet, the first mark starts right here
+    segmentEnd = ESP.getCycleCount();
+    endAt = segmentEnd + usecs * cyclesPerUs;
+    emitterIsr();
+
+    return true;
+}
+
+// Start playing len mark/space timings at a carrier of hz, followed by
+// repeat repeats of them with gap usecs of space before each. The timings
+// are copied, the caller may reuse them right away.
+// Returns false if a frame is still on the air or it doesn't fit.
+bool emitterPlay( const uint16_t *buf, uint16_t count, uint16_t hz, uint16_t repeat, uint32_t gap )
+{
+    return emitterStart( buf, count, hz, repeat, gap, false );
+}
+
+// Start playing the first count timings of a stream at a carrier of hz, last
+// if they are all of it. If it has to be abandoned, abortGap usecs of
+// silence follow.
+bool emitterStream( const uint16_t *buf, uint16_t count, uint16_t hz, bool last, uint32_t abortGap )
+{
+    abortGapUs = abortGap;
+
+    if( !emitterStart( buf, count, hz, 0, 0, !last ))
+        return false;
+
+    ++ streams;
+
+    return true;
+}
+
+// The next count timings of the stream being played came in, last if they
+// are the end of it. Timings that went missing (buf NULL), or that don't
+// fit, break it.
+void emitterFeed( const uint16_t *buf, uint16_t count, bool last )
+{
+    if( !open )
+        return;
+
+    uint16_t in = len.load( std::memory_order_relaxed );
+
+    if( buf == NULL || in + count > EMITTER_MAX_RAW )
+    {
+        broken = true;
+        return;
+    }
+
+    // The ISR only ever looks at timings below len
+    uint32_t usecs = 0;
+
+    memcpy( &timings[in], buf, count * sizeof(timings[0]) );
+    len.store( in + count, std::memory_order_release );
+
+    for( uint16_t i = 0; i < count; i++ )
+        usecs += buf[i];
+
+    airUs += usecs;
+    endAt += usecs * cyclesPerUs;
+
+    if( last )
+        open = false;
+}
+
+// How the last emission went: the timings that went out are returned in
+// *sent. Returns false if it was a stream and had to be abandoned.
+bool emitterResult( uint16_t *sent )
+{
+    *sent = pos;
+
+    return !abandoned;
+}
+
+// A frame is still on the air
+bool emitterBusy( void )
+{
+    return busy;
+}
+
+// Usecs until the frame on the air is over, 0 if there is none
+uint32_t emitterLeft( void )
+{
+    int32_t left = (int32_t)( endAt - ESP.getCycleCount() );
+
+    if( !busy )
+        return 0;
+
+    return left > 0 ? left / cyclesPerUs : kOverdueUs;
+}
+
+void emitterPrint( void )
+{
+    Serial.printf("IRsend emitter: %u frames played (%u streamed, %u of those abandoned), %u ms on the air, %u refused, edges up to %u us late\n",
+                  played, streams, underruns, (uint32_t)( airUs / 1000 ), refused, cyclesPerUs != 0 ? maxLate / cyclesPerUs : 0);
+}
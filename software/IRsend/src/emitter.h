@@ -0,0 +1,22 @@
+/*
+ *  IRsend:  emitter.h - Timer driven emission of mark/space waveforms, loop() goes on meanwhile.
+*/
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include <Arduino.h>
+#include "messages.h"
+
+// Timings of the longest waveform, the emitter plays its own copy
+#define EMITTER_MAX_RAW     IRFRAME_MAX_RAW
+
+void emitterInit( uint8_t pin );
+bool emitterPlay( const uint16_t *timings, uint16_t len, uint16_t hz, uint16_t repeat, uint32_t gap );
+bool emitterStream( const uint16_t *timings, uint16_t len, uint16_t hz, bool last, uint32_t abortGap );
+void emitterFeed( const uint16_t *timings, uint16_t len, bool last );
+bool emitterResult( uint16_t *sent );
+bool emitterBusy( void );
+uint32_t emitterLeft( void );
+void emitterPrint( void );
+
+#endif  // EMITTER_H
@@ -0,0 +1,106 @@
+/*
+ *  IRsend:  irframe.cpp - Reassembly of IR frame fragments received over ESP-NOW and parsing of the frames.
+ *
+ *  IRrecv splits every serialized frame (see messages.h) into numbered
+ *  fragments. They are copied into a preallocated buffer at the offset given by
+ *  their index, and the frame is complete once every fragment has arrived.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include "messages.h"
+#include "irframe.h"
+#include "rawpack.h"
+
+// Setup the reassembly of frames into buf (IRFRAME_MAX_LEN bytes)
+void irFrameReassemblyInit( struct_IRreassembly *reasm, uint8_t *buf )
+{
+    reasm->buf = buf;
+    reasm->active = false;
+    reasm->received = 0;
+}
+
+// Add a received MSG_IR fragment to the frame being reassembled. A fragment of
+// a different frame abandons the incomplete one.
+// Returns the length of the frame when this fragment completed it, 0 otherwise.
+uint16_t irFrameReassemble( struct_IRreassembly *reasm, const uint8_t *data, uint8_t len )
+{
+    const struct_IRfragment_hdr *hdr = (const struct_IRfragment_hdr *)data;
+
+    if( len < sizeof(struct_IRfragment_hdr) )
+        return 0;
+
+    uint16_t size = len - sizeof(struct_IRfragment_hdr);
+    uint16_t offset = hdr->fragIndex * IRFRAGMENT_MAX_DATA;
+
+    // Reject anything that would not fit the buffer
+    if( hdr->fragCount == 0 || hdr->fragCount > IRFRAME_MAX_FRAGMENTS ||
+        hdr->fragIndex >= hdr->fragCount || hdr->frameLen > IRFRAME_MAX_LEN ||
+        offset + size > hdr->frameLen )
+        return 0;
+
+    if( !reasm->active || reasm->frameId != hdr->frameId || reasm->frameLen != hdr->frameLen )
+    {   // Start of a new frame
+        reasm->active = true;
+        reasm->frameId = hdr->frameId;
+        reasm->fragCount = hdr->fragCount;
+        reasm->frameLen = hdr->frameLen;
+        reasm->received = 0;
+    }
+
+    memcpy( reasm->buf + offset, data + sizeof(struct_IRfragment_hdr), size );
+    reasm->received |= 1 << hdr->fragIndex;
+
+    if( reasm->received != (1 << reasm->fragCount) - 1 )
+        return 0;
+
+    reasm->active = false;
+
+    return reasm->frameLen;
+}
+
+// Rebuild the capture carried by a reassembled frame.
+// Returns false if the frame is malformed.
+bool irFrameParse( const uint8_t *buf, uint16_t len, struct_IRframe *frame )
+{
+    const struct_IRframe_hdr *hdr = (const struct_IRframe_hdr *)buf;
+    decode_results *results = &frame->results;
+
+    if( len < sizeof(struct_IRframe_hdr) )
+        return false;
+
+    uint16_t stateSize = (hdr->stateLen + 1) & ~1;
+    const uint8_t *raw = buf + sizeof(struct_IRframe_hdr) + stateSize;
+    bool packed = hdr->flags & IRFRAME_FLAG_PACKED;
+
+    if( hdr->stateLen > kStateSizeMax || hdr->rawLen > IRFRAME_MAX_RAW || sizeof(struct_IRframe_hdr) + stateSize > len )
+        return false;
+
+    // Packed timings run up to the end of the frame and must unpack to rawLen
+    if( packed ? !rawUnpack( raw, buf + len - raw, NULL, hdr->rawLen ) : raw + hdr->rawLen * 2 != buf + len )
+        return false;
+
+    memset( results, 0, sizeof(decode_results) );
+    results->decode_type = (decode_type_t)hdr->protocol;
+    results->bits = hdr->bits;
+    results->repeat = hdr->flags & IRFRAME_FLAG_REPEAT;
+    results->overflow = hdr->flags & IRFRAME_FLAG_OVERFLOW;
+
+    if( hdr->stateLen != 0 )
+    {   // state[] shares its memory with value, address and command
+        memcpy( results->state, buf + sizeof(struct_IRframe_hdr), hdr->stateLen );
+    }
+    else
+    {
+        results->value = hdr->value;
+        results->address = hdr->address;
+        results->command = hdr->command;
+    }
+
+    frame->rawLen = hdr->rawLen;
+    frame->raw = ( hdr->rawLen && !packed ) ? (const uint16_t *)raw : NULL;
+    frame->packed = ( hdr->rawLen && packed ) ? raw : NULL;
+    frame->packedLen = packed ? buf + len - raw : 0;
+
+    return true;
+}
+
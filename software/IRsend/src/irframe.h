@@ -0,0 +1,34 @@
+/*
+ *  IRsend:  irframe.h - Reassembly of IR frame fragments received over ESP-NOW and parsing of the frames.
+*/
+#ifndef IRFRAME_H
+#define IRFRAME_H
+
+#include <IRrecv.h>
+
+// State of the frame currently being reassembled
+typedef struct struct_IRreassembly
+{
+    uint8_t *buf;           // preallocated buffer of IRFRAME_MAX_LEN bytes
+    bool active;            // a frame is being reassembled into buf
+    uint8_t frameId;
+    uint8_t fragCount;
+    uint16_t frameLen;
+    uint16_t received;      // bit mask of the fragments received so far
+} struct_IRreassembly;
+
+// A parsed frame, ready to be retransmitted
+typedef struct struct_IRframe
+{
+    decode_results results;     // the capture as decoded by IRrecv, rawbuf is not used
+    const uint16_t *raw;        // mark/space timings in usecs, NULL when not sent or packed
+    const uint8_t *packed;      // the timings packed by rawPack(), NULL when not
+    uint16_t packedLen;
+    uint16_t rawLen;            // timings, 0 when not sent
+} struct_IRframe;
+
+void irFrameReassemblyInit( struct_IRreassembly *reasm, uint8_t *buf );
+uint16_t irFrameReassemble( struct_IRreassembly *reasm, const uint8_t *data, uint8_t len );
+bool irFrameParse( const uint8_t *buf, uint16_t len, struct_IRframe *frame );
+
+#endif  // IRFRAME_H
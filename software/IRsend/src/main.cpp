@@ -14,8 +14,20 @@
 #include <espnow.h>
 #include "messages.h"
 #include "callbacks.h"
-
-#define HEARTBEAT_1_SEC     1000    // Sync up with IRrecv once every second
+#include "irframe.h"
+#include "latency.h"
+#include "logring.h"
+#include "heapstats.h"
+#include "sources.h"
+#include "codecache.h"
+#include "waveform.h"
+#include "stream.h"
+#include "link.h"
+#include "timesync.h"
+#include "playout.h"
+#include "profile.h"
+#include "events.h"
+#include "emitter.h"
 
 // ==================== start of TUNEABLE PARAMETERS ====================
 
@@ -36,9 +48,33 @@ const uint16_t kCaptureBufferSize = 1024;  // 1024 == ~511 bits
 // message ended.
 const uint8_t kTimeout = 50;  // Milli-Seconds
 
-// kFrequency is the modulation frequency all UNKNOWN messages will be sent at.
+// kFrequency is the modulation frequency all UNKNOWN messages will be sent at,
+// and the waveforms of protocols that have no carrier of their own.
 const uint16_t kFrequency = 38000;  // in Hz. e.g. 38kHz.
 
+// kRawRepeatGap is the gap in usecs between repeats of an UNKNOWN message, its
+// raw timings don't include the gap the remote left between them.
+const uint32_t kRawRepeatGap = 40000;
+
+// A capture IRrecv streams while it's still coming in is emitted once this
+// many usecs of it are in, the jitter buffer that rides out late chunks. One
+// that runs out of timings anyway is abandoned, followed by kRawRepeatGap of
+// silence, and emitted from the frame IRrecv sends after it.
+const uint32_t kStreamPrebufferUs = 20000;
+
+// The clock of each IRrecv is synced with ours every kTimeSyncMs. Playout
+// needs it, otherwise it's only done if kTransitStats asks for the time from
+// capture to arrival in the latency stats.
+const uint32_t kTimeSyncMs = 2000;
+const bool kTransitStats = false;
+
+// kPlayoutUs is the fixed latency frames are emitted at after their capture
+// was over on IRrecv, so repeats and macros keep their spacing whatever the
+// radio did to them. It has to cover the slowest delivery that should still
+// be on time, retransmits included. 0 emits frames as soon as they are in.
+// Streamed captures are emitted as they come in either way.
+const uint32_t kPlayoutUs = 0;
+
 // How much percentage lee way do we give to incoming signals in order to match
 // it?
 // e.g. +/- 25% (default) to an expected value of 500 would mean matching a
@@ -49,32 +85,98 @@ const uint16_t kFrequency = 38000;  // in Hz. e.g. 38kHz.
 //       your remote's message some of the time, but not all of the time.
 const uint8_t kTolerancePercentage = kTolerance;  // kTolerance is normally 25%
 
+// Where more than one IRrecv sees the remote, they all relay each press. The
+// same frame from another IRrecv within kDupWindowMs of the first copy is
+// dropped, or toggles like "power" would be sent twice. It covers IRrecv's
+// retransmits, keep it at least as long as its kDeliveryDeadlineMs.
+const uint32_t kDupWindowMs = 300;
+
+// loop() idles between events (see events.cpp). Heartbeats, clock syncs and
+// the LED are looked after every kEventTickMs, a frame that comes in wakes
+// it up straight away.
+const uint32_t kEventTickMs = 10;
+
 // ==================== end of TUNEABLE PARAMETERS ====================
 
 // The IR transmitter.
 IRsend irsend(kIrLedPin);
 
 // ==================== begin of WiFi related data ====================
-// MAC Address of responder - edit as required
-uint8_t broadcastAddress[] = 
+// MAC Addresses of the IRrecv nodes - edit as required. Others are added
+// once they are heard from, up to SOURCE_MAX of them.
+const uint8_t kReceivers[][6] =
 {
-  0x50, 0x02, 0x91, 0xEC, 0x18, 0xC5
+    { 0x50, 0x02, 0x91, 0xEC, 0x18, 0xC5 },
 };
 
-// Create a structured object for received data
-struct_message_rcv rcvData;
+// Queue of received IR frames waiting to be retransmitted
+struct_rxqueue rxQueue;
 
-// Create a structured object for sent data
-struct_message_xmit xmitData;
+// Copy of the last frame retransmitted in full, held buttons repeat it
+static uint8_t lastFrameBuf[IRFRAME_MAX_LEN] __attribute__((aligned(4)));
+static struct_IRframe lastFrame;
+static uint8_t lastFrameId;
+static uint32_t lastFrameKey;
+static bool lastFrameValid = false;
 
-// ESP-NOW Peer info
-//esp_now_peer_info_t peerInfo;
+// The frame the emitter is playing, its emit stage ends once it's over
+static bool emitting = false;
+static uint32_t emitStart;
 
-// Variable for connection error  - true is error state
-static volatile bool wifiConnectError = true;
+// Print a record of the deferred log
+static void printLogRecord( const struct_logrec *rec )
+{
+    switch( rec->event )
+    {
+    case LOG_EV_FRAME:
+        // Display the basic output of what we found, as long as the frame
+        // is still around.
+        if( logLevel() >= LOG_DEBUG && lastFrameValid && lastFrameId == rec->frameId )
+        {
+            Serial.printf(D_STR_TIMESTAMP " : %06u.%03u\n", rec->time / 1000, rec->time % 1000);
+            Serial.print(resultToHumanReadableBasic(&lastFrame.results));
+
+            // Display any extra A/C info if we have it.
+            String description = IRAcUtils::resultAcToString(&lastFrame.results);
+
+            if (description.length()) Serial.println(D_STR_MESGDESC ": " + description);
+        }
+
+        // Display a crude timestamp & notification.
+        Serial.printf(
+            "%06u.%03u: A %d-bit %s message was %ssuccessfully retransmitted.\n",
+            rec->time / 1000, rec->time % 1000, rec->bits, typeToString((decode_type_t)rec->protocol).c_str(),
+            rec->success ? "" : "un");
+
+        if( logLevel() >= LOG_DEBUG )
+            Serial.printf("RX queue: %u waiting, high-water %u/%u, %u dropped\n",
+                          rec->arg[0], rxQueue.highWater, RXQUEUE_SIZE, rxQueue.drops);
+        break;
+
+    case LOG_EV_OVERFLOW:
+        // IRrecv got an IR message that was to big for its capture buffer.
+        Serial.printf(D_WARN_BUFFERFULL "\n", kCaptureBufferSize);
+        break;
+
+    case LOG_EV_REPEAT:
+        Serial.printf("%06u.%03u: %u repeat(s) of frame %u %s.\n",
+                      rec->time / 1000, rec->time % 1000, rec->arg[0], rec->frameId,
+                      rec->success ? "retransmitted" : "dropped");
+        break;
+
+    case LOG_EV_STREAM:
+        Serial.printf("%06u.%03u: Stream of frame %u %s after %u timings.\n",
+                      rec->time / 1000, rec->time % 1000, rec->frameId,
+                      rec->success ? "retransmitted" : "abandoned", rec->arg[0]);
+        break;
+    }
+}
 
-// Variable to signal receipt of an IR message to decode / repeat
-static volatile bool IRMessageReceived = false;
+// Events nothing posts, checked while loop() idles
+static uint8_t pollEvents( void )
+{
+    return Serial.available() ? EVENT_SERIAL : 0;
+}
 
 // Variable for connection status string
 String connectStatus = "NO INFO";
@@ -86,6 +188,7 @@ void setup()
     digitalWrite(statusLedPin, LOW);    // Turn light off
 
     irsend.begin();       // Start up the IR sender.
+    emitterInit( kIrLedPin );
 
     Serial.begin(kBaudRate, SERIAL_8N1);
 
@@ -108,13 +211,11 @@ void setup()
     if (esp_now_init() != 0)
     {
         Serial.println("Error initializing ESP-NOW");
-        wifiConnectError = true;
         return;
     }
     else
     {
         Serial.println("Initialized ESP-NOW");
-        wifiConnectError = false;
     }
 
     // Set role to combo
@@ -126,135 +227,326 @@ void setup()
     // Register the send callback
     esp_now_register_send_cb( OnDataSent );
 
-    // Register peer
-    //memcpy(peerInfo.peer_addr, broadcastAddress, 6);
-    //peerInfo.channel = 0;
-    //peerInfo.encrypt = false;
+    // Take the RSSI of what comes in
+    linkRssiInit();
 
-    // Add peer
-    if( esp_now_add_peer( broadcastAddress, ESP_NOW_ROLE_SLAVE, 0, NULL, 0 ) != 0 )
-    {
-        Serial.println("No peer added");
-        wifiConnectError = true;
-        return;
+    // Add the IRrecv nodes as peers
+    sourcesInit( kReceivers, sizeof(kReceivers) / sizeof(kReceivers[0]), kDupWindowMs );
+    Serial.println("ESP-NOW Ready");
+    
+    Serial.println("SmartIRRepeater is now running and waiting for IR input on Pin ");
+
+    // Display the library version the messages are sent with.
+    Serial.println(D_STR_LIBRARY "   : v" _IRREMOTEESP8266_VERSION_STR "\n");
+    profilePrint();
+
+    // Display the tolerance percentage if it has been change from the default.
+    if (kTolerancePercentage != kTolerance)
+        Serial.printf(D_STR_TOLERANCE " : %d%%\n", kTolerancePercentage);
+
+    logInit( LOG_INFO, printLogRecord );
+
+    waveformInit( kFrequency, kRawRepeatGap );
+    streamInit( kStreamPrebufferUs, kRawRepeatGap );
+    timeSyncInit( kTimeSyncMs );
+    playoutInit( kPlayoutUs );
+
+    if( !codeCacheInit() )
+        Serial.println("No LittleFS, learned codes are kept until the next reboot");
+
+    rxQueueInit( &rxQueue );
+    callbacksInit( &rxQueue );
+    eventInit( kEventTickMs, pollEvents );
+
+    Serial.println("Type s to print the latency histograms, l the link statistics, v to change the log level.");
+}
+
+// Send a frame out via the IR LED circuit, followed by repeat repeats of it.
+// A frame that came with its raw timings is compiled into a waveform the
+// first time, later it's played from the cache by its key. Waveforms are
+// still on the air when this returns, the encoder's frames are over.
+static bool retransmit( const struct_IRframe *frame, uint16_t repeat, uint32_t key )
+{
+    decode_type_t protocol = frame->results.decode_type;
+    uint16_t size = frame->results.bits;
+    bool success = true;
+    const struct_waveform *wf = waveformGet( key );
+
+    if( wf == NULL && frame->rawLen != 0 )
+        wf = waveformCompile( key, frame );
+
+    if( wf != NULL )
+    {  // Play the waveform, as often as the protocol's encoder would send it
+        if( repeat < wf->minRepeats )
+            repeat = wf->minRepeats;
+
+        // The emitter sends it out via the IR LED circuit, loop() goes on
+        success = emitterPlay( wf->timings, wf->len, wf->freq, repeat, wf->gap );
+    }
+    else if (protocol == decode_type_t::UNKNOWN || frame->rawLen != 0 || !profileHas( protocol ))
+    {  // A protocol we don't understand or whose encoder the profile left out,
+       // without its timings to replay
+        success = false;
+    }
+    else if( hasACState( protocol ))
+    {  // Does the message require a state[]?
+        // It does, so send with bytes instead. There is no repeat parameter
+        // for those, the state[] is just sent again.
+        for( uint16_t i = 0; success && i <= repeat; i++ )
+            success = irsend.send(protocol, frame->results.state, size / 8);
     }
     else
-    {
-        Serial.println("ESP-NOW Ready");
-        wifiConnectError = false;
+    {  // Anything else must be a simple message protocol. ie. <= 64 bits
+        success = irsend.send(protocol, frame->results.value, size, repeat);
     }
-    
-    Serial.println("SmartIRRepeater is now running and waiting for IR input on Pin ");
 
-    callbacksInit( &rcvData, sizeof(rcvData), &wifiConnectError, &IRMessageReceived );
+    return success;
+}
 
-    // Enter the Loop with connectError set HIGH to avoid intial display flicker
-    wifiConnectError = true;
+// The emit stage of a frame started at emitStamp ends once it's over: now if
+// it was sent by the encoder, which blocks, or when the emitter is done
+static void emitStarted( uint32_t emitStamp, uint32_t now )
+{
+    if( emitterBusy() )
+    {
+        emitting = true;
+        emitStart = emitStamp;
+    }
+    else
+        latencyRecord( STAGE_EMIT, emitStamp, now );
 }
 
 // The repeating section of the code
 void loop()
 {
-    static uint32_t last_time = 0;
     uint32_t now;
-    static uint32_t heartbeatTime = 0;
-    static uint32_t heartbeatRate = HEARTBEAT_1_SEC;
-    static uint8_t failCount = 0;
+    static uint8_t ledLevel = LOW;
 
-    static uint8_t pinState = LOW;
+    struct_rxslot *slot;
+    uint8_t events = eventTake();   // what woke us up
     
     now = millis();     // get current time
-    heartbeatTime += now - last_time;
-    last_time = now;    // save for next loop
 
-    // Send a message every second to montior whether IRrecv peer is present
-    if( heartbeatTime > heartbeatRate )
+    // The frame on the air is over
+    if( emitting && !emitterBusy() )
     {
-        heartbeatTime = 0;
+        latencyRecord( STAGE_EMIT, emitStart, latencyStamp() );
+        emitting = false;
+    }
 
-        xmitData.msg_type = MSG_HEARTBEAT;
-        xmitData.msg_data = 0xAA;
-        int result = esp_now_send(broadcastAddress, (uint8_t *)&xmitData, sizeof(xmitData));
+    // So is the stream, log how it went
+    uint8_t streamFrameId;
+    uint16_t streamEmitted;
+    bool streamSuccess;
 
-        if( wifiConnectError == true )
-        {
-            ++ failCount;
+    if( streamDone( &streamFrameId, &streamEmitted, &streamSuccess ))
+    {
+        struct_logrec *rec = logNew( streamSuccess ? LOG_INFO : LOG_ERROR, LOG_EV_STREAM );
 
-            if( failCount > 5 )
-                pinState = LOW;
+        if( rec != NULL )
+        {
+            rec->frameId = streamFrameId;
+            rec->success = streamSuccess;
+            rec->arg[0] = streamEmitted;
         }
-        else
+    }
+
+    if( events & EVENT_TICK )
+    {
+        // The IRrecv nodes hear from us through our ACKs, those we had nothing
+        // for lately get a heartbeat instead
+        sourcesHeartbeat( now );
+
+        // A clock sync exchange is only started while no frame waits, its reply
+        // would sit out the emission
+        if(( kPlayoutUs != 0 || kTransitStats ) && rxQueueCount( &rxQueue ) == 0 )
+            timeSyncPoll( now );
+
+        // The LED shows how the links to the nodes are doing
+        if( sourcesLed( now ) != ledLevel )
         {
-            failCount = 0;
-            pinState = HIGH;
+            ledLevel = !ledLevel;
+            digitalWrite( statusLedPin, ledLevel );
         }
-        
-        digitalWrite( statusLedPin, pinState );
     }
 
-    // Check connection status
-    if( rcvData.newMessage == true )
+    // Heartbeats and the like wait a little for others to the same node
+    linkPoll();
+
+    switch( ( events & EVENT_SERIAL ) && Serial.available() ? Serial.read() : -1 )
     {
-        rcvData.newMessage = false;
+    case 's':
+        latencyDump( "IRsend" );
+        sourcesPrint();
+        sourcesPrintLinks( now );
+        codeCachePrint();
+        waveformPrint();
+        streamPrint();
+        timeSyncPrint();
+        playoutPrint();
+        emitterPrint();
+        eventPrint();
+        break;
+
+    case 'l':   // How the links to the IRrecv nodes are doing
+        sourcesPrintLinks( now );
+        break;
+
+    case 'v':   // Cycle through the log levels
+        logSetLevel( (LOG_LEVEL_E)(( logLevel() + 1 ) % ( LOG_DEBUG + 1 )));
+        Serial.printf("Log level %u\n", logLevel());
+        break;
+    }
+
+    // Retransmit the oldest frame waiting in the queue
+    slot = rxQueuePeek( &rxQueue );
+
+    // It waits for the frame on the air to be over, and in playout mode
+    // for its moment
+    if( slot != NULL && ( emitterBusy() || playoutHold( slot->src, slot->captureUs )))
+        slot = NULL;
+
+    if( slot != NULL && slot->repeatCount != 0 )
+    {   // A held button, regenerate the repeats from the last full frame
+        bool success = lastFrameValid && slot->key == lastFrameKey;
+        uint32_t emitStamp = latencyStamp();
+
+        heapStatsMark();
+
+        latencyRecord( STAGE_QUEUE, slot->rxStamp, emitStamp );
+
+        if( success && slot->frame.rawLen != 0 )
+        {   // The protocol has its own repeat code, it came along. Its raw
+            // timings don't include the gap the remote left between them.
+            success = emitterPlay( slot->frame.raw, slot->frame.rawLen, kFrequency,
+                                   slot->repeatCount - 1, kRawRepeatGap );
+        }
+        else if( success )
+        {
+            success = retransmit( &lastFrame, slot->repeatCount - 1, lastFrameKey );
+        }
+
+        uint32_t logStamp = latencyStamp();
+
+        emitStarted( emitStamp, logStamp );
 
-        decode_type_t protocol = rcvData.IRmessage_data.decode_type;
-        uint16_t size = rcvData.IRmessage_data.bits;
+        struct_logrec *rec = logNew( LOG_INFO, LOG_EV_REPEAT );
+
+        if( rec != NULL )
+        {
+            rec->frameId = slot->frameId;
+            rec->success = success;
+            rec->arg[0] = slot->repeatCount;
+        }
+
+        heapStatsCheck();
+
+        latencyRecord( STAGE_SEND_LOG, logStamp, latencyStamp() );
+
+        rxQueueRelease( &rxQueue );
+    }
+    else if( slot != NULL )
+    {
+        struct_IRframe &frame = slot->frame;
         bool success = true;
+        struct_logrec *rec;
 
-        Serial.printf(D_STR_TIMESTAMP " : %06u.%03u\n", now / 1000, now % 1000);
+        heapStatsMark();
 
-        // Check if we got an IR message that was to big for our capture buffer.
-        if (rcvData.IRmessage_data.overflow)
-            Serial.printf(D_WARN_BUFFERFULL "\n", kCaptureBufferSize);
-
-        // Display the library version the message was captured with.
-        Serial.println(D_STR_LIBRARY "   : v" _IRREMOTEESP8266_VERSION_STR "\n");
-
-        // Display the tolerance percentage if it has been change from the default.
-        if (kTolerancePercentage != kTolerance)
-            Serial.printf(D_STR_TOLERANCE " : %d%%\n", kTolerancePercentage);
-
-        // Display the basic output of what we found.
-        Serial.print(resultToHumanReadableBasic(&rcvData.IRmessage_data));
-
-        // Display any extra A/C info if we have it.
-        String description = IRAcUtils::resultAcToString(&rcvData.IRmessage_data);
-
-        if (description.length()) Serial.println(D_STR_MESGDESC ": " + description);
-
-        yield();  // Feed the WDT as the text output can take a while to print.
-
-		// Is it a protocol we don't understand?
-        if (protocol == decode_type_t::UNKNOWN)
-        {  // Yes.
-            // Convert the results into an array suitable for sendRaw().
-            // resultToRawArray() allocates the memory we need for the array.
-            uint16_t *raw_array = resultToRawArray(&rcvData.IRmessage_data);
-            // Find out how many elements are in the array.
-            size = getCorrectedRawLength(&rcvData.IRmessage_data);
-#if SEND_RAW
-            // Send it out via the IR LED circuit.
-            irsend.sendRaw(raw_array, size, kFrequency);
-#endif  // SEND_RAW
-            // Deallocate the memory allocated by resultToRawArray().
-            delete [] raw_array;
+        // Its stream was emitted already, or is about to be overtaken by it
+        STREAM_MATCH_E streamed = streamFind( slot->src, slot->frameId, now );
+
+        if( streamed == STREAM_PENDING )
+            streamCancel();
+
+        // IRrecv sent the code of a frame we learned, replay that frame
+        if( slot->frameLen == 0 )
+        {
+            slot->frameLen = codeCacheLoad( slot->key, slot->buf );
+
+            if( slot->frameLen == 0 || !irFrameParse( slot->buf, slot->frameLen, &frame ))
+            {
+                memset( &frame, 0, sizeof(frame) );
+                slot->frameLen = 0;
+                success = false;
+            }
         }
-        else if( hasACState( protocol ))
-        {  // Does the message require a state[]?
-            // It does, so send with bytes instead.
-            success = irsend.send(protocol, rcvData.IRmessage_data.state, size / 8);
+
+        decode_type_t protocol = frame.results.decode_type;
+        uint16_t size = frame.results.bits;
+
+        // Start sending it out first, it's logged while it's on the air
+        uint32_t emitStamp = latencyStamp();
+
+        latencyRecord( STAGE_QUEUE, slot->rxStamp, emitStamp );
+
+        if( success && streamed != STREAM_PLAYED )
+            success = retransmit( &frame, kNoRepeat, slot->key );
+
+        uint32_t logStamp = latencyStamp();
+
+        emitStarted( emitStamp, logStamp );
+
+        if( frame.rawLen != 0 )
+            size = frame.rawLen;
+
+        // Keep the frame, repeats of a held button regenerate it
+        lastFrameValid = false;
+
+        if( success )
+        {
+            memcpy( lastFrameBuf, slot->buf, slot->frameLen );
+            lastFrameValid = irFrameParse( lastFrameBuf, slot->frameLen, &lastFrame );
+            lastFrameId = slot->frameId;
+            lastFrameKey = slot->key;
         }
-        else
-        {  // Anything else must be a simple message protocol. ie. <= 64 bits
-            success = irsend.send(protocol, rcvData.IRmessage_data.value, size);
+
+        // Check if we got an IR message that was to big for our capture buffer.
+        if( frame.results.overflow && ( rec = logNew( LOG_ERROR, LOG_EV_OVERFLOW )) != NULL )
+            rec->frameId = slot->frameId;
+
+        if( ( rec = logNew( LOG_INFO, LOG_EV_FRAME )) != NULL )
+        {
+            rec->frameId = slot->frameId;
+            rec->protocol = protocol;
+            rec->bits = size;
+            rec->success = success;
+            rec->arg[0] = rxQueueCount( &rxQueue ) - 1;
         }
-        
-            // Display a crude timestamp & notification.
-            Serial.printf(
-                "%06u.%03u: A %d-bit %s message was %ssuccessfully retransmitted.\n",
-                now / 1000, now % 1000, size, typeToString(protocol).c_str(),
-                success ? "" : "un");
-  
-        yield();  // Or delay(milliseconds); This ensures the ESP doesn't WDT reset.
-    }    
+
+        latencyRecord( STAGE_SEND_LOG, logStamp, latencyStamp() );
+        heapStatsCheck();
+
+        // Learn the frame, IRrecv sends just its code from now on. It's written
+        // to flash once the emitter is idle.
+        if( success )
+            codeCacheStore( slot->key, slot->buf, slot->frameLen );
+
+        // The slot may now be reused for the next frame
+        rxQueueRelease( &rxQueue );
+    }
+    else if( !emitterBusy() && streamReady( now ))
+    {   // A long capture IRrecv is still streaming, emit it as it comes in
+        streamStart( kFrequency );
+    }
+    else
+    {   // Nothing to send right now, learn the last frame and print the log
+        if( !emitterBusy() )
+            codeCacheFlush();
+
+        logDrain();
+    }
+
+    // Frames still queued are sent on right away, unless they wait for their
+    // moment (playoutHold() has us woken up for it)
+    if( rxQueueCount( &rxQueue ) != 0 && slot != NULL )
+        eventWakeIn( 0 );
+
+    // The next one goes out once the frame on the air is over
+    if( emitterBusy() )
+        eventWakeIn( emitterLeft() );
+
+    // Hand the CPU to the SDK until there is something to do, this also
+    // ensures the ESP doesn't WDT reset
+    eventIdle();
 }
\ No newline at end of file
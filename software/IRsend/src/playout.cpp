@@ -0,0 +1,78 @@
+/*
+ *  IRsend:  playout.cpp - Emission of frames at a fixed latency after their capture.
+ *
+ *  Every frame carries the micros() of its IRrecv when the capture was over.
+ *  With the clocks synced (see timesync.cpp) that is a moment on our own
+ *  clock, and the frame is held in the queue until targetUs after it. Radio
+ *  retries and retransmits then no longer show in when the frame goes out,
+ *  so repeats and the frames of a macro keep the spacing they had on the air.
+ *  A frame that comes in later than that goes out right away, as does one
+ *  from an IRrecv whose clock isn't known yet.
+*/
+#include <Arduino.h>
+#include "timesync.h"
+#include "playout.h"
+#include "events.h"
+
+// A frame that goes out within this of its moment is on time
+const uint32_t kOnTimeUs = 500;
+
+static uint32_t target = 0;
+
+static uint32_t onTime = 0;     // frames emitted at their moment
+static uint32_t late = 0;       // frames that came in too late for it
+static uint32_t maxLateUs = 0;
+static uint32_t unsynced = 0;   // frames from an IRrecv whose clock isn't known
+
+// Emit frames targetUs after their capture was over, 0 emits them as soon as
+// they are in
+void playoutInit( uint32_t targetUs )
+{
+    target = targetUs;
+}
+
+// The frame at the head of the queue, captured by src until its micros()
+// captureUs, has to wait for its moment still
+bool playoutHold( int8_t src, uint32_t captureUs )
+{
+    uint32_t localUs;
+
+    if( target == 0 )
+        return false;
+
+    if( !timeSyncLocal( src, captureUs, &localUs ))
+    {
+        ++ unsynced;
+        return false;
+    }
+
+    int32_t wait = (int32_t)( localUs + target - micros() );
+
+    if( wait > 0 )
+    {
+        eventWakeIn( wait );
+        return true;
+    }
+
+    if( (uint32_t)-wait <= kOnTimeUs )
+        ++ onTime;
+    else
+    {
+        ++ late;
+        maxLateUs = max( maxLateUs, (uint32_t)-wait );
+    }
+
+    return false;
+}
+
+void playoutPrint( void )
+{
+    if( target == 0 )
+    {
+        Serial.println("IRsend playout: off, frames go out as soon as they are in");
+        return;
+    }
+
+    Serial.printf("IRsend playout at %u us: %u frames on time, %u late (by up to %u us), %u before the clock was synced\n",
+                  target, onTime, late, maxLateUs, unsynced);
+}
@@ -0,0 +1,13 @@
+/*
+ *  IRsend:  playout.h - Emission of frames at a fixed latency after their capture.
+*/
+#ifndef PLAYOUT_H
+#define PLAYOUT_H
+
+#include <Arduino.h>
+
+void playoutInit( uint32_t targetUs );
+bool playoutHold( int8_t src, uint32_t captureUs );
+void playoutPrint( void );
+
+#endif  // PLAYOUT_H
@@ -0,0 +1,60 @@
+/*
+ *  IRsend:  rxqueue.cpp - Lock-free single-producer/single-consumer queue of received IR frames.
+*/
+#include <Arduino.h>
+#include "rxqueue.h"
+
+void rxQueueInit( struct_rxqueue *q )
+{
+    q->head.store( 0 );
+    q->tail.store( 0 );
+    q->drops = 0;
+    q->highWater = 0;
+}
+
+// Get the free slot at head to build the next frame in.
+// Returns NULL when every slot still waits for retransmission.
+struct_rxslot *rxQueueReserve( struct_rxqueue *q )
+{
+    uint8_t head = q->head.load( std::memory_order_relaxed );
+    uint8_t tail = q->tail.load( std::memory_order_acquire );
+
+    if( (uint8_t)(head - tail) >= RXQUEUE_SIZE )
+        return NULL;
+
+    return &q->slots[head & (RXQUEUE_SIZE - 1)];
+}
+
+// Hand the slot returned by rxQueueReserve() over to the consumer
+void rxQueuePublish( struct_rxqueue *q )
+{
+    uint8_t head = q->head.load( std::memory_order_relaxed ) + 1;
+    uint8_t count = head - q->tail.load( std::memory_order_acquire );
+
+    q->head.store( head, std::memory_order_release );
+
+    if( count > q->highWater )
+        q->highWater = count;
+}
+
+// Get the oldest published slot, NULL when the queue is empty
+struct_rxslot *rxQueuePeek( struct_rxqueue *q )
+{
+    uint8_t tail = q->tail.load( std::memory_order_relaxed );
+
+    if( tail == q->head.load( std::memory_order_acquire ))
+        return NULL;
+
+    return &q->slots[tail & (RXQUEUE_SIZE - 1)];
+}
+
+// Give the slot returned by rxQueuePeek() back to the producer
+void rxQueueRelease( struct_rxqueue *q )
+{
+    q->tail.store( q->tail.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+uint8_t rxQueueCount( struct_rxqueue *q )
+{
+    return q->head.load( std::memory_order_acquire ) - q->tail.load( std::memory_order_acquire );
+}
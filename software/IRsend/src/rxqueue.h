@@ -0,0 +1,56 @@
+/*
+ *  IRsend:  rxqueue.h - Lock-free single-producer/single-consumer queue of received IR frames.
+ *
+ *  OnDataRecv() is the only producer, it reassembles frames straight into the
+ *  slot at head and publishes it once complete. loop() is the only consumer, it
+ *  retransmits the slot at tail and then releases it. head is only written by
+ *  the producer and tail only by the consumer, so no lock is needed.
+*/
+#ifndef RXQUEUE_H
+#define RXQUEUE_H
+
+#include <atomic>
+#include "messages.h"
+#include "irframe.h"
+
+// Number of frames that can wait for retransmission. Must be a power of 2.
+#define RXQUEUE_SIZE    4
+
+static_assert( (RXQUEUE_SIZE & (RXQUEUE_SIZE - 1)) == 0, "RXQUEUE_SIZE must be a power of 2" );
+
+// A received frame, parsed and ready to be retransmitted, or a repeat of the
+// last full frame
+typedef struct struct_rxslot
+{
+    struct_IRframe frame;       // parsed frame, raw points into buf
+    int8_t src;                 // sources.cpp index of the IRrecv it came from
+    uint8_t frameId;            // id of the frame, or of the frame to repeat
+    uint32_t key;               // irCodeKey() of the frame, or of the frame to repeat (0 if unknown)
+    uint8_t repeatCount;        // 0 for a full frame, else times to repeat frameId
+    uint16_t frameLen;          // 0 for a frame still to be loaded from the code cache
+    uint32_t captureUs;         // IRrecv's micros() when the capture was over
+    uint32_t rxStamp;           // latencyStamp() when the frame was complete
+    uint8_t buf[IRFRAME_MAX_LEN] __attribute__((aligned(4)));
+} struct_rxslot;
+
+typedef struct struct_rxqueue
+{
+    struct_rxslot slots[RXQUEUE_SIZE];
+    std::atomic<uint8_t> head;      // next slot to fill, producer only
+    std::atomic<uint8_t> tail;      // next slot to drain, consumer only
+    volatile uint32_t drops;        // frames dropped because the queue was full
+    volatile uint8_t highWater;     // largest number of frames ever queued
+} struct_rxqueue;
+
+void rxQueueInit( struct_rxqueue *q );
+
+// Producer side
+struct_rxslot *rxQueueReserve( struct_rxqueue *q );
+void rxQueuePublish( struct_rxqueue *q );
+
+// Consumer side
+struct_rxslot *rxQueuePeek( struct_rxqueue *q );
+void rxQueueRelease( struct_rxqueue *q );
+uint8_t rxQueueCount( struct_rxqueue *q );
+
+#endif  // RXQUEUE_H
@@ -0,0 +1,280 @@
+/*
+ *  IRsend:  sources.cpp - Table of the IRrecv nodes frames come from, and the collapsing of their duplicates.
+ *
+ *  Where more than one IRrecv sees the remote, each of them relays the same
+ *  press. Every frame queued is remembered for a while by its key, a hash of
+ *  what it emits (see codekey.cpp). The same key from another IRrecv within
+ *  the window is a copy of that press: it is acknowledged but not queued.
+ *  The same key from the IRrecv that sent it before is a new press.
+ *
+ *  Frame ids are only unique per IRrecv, so each one also has its own list
+ *  of the frames it sent lately, to catch its retransmits and to find the
+ *  frame its repeats are for.
+*/
+#include <Arduino.h>
+#include <espnow.h>
+#include "sources.h"
+#include "link.h"
+
+// Frames of each IRrecv remembered, and for how long. Frame ids roll over.
+#define RECENT_FRAMES   8
+const uint32_t kRecentFrameMs = 2000;
+
+// Keys of the frames queued lately, from all IRrecv nodes
+#define DEDUP_KEYS      8
+
+typedef struct struct_source
+{
+    uint8_t mac[6];
+    struct_link link;
+    uint8_t recentIds[RECENT_FRAMES];
+    uint32_t recentKeys[RECENT_FRAMES];
+    uint32_t recentTimes[RECENT_FRAMES];
+    uint8_t recentNext;
+    uint8_t recentCount;
+    uint32_t stats[SOURCE_STAT_COUNT];
+} struct_source;
+
+typedef struct struct_dedup_key
+{
+    uint32_t key;
+    uint32_t time;          // millis() when the frame was queued
+    int8_t src;
+} struct_dedup_key;
+
+static struct_source sources[SOURCE_MAX];
+static uint8_t count = 0;
+static uint8_t configured = 0;      // the first ones are the nodes we were given, they stay
+static uint32_t dupWindow;
+static struct_dedup_key keys[DEDUP_KEYS];
+static uint8_t keysNext = 0;
+static uint8_t keysCount = 0;
+
+static void sourcesAdd( uint8_t index, const uint8_t *mac )
+{
+    memset( &sources[index], 0, sizeof(sources[index]) );
+    memcpy( sources[index].mac, mac, 6 );
+    linkInit( &sources[index].link );
+
+    esp_now_add_peer( sources[index].mac, ESP_NOW_ROLE_SLAVE, 0, NULL, 0 );
+}
+
+// Start out with the IRrecv nodes we know of. Copies of a frame from
+// different nodes within dupWindowMs of each other are collapsed.
+void sourcesInit( const uint8_t (*macs)[6], uint8_t macCount, uint32_t dupWindowMs )
+{
+    count = ( macCount > SOURCE_MAX ) ? SOURCE_MAX : macCount;
+    configured = count;
+    dupWindow = dupWindowMs;
+
+    for( uint8_t i = 0; i < count; i++ )
+        sourcesAdd( i, macs[i] );
+}
+
+// Index of the IRrecv with this MAC address, -1 if it isn't in the table
+int8_t sourcesFind( const uint8_t *mac )
+{
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        if( memcmp( sources[i].mac, mac, 6 ) == 0 )
+            return i;
+    }
+
+    return -1;
+}
+
+// Add an IRrecv that wasn't heard from before. If the table is full it
+// takes the place of the learned one heard from longest ago, the nodes we
+// were given are never dropped.
+// Returns its index, -1 if there is no room.
+int8_t sourcesLearn( const uint8_t *mac, uint32_t now )
+{
+    int8_t oldest = -1;
+
+    if( count < SOURCE_MAX )
+        oldest = count++;
+    else
+    {
+        for( uint8_t i = configured; i < count; i++ )
+        {
+            if( oldest < 0 || now - sources[i].link.lastHeard > now - sources[oldest].link.lastHeard )
+                oldest = i;
+        }
+
+        if( oldest < 0 )
+            return -1;
+
+        esp_now_del_peer( sources[oldest].mac );
+
+        // Its keys mustn't collapse the frames of the one taking its place
+        for( uint8_t i = 0; i < keysCount; i++ )
+        {
+            if( keys[i].src == oldest )
+                keys[i].src = -1;
+        }
+    }
+
+    sourcesAdd( oldest, mac );
+
+    return oldest;
+}
+
+uint8_t sourcesCount( void )
+{
+    return count;
+}
+
+uint8_t *sourcesMac( uint8_t index )
+{
+    return sources[index].mac;
+}
+
+// Index into the recent frames of src, -1 if it didn't send frameId lately
+static int8_t sourcesRecent( int8_t src, uint8_t frameId, uint32_t now )
+{
+    const struct_source *s = &sources[src];
+
+    for( uint8_t i = 0; i < s->recentCount; i++ )
+    {
+        if( s->recentIds[i] == frameId && now - s->recentTimes[i] < kRecentFrameMs )
+            return i;
+    }
+
+    return -1;
+}
+
+// src sent frameId before, its ACK must have been lost
+bool sourcesIsRetransmit( int8_t src, uint8_t frameId, uint32_t now )
+{
+    return sourcesRecent( src, frameId, now ) >= 0;
+}
+
+// Key of frame frameId src sent lately, 0 if there is none. Asked for by
+// its repeats, each of them keeps the frame recent, so a button can be
+// held for longer than kRecentFrameMs.
+uint32_t sourcesFrameKey( int8_t src, uint8_t frameId, uint32_t now )
+{
+    int8_t i = sourcesRecent( src, frameId, now );
+
+    if( i < 0 )
+        return 0;
+
+    sources[src].recentTimes[i] = now;
+
+    return sources[src].recentKeys[i];
+}
+
+// src sent us frameId, whether it was queued or collapsed
+void sourcesRemember( int8_t src, uint8_t frameId, uint32_t key, uint32_t now )
+{
+    struct_source *s = &sources[src];
+
+    s->recentIds[s->recentNext] = frameId;
+    s->recentKeys[s->recentNext] = key;
+    s->recentTimes[s->recentNext] = now;
+    s->recentNext = (s->recentNext + 1) % RECENT_FRAMES;
+
+    if( s->recentCount < RECENT_FRAMES )
+        ++ s->recentCount;
+}
+
+// Another IRrecv had a frame with this key queued within the window. If not,
+// the frame is about to be queued and its key is remembered.
+bool sourcesIsDuplicate( int8_t src, uint32_t key, uint32_t now )
+{
+    for( uint8_t i = 0; i < keysCount; i++ )
+    {
+        if( keys[i].key == key && keys[i].src != src && now - keys[i].time < dupWindow )
+            return true;
+    }
+
+    keys[keysNext].key = key;
+    keys[keysNext].time = now;
+    keys[keysNext].src = src;
+    keysNext = (keysNext + 1) % DEDUP_KEYS;
+
+    if( keysCount < DEDUP_KEYS )
+        ++ keysCount;
+
+    return false;
+}
+
+void sourcesTally( int8_t src, SOURCE_STAT_E stat )
+{
+    ++ sources[src].stats[stat];
+
+    if( stat == SOURCE_RETRANSMITS )
+        linkRetransmit( &sources[src].link );
+}
+
+// A packet came in from src
+void sourcesHeard( int8_t src, const uint8_t *data, uint8_t len, uint32_t now )
+{
+    linkHeard( &sources[src].link, sources[src].mac, data, len, now );
+}
+
+// Status of a packet sent, sendUs after it was, called from OnDataSent()
+void sourcesSent( const uint8_t *mac, uint8_t status, uint32_t sendUs, uint32_t now )
+{
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        if( memcmp( sources[i].mac, mac, 6 ) == 0 )
+        {
+            linkSent( &sources[i].link, now );
+            linkDelivered( &sources[i].link, status == 0, sendUs );
+            return;
+        }
+    }
+}
+
+// Send a heartbeat to the IRrecv nodes we had nothing else for lately
+void sourcesHeartbeat( uint32_t now )
+{
+    for( uint8_t i = 0; i < count; i++ )
+        linkHeartbeat( sources[i].mac, &sources[i].link, now );
+}
+
+// Level of the status LED, see linkLed()
+uint8_t sourcesLed( uint32_t now )
+{
+    LINK_QUALITY_E worst = LINK_GOOD;
+    LINK_QUALITY_E best = LINK_DOWN;
+
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        LINK_QUALITY_E quality = linkQuality( &sources[i].link, now );
+
+        worst = min( worst, quality );
+        best = max( best, quality );
+    }
+
+    return linkLed( worst, best, now );
+}
+
+void sourcesPrint( void )
+{
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        const struct_source *s = &sources[i];
+
+        Serial.printf("IRrecv %02X:%02X:%02X:%02X:%02X:%02X: %u frames, %u repeats, "
+                      "%u duplicates collapsed, %u retransmits, %u fragments ignored while busy\n",
+                      s->mac[0], s->mac[1], s->mac[2], s->mac[3], s->mac[4], s->mac[5],
+                      s->stats[SOURCE_FRAMES], s->stats[SOURCE_REPEATS], s->stats[SOURCE_DUPLICATES],
+                      s->stats[SOURCE_RETRANSMITS], s->stats[SOURCE_BUSY]);
+    }
+}
+
+void sourcesPrintLinks( uint32_t now )
+{
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        const struct_source *s = &sources[i];
+
+        Serial.printf("IRrecv %02X:%02X:%02X:%02X:%02X:%02X: ",
+                      s->mac[0], s->mac[1], s->mac[2], s->mac[3], s->mac[4], s->mac[5]);
+        linkPrint( &s->link, now );
+    }
+
+    linkPrintBatches();
+}
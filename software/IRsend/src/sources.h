@@ -0,0 +1,40 @@
+/*
+ *  IRsend:  sources.h - Table of the IRrecv nodes frames come from, and the collapsing of their duplicates.
+*/
+#ifndef SOURCES_H
+#define SOURCES_H
+
+#include <Arduino.h>
+
+// Largest number of IRrecv nodes kept track of
+#define SOURCE_MAX          4
+
+// What is counted for each IRrecv
+typedef enum
+{
+    SOURCE_FRAMES = 0,      // frames queued for retransmission
+    SOURCE_REPEATS,         // repeats queued
+    SOURCE_DUPLICATES,      // frames and repeats another IRrecv sent first
+    SOURCE_RETRANSMITS,     // frames it sent again that we already had
+    SOURCE_BUSY,            // fragments ignored while another IRrecv's frame was reassembled
+    SOURCE_STAT_COUNT
+} SOURCE_STAT_E;
+
+void sourcesInit( const uint8_t (*macs)[6], uint8_t count, uint32_t dupWindowMs );
+int8_t sourcesFind( const uint8_t *mac );
+int8_t sourcesLearn( const uint8_t *mac, uint32_t now );
+uint8_t sourcesCount( void );
+uint8_t *sourcesMac( uint8_t index );
+bool sourcesIsRetransmit( int8_t src, uint8_t frameId, uint32_t now );
+uint32_t sourcesFrameKey( int8_t src, uint8_t frameId, uint32_t now );
+void sourcesRemember( int8_t src, uint8_t frameId, uint32_t key, uint32_t now );
+bool sourcesIsDuplicate( int8_t src, uint32_t key, uint32_t now );
+void sourcesTally( int8_t src, SOURCE_STAT_E stat );
+void sourcesHeard( int8_t src, const uint8_t *data, uint8_t len, uint32_t now );
+void sourcesSent( const uint8_t *mac, uint8_t status, uint32_t sendUs, uint32_t now );
+void sourcesHeartbeat( uint32_t now );
+uint8_t sourcesLed( uint32_t now );
+void sourcesPrint( void );
+void sourcesPrintLinks( uint32_t now );
+
+#endif  // SOURCES_H
@@ -0,0 +1,204 @@
+/*
+ *  IRsend:  stream.cpp - Cut-through emission of the captures IRrecv streams while they are still coming in.
+ *
+ *  The chunks of a MSG_IR_STREAM are collected in order. Once they hold
+ *  prebufferUs of timings, or the capture is over, loop() starts the
+ *  emitter on them, and the chunks that come in after are fed to it while
+ *  it plays.
+ *
+ *  A mark can't wait for its timing, so running out of them is fatal. If a
+ *  chunk went missing, or the next timings aren't in by the time they're due,
+ *  the emission is abandoned between two marks and followed by abortGapUs of
+ *  silence, so the receiving device drops the partial frame. IRrecv then sends
+ *  the whole frame as usual and it's emitted from the queue. If the stream was
+ *  emitted in full, that frame is only acknowledged.
+*/
+#include <Arduino.h>
+#include "messages.h"
+#include "emitter.h"
+#include "stream.h"
+
+// A stream that stops coming in for this long is dropped, and a stream
+// that was emitted is remembered this long for its frame to come in
+const uint32_t kStaleMs = 100;
+const uint32_t kPlayedMs = 2000;
+
+typedef enum
+{
+    STREAM_IDLE = 0,
+    STREAM_FILLING,         // chunks are coming in
+    STREAM_PLAYING          // the emitter is playing it
+} STREAM_STATE_E;
+
+static uint16_t timings[IRFRAME_MAX_RAW];
+static volatile uint8_t state = STREAM_IDLE;
+static int8_t streamSrc;
+static uint8_t streamFrameId;
+static volatile uint16_t received;      // timings in, in order from the start
+static volatile uint32_t receivedUs;    // their air time
+static volatile bool ended;             // its last chunk came in
+static volatile bool broken;            // a chunk went missing
+static volatile uint32_t lastChunk;     // millis() when a chunk last came in
+
+static int8_t playedSrc = -1;           // the last stream emitted in full
+static uint8_t playedFrameId;
+static uint32_t playedAt;
+
+static uint32_t prebuffer;
+static uint32_t abortGap;
+
+static uint32_t started = 0;            // streams that came in
+static uint32_t played = 0;             // of those, emitted in full
+static uint32_t underruns = 0;          // abandoned for lack of timings
+static uint32_t dropped = 0;            // never emitted, a chunk went missing
+static uint32_t busy = 0;               // chunks of another stream ignored
+
+// Start emitting a stream once prebufferUs of it came in. A stream that's
+// abandoned is followed by abortGapUs of silence.
+void streamInit( uint32_t prebufferUs, uint32_t abortGapUs )
+{
+    prebuffer = prebufferUs;
+    abortGap = abortGapUs;
+}
+
+// A MSG_IR_STREAM came in from src, called from OnDataRecv()
+void streamReceive( int8_t src, const uint8_t *data, uint8_t len, uint32_t now )
+{
+    const struct_IRstream_hdr *hdr = (const struct_IRstream_hdr *)data;
+
+    if( len < sizeof(struct_IRstream_hdr) || len != sizeof(struct_IRstream_hdr) + hdr->count * 2 )
+        return;
+
+    if( state != STREAM_IDLE && ( src != streamSrc || hdr->frameId != streamFrameId ))
+    {
+        ++ busy;
+        return;
+    }
+
+    if( state == STREAM_IDLE )
+    {   // Only a stream whose start came in can be emitted
+        if( hdr->offset != 0 || ( src == playedSrc && hdr->frameId == playedFrameId ))
+            return;
+
+        streamSrc = src;
+        streamFrameId = hdr->frameId;
+        received = 0;
+        receivedUs = 0;
+        ended = false;
+        broken = false;
+        state = STREAM_FILLING;
+        ++ started;
+    }
+
+    lastChunk = now;
+
+    if( broken || ended || hdr->offset < received )
+        return;
+
+    if( hdr->offset > received || received + hdr->count > IRFRAME_MAX_RAW )
+    {
+        broken = true;
+
+        if( state == STREAM_PLAYING )
+            emitterFeed( NULL, 0, false );
+
+        return;
+    }
+
+    memcpy( &timings[received], data + sizeof(struct_IRstream_hdr), hdr->count * 2 );
+
+    for( uint8_t i = 0; i < hdr->count; i++ )
+        receivedUs += timings[received + i];
+
+    received += hdr->count;
+
+    if( hdr->flags & IRSTREAM_FLAG_END )
+        ended = true;
+
+    if( state == STREAM_PLAYING )
+        emitterFeed( &timings[hdr->offset], hdr->count, ended );
+}
+
+// There is a stream to emit. One that broke off before that is dropped.
+bool streamReady( uint32_t now )
+{
+    if( state != STREAM_FILLING )
+        return false;
+
+    if( broken || ( !ended && now - lastChunk > kStaleMs ))
+    {
+        state = STREAM_IDLE;
+        ++ dropped;
+        return false;
+    }
+
+    return ended || receivedUs >= prebuffer;
+}
+
+// Start emitting the stream at hz, the rest of it is fed to the emitter as
+// it comes in. Returns false if the emitter is busy, the stream is dropped.
+bool streamStart( uint16_t hz )
+{
+    state = STREAM_PLAYING;
+
+    if( !emitterStream( timings, received, hz, ended, abortGap ))
+    {
+        state = STREAM_IDLE;
+        ++ dropped;
+        return false;
+    }
+
+    return true;
+}
+
+// The stream the emitter played is over. Its frameId and the number of
+// timings that went out are returned in *frameId and *emitted, and in
+// *success whether it was emitted in full.
+// Returns false while it's still being played, or if there is none.
+bool streamDone( uint8_t *frameId, uint16_t *emitted, bool *success )
+{
+    if( state != STREAM_PLAYING || emitterBusy() )
+        return false;
+
+    *frameId = streamFrameId;
+    *success = emitterResult( emitted );
+
+    if( *success )
+    {
+        playedSrc = streamSrc;
+        playedFrameId = streamFrameId;
+        playedAt = millis();
+        ++ played;
+    }
+    else
+        ++ underruns;
+
+    state = STREAM_IDLE;
+
+    return true;
+}
+
+// What the stream knows of frameId from src
+STREAM_MATCH_E streamFind( int8_t src, uint8_t frameId, uint32_t now )
+{
+    if( state != STREAM_IDLE && src == streamSrc && frameId == streamFrameId )
+        return STREAM_PENDING;
+
+    if( src == playedSrc && frameId == playedFrameId && now - playedAt < kPlayedMs )
+        return STREAM_PLAYED;
+
+    return STREAM_NONE;
+}
+
+// Drop the stream waiting to be emitted, its frame is emitted instead
+void streamCancel( void )
+{
+    if( state == STREAM_FILLING )
+        state = STREAM_IDLE;
+}
+
+void streamPrint( void )
+{
+    Serial.printf("IRsend streams: %u came in, %u emitted in full, %u abandoned, %u dropped, %u chunks ignored while busy\n",
+                  started, played, underruns, dropped, busy);
+}
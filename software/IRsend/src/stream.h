@@ -0,0 +1,26 @@
+/*
+ *  IRsend:  stream.h - Cut-through emission of the captures IRrecv streams while they are still coming in.
+*/
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <Arduino.h>
+
+// What the stream knows of a frame that came in
+typedef enum
+{
+    STREAM_NONE = 0,        // it wasn't streamed, or the stream failed
+    STREAM_PENDING,         // its stream is still waiting to be played
+    STREAM_PLAYED           // its stream was emitted in full
+} STREAM_MATCH_E;
+
+void streamInit( uint32_t prebufferUs, uint32_t abortGapUs );
+void streamReceive( int8_t src, const uint8_t *data, uint8_t len, uint32_t now );
+bool streamReady( uint32_t now );
+bool streamStart( uint16_t hz );
+bool streamDone( uint8_t *frameId, uint16_t *emitted, bool *success );
+STREAM_MATCH_E streamFind( int8_t src, uint8_t frameId, uint32_t now );
+void streamCancel( void );
+void streamPrint( void );
+
+#endif  // STREAM_H
@@ -0,0 +1,206 @@
+/*
+ *  IRsend:  timesync.cpp - Offset and drift of the clocks of the IRrecv nodes against ours.
+ *
+ *  Every intervalMs each IRrecv is asked for the time, NTP style: the
+ *  MSG_TIME_REQ leaves at t1 on our clock, comes in at t2 and the reply
+ *  leaves at t3 on its clock, and the reply comes in at t4 on ours. With
+ *  equal delays both ways its clock is ahead of ours by
+ *  t2 - t1 - ((t4 - t1) - (t3 - t2)) / 2.
+ *
+ *  An exchange that took much longer than the shortest one lately had a
+ *  retry or a busy loop() in it and isn't symmetric, it is skipped. The
+ *  others are smoothed into the offset, and every few seconds the change of
+ *  the offset gives the drift between the two crystals, so the offset is
+ *  still right between exchanges. micros() wraps after ~71 minutes, offsets
+ *  are kept modulo 2^32 and only their differences are taken as signed.
+*/
+#include <Arduino.h>
+#include "messages.h"
+#include "sources.h"
+#include "link.h"
+#include "timesync.h"
+
+// The first exchanges with a node come this far apart, until it's synced
+const uint32_t kFirstIntervalMs = 250;
+
+// An exchange counts if its round trip is at most this much longer than the
+// shortest of the last few. Only the last few, so a path that got slower for
+// good is learned again.
+const uint32_t kDelaySlackUs = 400;
+#define TIMESYNC_DELAYS     8
+
+// A round trip longer than this is a lost reply that came in late
+const uint32_t kMaxDelayUs = 50000;
+
+// The drift is measured over at least this long
+const uint32_t kDriftSpanUs = 30000000;
+
+typedef struct struct_clock
+{
+    uint8_t mac[6];             // the node this is about, sources.cpp reuses indexes
+    bool synced;
+    uint32_t offsetUs;          // its clock minus ours at refUs
+    uint32_t refUs;             // our micros() the offset was taken at
+    int32_t driftPpb;           // how fast its clock gains on ours, in parts per billion
+    uint32_t anchorUs;          // our micros() the drift is measured from
+    uint32_t anchorOffsetUs;    // the offset then
+    uint32_t delaysUs[TIMESYNC_DELAYS];     // round trips of the last exchanges
+    uint32_t minDelayUs;        // shortest of them
+    uint32_t requestUs;         // our micros() the outstanding request left at, 0 once answered
+    uint32_t requestedAt;       // millis() of the last request
+    uint32_t requests;
+    uint32_t used;              // replies that went into the offset
+    uint32_t skipped;           // replies that took too long
+} struct_clock;
+
+static struct_clock clocks[SOURCE_MAX];
+static uint32_t interval;
+
+// Ask each IRrecv for the time every intervalMs
+void timeSyncInit( uint32_t intervalMs )
+{
+    interval = intervalMs;
+}
+
+// The clock of src, started afresh if another node took its place
+static struct_clock *timeSyncClock( int8_t src )
+{
+    struct_clock *c = &clocks[src];
+    const uint8_t *mac = sourcesMac( src );
+
+    if( memcmp( c->mac, mac, 6 ) != 0 )
+    {
+        memset( c, 0, sizeof(*c) );
+        memcpy( c->mac, mac, 6 );
+    }
+
+    return c;
+}
+
+// Its offset at our micros() nowUs
+static uint32_t timeSyncOffset( const struct_clock *c, uint32_t nowUs )
+{
+    int32_t elapsed = nowUs - c->refUs;
+
+    return c->offsetUs + (int32_t)( (int64_t)elapsed * c->driftPpb / 1000000000 );
+}
+
+// Send the requests that are due
+void timeSyncPoll( uint32_t now )
+{
+    for( uint8_t i = 0; i < sourcesCount(); i++ )
+    {
+        struct_clock *c = timeSyncClock( i );
+        struct_time_hdr req;
+
+        if( now - c->requestedAt < ( c->synced ? interval : kFirstIntervalMs ))
+            continue;
+
+        req.msg_type = MSG_TIME_REQ;
+        req.requestUs = micros();
+        req.receiveUs = 0;
+        req.replyUs = 0;
+
+        c->requestUs = req.requestUs;
+        c->requestedAt = now;
+        ++ c->requests;
+
+        linkSend( sourcesMac( i ), &req, sizeof(req) );
+    }
+}
+
+// A MSG_TIME came in from src at our micros() receiveUs, called from OnDataRecv()
+void timeSyncReceive( int8_t src, const uint8_t *data, uint8_t len, uint32_t receiveUs )
+{
+    const struct_time_hdr *hdr = (const struct_time_hdr *)data;
+    struct_clock *c = timeSyncClock( src );
+
+    // Only the reply to the outstanding request, once
+    if( len != sizeof(struct_time_hdr) || hdr->requestUs != c->requestUs || c->requestUs == 0 )
+        return;
+
+    c->requestUs = 0;
+
+    uint32_t delay = ( receiveUs - hdr->requestUs ) - ( hdr->replyUs - hdr->receiveUs );
+
+    if( delay > kMaxDelayUs )
+        return;
+
+    uint8_t n = min( c->used + c->skipped, (uint32_t)TIMESYNC_DELAYS );
+
+    c->delaysUs[( c->used + c->skipped ) % TIMESYNC_DELAYS] = delay;
+    c->minDelayUs = delay;
+
+    for( uint8_t i = 0; i < n; i++ )
+        c->minDelayUs = min( c->minDelayUs, c->delaysUs[i] );
+
+    if( delay > c->minDelayUs + kDelaySlackUs )
+    {
+        ++ c->skipped;
+        return;
+    }
+
+    uint32_t sample = hdr->receiveUs - hdr->requestUs - delay / 2;
+
+    ++ c->used;
+
+    if( !c->synced )
+    {
+        c->synced = true;
+        c->offsetUs = sample;
+        c->refUs = receiveUs;
+        c->anchorUs = receiveUs;
+        c->anchorOffsetUs = sample;
+        return;
+    }
+
+    // Move a quarter of the way to the sample, that evens out the jitter
+    uint32_t predicted = timeSyncOffset( c, receiveUs );
+
+    c->offsetUs = predicted + (int32_t)( sample - predicted ) / 4;
+    c->refUs = receiveUs;
+
+    uint32_t span = receiveUs - c->anchorUs;
+
+    if( span >= kDriftSpanUs )
+    {
+        int32_t measured = (int64_t)(int32_t)( c->offsetUs - c->anchorOffsetUs ) * 1000000000 / span;
+
+        c->driftPpb += ( measured - c->driftPpb ) / 4;
+        c->anchorUs = receiveUs;
+        c->anchorOffsetUs = c->offsetUs;
+    }
+}
+
+// Convert src's micros() remoteUs into ours in *localUs.
+// Returns false if src's clock isn't known yet.
+bool timeSyncLocal( int8_t src, uint32_t remoteUs, uint32_t *localUs )
+{
+    if( src < 0 || !timeSyncClock( src )->synced )
+        return false;
+
+    const struct_clock *c = &clocks[src];
+
+    *localUs = remoteUs - timeSyncOffset( c, micros() );
+
+    return true;
+}
+
+void timeSyncPrint( void )
+{
+    for( uint8_t i = 0; i < sourcesCount(); i++ )
+    {
+        const struct_clock *c = timeSyncClock( i );
+
+        Serial.printf("IRrecv %02X:%02X:%02X:%02X:%02X:%02X clock: ",
+                      c->mac[0], c->mac[1], c->mac[2], c->mac[3], c->mac[4], c->mac[5]);
+
+        if( c->synced )
+            Serial.printf("%d us ahead, drift %d ppb, round trip %u us, ",
+                          (int32_t)timeSyncOffset( c, micros() ), c->driftPpb, c->minDelayUs);
+        else
+            Serial.printf("not synced, ");
+
+        Serial.printf("%u of %u exchanges used, %u skipped as slow\n", c->used, c->requests, c->skipped);
+    }
+}
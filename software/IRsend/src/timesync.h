@@ -0,0 +1,15 @@
+/*
+ *  IRsend:  timesync.h - Offset and drift of the clocks of the IRrecv nodes against ours.
+*/
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <Arduino.h>
+
+void timeSyncInit( uint32_t intervalMs );
+void timeSyncPoll( uint32_t now );
+void timeSyncReceive( int8_t src, const uint8_t *data, uint8_t len, uint32_t receiveUs );
+bool timeSyncLocal( int8_t src, uint32_t remoteUs, uint32_t *localUs );
+void timeSyncPrint( void );
+
+#endif  // TIMESYNC_H
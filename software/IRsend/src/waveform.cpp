@@ -0,0 +1,273 @@
+/*
+ *  IRsend:  waveform.cpp - Cache of frames compiled into flat mark/space waveforms.
+ *
+ *  IRsend::send() derives the timings of a frame bit by bit through the
+ *  protocol encoder while it transmits, every time. Instead, a frame that
+ *  came with its raw timings is compiled once into a flat waveform, and
+ *  repeats and later presses of the button play it with the emitter.
+ *
+ *  The library's encoders can't be run without transmitting, so a frame is
+ *  compiled from the timings IRrecv captured. The capture is cleaned up:
+ *  the IR detector stretches every mark by about kMarkExcess at the cost of
+ *  the following space, and the marks and spaces that stand for the same
+ *  symbol are all set to their mean, which removes the capture's jitter.
+ *  The carrier the detector strips, and the spacing of repeats, come from the
+ *  protocol.
+ *
+ *  The waveforms used most lately share one pool of timings. The one used
+ *  longest ago makes room for a new one.
+*/
+#include <Arduino.h>
+#include <IRsend.h>
+#include <IRrecv.h>
+#include "messages.h"
+#include "waveform.h"
+#include "rawpack.h"
+
+// Marks or spaces within this many % of each other are the same symbol.
+// Longer ones are gaps between the sections of a frame, kept as they are.
+const uint8_t kSymbolTolerance = 20;
+const uint16_t kSymbolMaxUs = 16000;
+
+// Distinct marks, and spaces, told apart. Any protocol has far fewer.
+#define WAVEFORM_SYMBOLS    16
+
+typedef struct struct_waveform_slot
+{
+    struct_waveform wf;
+    uint16_t offset;        // of its timings in the pool
+    uint32_t lastUsed;      // uses counter when it was last played
+} struct_waveform_slot;
+
+typedef struct struct_symbol
+{
+    uint32_t sum;
+    uint16_t count;
+} struct_symbol;
+
+// What the captures of a protocol don't tell: its carrier, and how long it is
+// from the start of a frame to the start of its repeat. 0 is the default.
+static const struct
+{
+    decode_type_t protocol;
+    uint16_t hz;
+    uint32_t period;        // usecs
+} protocols[] =
+{
+    { decode_type_t::NEC, 0, 108000 },
+    { decode_type_t::SAMSUNG, 0, 108000 },
+    { decode_type_t::LG, 0, 108000 },
+    { decode_type_t::SONY, 40000, 45000 },
+    { decode_type_t::RC5, 36000, 114000 },
+    { decode_type_t::RC5X, 36000, 114000 },
+    { decode_type_t::RC6, 36000, 83000 },
+    { decode_type_t::RCMM, 36000, 0 },
+    { decode_type_t::PANASONIC, 36700, 0 },
+};
+
+static uint16_t pool[WAVEFORM_POOL];
+static uint16_t poolUsed = 0;
+static struct_waveform_slot slots[WAVEFORM_SLOTS];
+static uint16_t carrier = 38000;
+static uint32_t repeatGap = 40000;
+static uint32_t uses = 0;
+
+static uint32_t hits = 0;       // frames played from the cache
+static uint32_t compiled = 0;   // frames compiled
+
+// Set the carrier and the gap to its repeats of a waveform from its protocol
+static void waveformProtocol( struct_waveform *wf, decode_type_t protocol )
+{
+    uint32_t duration = 0;
+
+    wf->freq = carrier;
+    wf->gap = repeatGap;
+
+    for( uint16_t i = 0; i < wf->len; i++ )
+        duration += wf->timings[i];
+
+    for( auto &p : protocols )
+    {
+        if( p.protocol != protocol )
+            continue;
+
+        if( p.hz != 0 )
+            wf->freq = p.hz;
+
+        if( p.period > duration )
+            wf->gap = p.period - duration;
+    }
+}
+
+// The symbol duration stands for, from the means of symbols[]. A new one is
+// added if none is close enough.
+// Returns its index, -1 if it's a gap or there is no room for another one.
+static int8_t waveformSymbol( struct_symbol *symbols, uint8_t *count, uint32_t duration )
+{
+    if( duration > kSymbolMaxUs )
+        return -1;
+
+    for( uint8_t i = 0; i < *count; i++ )
+    {
+        uint32_t mean = symbols[i].sum / symbols[i].count;
+
+        if( ( duration > mean ? duration - mean : mean - duration ) * 100 <= mean * kSymbolTolerance )
+            return i;
+    }
+
+    if( *count == WAVEFORM_SYMBOLS )
+        return -1;
+
+    symbols[*count].sum = 0;
+    symbols[*count].count = 0;
+
+    return (*count)++;
+}
+
+// Drop the waveform in slot, its timings after it move down
+static void waveformEvict( struct_waveform_slot *slot )
+{
+    uint16_t end = slot->offset + slot->wf.len;
+
+    memmove( &pool[slot->offset], &pool[end], ( poolUsed - end ) * sizeof(pool[0]) );
+    poolUsed -= slot->wf.len;
+
+    for( uint8_t i = 0; i < WAVEFORM_SLOTS; i++ )
+    {
+        if( slots[i].wf.key != 0 && slots[i].offset > slot->offset )
+        {
+            slots[i].offset -= slot->wf.len;
+            slots[i].wf.timings = &pool[slots[i].offset];
+        }
+    }
+
+    slot->wf.key = 0;
+}
+
+// Make room for a waveform of len timings.
+// Returns the slot to compile it into.
+static struct_waveform_slot *waveformAlloc( uint16_t len )
+{
+    for( ;; )
+    {
+        struct_waveform_slot *free = NULL;
+        struct_waveform_slot *oldest = NULL;
+
+        for( uint8_t i = 0; i < WAVEFORM_SLOTS; i++ )
+        {
+            if( slots[i].wf.key == 0 )
+                free = &slots[i];
+            else if( oldest == NULL || slots[i].lastUsed < oldest->lastUsed )
+                oldest = &slots[i];
+        }
+
+        if( free != NULL && poolUsed + len <= WAVEFORM_POOL )
+        {
+            free->offset = poolUsed;
+            free->wf.timings = &pool[poolUsed];
+            poolUsed += len;
+
+            return free;
+        }
+
+        waveformEvict( oldest );
+    }
+}
+
+// Carrier of UNKNOWN frames and of the protocols that don't have their own,
+// and the gap between their repeats in usecs
+void waveformInit( uint16_t defaultHz, uint32_t defaultGap )
+{
+    carrier = defaultHz;
+    repeatGap = defaultGap;
+}
+
+// The waveform of the frame with this key, NULL if it isn't cached
+const struct_waveform *waveformGet( uint32_t key )
+{
+    for( uint8_t i = 0; i < WAVEFORM_SLOTS; i++ )
+    {
+        if( slots[i].wf.key == key && key != 0 )
+        {
+            slots[i].lastUsed = ++ uses;
+            ++ hits;
+
+            return &slots[i].wf;
+        }
+    }
+
+    return NULL;
+}
+
+// Compile a frame into the cache, from the raw timings that came with it.
+// Returns its waveform, NULL if it has no raw timings to compile.
+const struct_waveform *waveformCompile( uint32_t key, const struct_IRframe *frame )
+{
+    struct_symbol symbols[2][WAVEFORM_SYMBOLS];
+    uint8_t symbolCount[2] = { 0, 0 };
+    int8_t symbol;
+
+    if( key == 0 || frame->rawLen == 0 || frame->results.overflow )
+        return NULL;
+
+    struct_waveform_slot *slot = waveformAlloc( frame->rawLen );
+    uint16_t *timings = &pool[slot->offset];
+
+    // Packed timings are unpacked right into the pool
+    if( frame->packed != NULL )
+        rawUnpack( frame->packed, frame->packedLen, timings, frame->rawLen );
+    else
+        memcpy( timings, frame->raw, frame->rawLen * sizeof(timings[0]) );
+
+    // Take the detector's mark excess out, and find the symbols. Marks are at
+    // even indexes, spaces at odd ones.
+    for( uint16_t i = 0; i < frame->rawLen; i++ )
+    {
+        uint32_t t = timings[i];
+
+        if( i & 1 )
+            t += kMarkExcess;
+        else if( t > 2 * kMarkExcess )
+            t -= kMarkExcess;
+
+        timings[i] = t;
+
+        if( ( symbol = waveformSymbol( symbols[i & 1], &symbolCount[i & 1], t )) >= 0 )
+        {
+            symbols[i & 1][symbol].sum += t;
+            ++ symbols[i & 1][symbol].count;
+        }
+    }
+
+    // Every mark and space becomes the mean of its symbol
+    for( uint16_t i = 0; i < frame->rawLen; i++ )
+    {
+        struct_symbol *s = symbols[i & 1];
+
+        if( ( symbol = waveformSymbol( s, &symbolCount[i & 1], timings[i] )) >= 0 && s[symbol].count != 0 )
+            timings[i] = ( s[symbol].sum + s[symbol].count / 2 ) / s[symbol].count;
+    }
+
+    slot->wf.key = key;
+    slot->wf.len = frame->rawLen;
+    slot->wf.minRepeats = IRsend::minRepeats( frame->results.decode_type );
+    waveformProtocol( &slot->wf, frame->results.decode_type );
+    slot->lastUsed = ++ uses;
+    ++ compiled;
+
+    return &slot->wf;
+}
+
+void waveformPrint( void )
+{
+    uint8_t count = 0;
+
+    for( uint8_t i = 0; i < WAVEFORM_SLOTS; i++ )
+    {
+        if( slots[i].wf.key != 0 )
+            ++ count;
+    }
+
+    Serial.printf("IRsend waveforms: %u cached (%u/%u timings), %u played from the cache, %u compiled\n",
+                  count, poolUsed, WAVEFORM_POOL, hits, compiled);
+}
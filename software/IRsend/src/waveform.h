@@ -0,0 +1,33 @@
+/*
+ *  IRsend:  waveform.h - Cache of frames compiled into flat mark/space waveforms.
+*/
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <Arduino.h>
+#include "messages.h"
+#include "irframe.h"
+
+// Waveforms cached, and the timings they share. Any single frame fits.
+#define WAVEFORM_SLOTS      8
+#define WAVEFORM_POOL       2048
+
+static_assert( WAVEFORM_POOL >= IRFRAME_MAX_RAW, "every frame must fit into WAVEFORM_POOL" );
+
+// A compiled frame, ready for emitterPlay()
+typedef struct struct_waveform
+{
+    uint32_t key;           // irCodeKey() of the frame, 0 while free
+    uint16_t freq;          // carrier frequency in Hz
+    uint32_t gap;           // usecs of space before each repeat
+    uint16_t minRepeats;    // repeats the protocol always sends
+    uint16_t len;           // mark/space timings
+    const uint16_t *timings;
+} struct_waveform;
+
+void waveformInit( uint16_t defaultHz, uint32_t defaultGap );
+const struct_waveform *waveformGet( uint32_t key );
+const struct_waveform *waveformCompile( uint32_t key, const struct_IRframe *frame );
+void waveformPrint( void );
+
+#endif  // WAVEFORM_H
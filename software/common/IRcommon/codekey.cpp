@@ -0,0 +1,101 @@
+/*
+ *  IRcommon:  codekey.cpp - Code ids of serialized IR frames.
+ *
+ *  A code id is a hash of what a frame emits, so both nodes derive the same
+ *  id from the same frame without agreeing on it first, and two captures of
+ *  one button get the same id. Raw timings differ a little from capture to
+ *  capture and from one receiver to the next, so for UNKNOWN frames the
+ *  number of timings, each timing rounded down to a quarter octave (about the
+ *  capture tolerance) and whether it is shorter, about equal or longer than
+ *  the one before last are hashed. A timing right on the edge of a quarter
+ *  octave can still land either side of it, which costs a cache miss but
+ *  never a wrong code.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include "messages.h"
+#include "codekey.h"
+#include "rawpack.h"
+
+// FNV-1a, one value at a time
+static uint32_t fnv( uint32_t hash, uint32_t value )
+{
+    for( uint8_t i = 0; i < 4; i++ )
+    {
+        hash = ( hash ^ ( value & 0xFF )) * 16777619UL;
+        value >>= 8;
+    }
+
+    return hash;
+}
+
+// Quarter octave of usecs: its top bit and the two bits below it
+static uint8_t codeKeyBucket( uint16_t usecs )
+{
+    if( usecs < 4 )
+        return usecs;
+
+    uint8_t top = 31 - __builtin_clz( usecs );
+
+    return top * 4 + (( usecs >> ( top - 2 )) & 3 );
+}
+
+// Code id of the serialized frame (see messages.h). Never returns 0, which
+// stands for no code.
+uint32_t irCodeKey( const uint8_t *frame, uint16_t len )
+{
+    const struct_IRframe_hdr *hdr = (const struct_IRframe_hdr *)frame;
+
+    if( len < sizeof(struct_IRframe_hdr) )
+        return 1;
+
+    const uint8_t *state = frame + sizeof(struct_IRframe_hdr);
+    const uint16_t *raw = (const uint16_t *)( state + (( hdr->stateLen + 1 ) & ~1 ));
+    uint32_t hash = fnv( 2166136261UL, (uint16_t)hdr->protocol );
+
+    hash = fnv( hash, hdr->bits );
+
+    if( hdr->protocol == decode_type_t::UNKNOWN )
+    {   // Packed timings are read one by one, the last two are kept
+        struct_rawunpack unpack;
+        bool packed = hdr->flags & IRFRAME_FLAG_PACKED;
+        uint16_t last[2];
+        uint16_t now;
+
+        if( packed && !rawUnpackInit( &unpack, (const uint8_t *)raw, frame + len - (const uint8_t *)raw ))
+            return hash != 0 ? hash : 1;
+
+        hash = fnv( hash, hdr->rawLen );
+
+        for( uint16_t i = 0; i < hdr->rawLen; i++ )
+        {
+            if( !packed )
+                now = raw[i];
+            else if( !rawUnpackNext( &unpack, &now ))
+                break;
+
+            hash = fnv( hash, codeKeyBucket( now ));
+
+            if( i >= 2 )
+            {
+                uint32_t before = last[i & 1];
+
+                hash = fnv( hash, ( now * 10 < before * 8 ) ? 0 : ( before * 10 < now * 8 ) ? 2 : 1 );
+            }
+
+            last[i & 1] = now;
+        }
+    }
+    else if( hdr->stateLen != 0 )
+    {
+        for( uint16_t i = 0; i < hdr->stateLen; i++ )
+            hash = fnv( hash, state[i] );
+    }
+    else
+    {
+        hash = fnv( hash, hdr->value );
+        hash = fnv( hash, hdr->value >> 32 );
+    }
+
+    return hash != 0 ? hash : 1;
+}
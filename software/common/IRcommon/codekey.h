@@ -0,0 +1,11 @@
+/*
+ *  IRcommon:  codekey.h - Code ids of serialized IR frames.
+*/
+#ifndef CODEKEY_H
+#define CODEKEY_H
+
+#include <Arduino.h>
+
+uint32_t irCodeKey( const uint8_t *frame, uint16_t len );
+
+#endif  // CODEKEY_H
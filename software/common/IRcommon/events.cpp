@@ -0,0 +1,207 @@
+/*
+ *  IRcommon:  events.cpp - Cooperative event scheduler, loop() idles until there is something to do.
+ *
+ *  Rather than spinning, loop() ends in eventIdle(), which hands the CPU to
+ *  the SDK until one of these happens:
+ *    - a callback posts an event with eventPost(), OnDataRecv() does for every
+ *      packet. It wakes loop() straight away through esp_schedule().
+ *    - the poll function of the node sees something that posts no event of
+ *      its own, like the IR receiver getting edges or a key being typed. It
+ *      is checked every kPollMs while idle.
+ *    - the housekeeping tick comes due, every tickMs. Heartbeats, the LED and
+ *      the timeouts of the modules only need that much resolution.
+ *    - a wake-up asked for with eventWakeIn() comes due, for what has to
+ *      happen sooner, like a batch of messages to send or a frame waiting for
+ *      its moment. eventWakeIn(0) keeps loop() going, there is more to do.
+ *  The idle CPU waits for an interrupt, which keeps the node cool, while the
+ *  radio stack has it all to itself. Light sleep would turn the radio off and
+ *  miss packets, ESP-NOW needs it on.
+ *
+ *  eventTake() returns what happened since the last call. How long loop()
+ *  was idle and how late it got to the events is counted for eventPrint().
+*/
+#include <Arduino.h>
+#include <coredecls.h>
+#include "events.h"
+
+// How often the poll function is checked while idle
+const uint32_t kPollMs = 1;
+
+static const char *kEventNames[EVENT_COUNT] = { "radio", "capture", "serial", "tick", "wake" };
+
+static event_poll_t pollFn = NULL;
+static volatile uint8_t pending = 0;        // events posted since eventTake()
+static uint32_t postedUs[EVENT_COUNT];      // micros() when each was first posted or came due
+
+static uint32_t tickUs;
+static uint32_t tickAt;                     // micros() when the tick is next due
+static bool wakeSet = false;
+static uint32_t wakeAt;                     // micros() of the wake-up asked for
+
+static uint32_t startUs;                    // micros() at eventInit()
+static uint64_t idleUs = 0;                 // time spent in esp_delay()
+static uint32_t wakeups = 0;                // times loop() idled and woke up again
+static uint32_t dispatched[EVENT_COUNT];
+static uint64_t latencySum[EVENT_COUNT];    // usecs from posted to eventTake()
+static uint32_t latencyMax[EVENT_COUNT];
+
+// Run the tick every tickMs, poll is checked for events while idle
+void eventInit( uint32_t tickMs, event_poll_t poll )
+{
+    pollFn = poll;
+    tickUs = tickMs * 1000;
+    startUs = micros();
+    tickAt = startUs + tickUs;
+    memset( dispatched, 0, sizeof(dispatched) );
+    memset( latencySum, 0, sizeof(latencySum) );
+    memset( latencyMax, 0, sizeof(latencyMax) );
+}
+
+// Mark events pending, as having happened at micros() at unless they
+// already were
+static void eventMark( uint8_t events, uint32_t at )
+{
+    for( uint8_t i = 0; i < EVENT_COUNT; i++ )
+    {
+        if(( events & ( 1 << i )) && !( pending & ( 1 << i )))
+            postedUs[i] = at;
+    }
+
+    pending |= events;
+}
+
+// Let loop() know, from a callback or from loop() itself
+void eventPost( uint8_t events )
+{
+    eventMark( events, micros() );
+    esp_schedule();
+}
+
+// Have loop() run again within us, the earliest of those asked for counts
+void eventWakeIn( uint32_t us )
+{
+    uint32_t at = micros() + us;
+
+    if( !wakeSet || (int32_t)( at - wakeAt ) < 0 )
+        wakeAt = at;
+
+    wakeSet = true;
+}
+
+// Post the tick and the wake-up that came due at the time they were due, so
+// their latency is how late loop() got to them
+static void eventTimers( void )
+{
+    uint32_t now = micros();
+
+    if( (int32_t)( now - tickAt ) >= 0 )
+    {
+        eventMark( EVENT_TICK, tickAt );
+        tickAt += tickUs;
+
+        // Ticks that were missed aren't made up for
+        if( (int32_t)( now - tickAt ) >= 0 )
+            tickAt = now + tickUs;
+    }
+
+    if( wakeSet && (int32_t)( now - wakeAt ) >= 0 )
+    {
+        eventMark( EVENT_WAKE, wakeAt );
+        wakeSet = false;
+    }
+}
+
+// The events since the last call, at the top of loop()
+uint8_t eventTake( void )
+{
+    eventTimers();
+
+    uint32_t now = micros();
+    uint8_t events = pending;
+
+    pending = 0;
+
+    for( uint8_t i = 0; i < EVENT_COUNT; i++ )
+    {
+        if( !( events & ( 1 << i )))
+            continue;
+
+        uint32_t latency = now - postedUs[i];
+
+        ++ dispatched[i];
+        latencySum[i] += latency;
+        latencyMax[i] = max( latencyMax[i], latency );
+    }
+
+    return events;
+}
+
+// Nothing to do until an event is posted or polled for
+static bool eventNone( void )
+{
+    if( pending != 0 )
+        return false;
+
+    uint8_t events = pollFn != NULL ? pollFn() : 0;
+
+    if( events != 0 )
+    {
+        eventPost( events );
+        return false;
+    }
+
+    return true;
+}
+
+// Idle until there is something to do, at the end of loop()
+void eventIdle( void )
+{
+    eventTimers();
+
+    if( !eventNone() )
+    {   // Let the SDK have its turn all the same
+        yield();
+        return;
+    }
+
+    uint32_t start = micros();
+    uint32_t until = tickAt;
+
+    if( wakeSet && (int32_t)( wakeAt - until ) < 0 )
+        until = wakeAt;
+
+    int32_t wait = (int32_t)( until - start );
+
+    if( wait > 0 )
+        esp_delay( ( wait + 999 ) / 1000, eventNone, kPollMs );
+    else
+        yield();
+
+    idleUs += micros() - start;
+    ++ wakeups;
+}
+
+void eventPrint( void )
+{
+    uint32_t uptime = micros() - startUs;
+    uint32_t permille = uptime != 0 ? min( idleUs, (uint64_t)uptime ) * 1000 / uptime : 0;
+
+    Serial.printf("Events: idle %u.%u%% of the last %u.%03u s, %u wakeups\n",
+                  permille / 10, permille % 10, uptime / 1000000, uptime / 1000 % 1000, wakeups);
+
+    for( uint8_t i = 0; i < EVENT_COUNT; i++ )
+    {
+        if( dispatched[i] == 0 )
+            continue;
+
+        Serial.printf("  %-8s %8u dispatched, %u us after they happened on average, %u us at most\n",
+                      kEventNames[i], dispatched[i], (uint32_t)( latencySum[i] / dispatched[i] ), latencyMax[i]);
+    }
+
+    startUs = micros();
+    idleUs = 0;
+    wakeups = 0;
+    memset( dispatched, 0, sizeof(dispatched) );
+    memset( latencySum, 0, sizeof(latencySum) );
+    memset( latencyMax, 0, sizeof(latencyMax) );
+}
@@ -0,0 +1,27 @@
+/*
+ *  IRcommon:  events.h - Cooperative event scheduler, loop() idles until there is something to do.
+*/
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <Arduino.h>
+
+// What woke loop() up, eventTake() hands them out as a mask
+#define EVENT_RADIO     0x01    // a packet came in, posted by OnDataRecv()
+#define EVENT_CAPTURE   0x02    // the IR receiver has edges, or a capture waits
+#define EVENT_SERIAL    0x04    // a key was typed
+#define EVENT_TICK      0x08    // the housekeeping timer: heartbeats, LED, timeouts
+#define EVENT_WAKE      0x10    // a wake-up eventWakeIn() asked for came due
+#define EVENT_COUNT     5
+
+// Events nothing posts, checked before and while loop() idles
+typedef uint8_t (*event_poll_t)( void );
+
+void eventInit( uint32_t tickMs, event_poll_t poll );
+void eventPost( uint8_t events );
+void eventWakeIn( uint32_t us );
+uint8_t eventTake( void );
+void eventIdle( void );
+void eventPrint( void );
+
+#endif  // EVENTS_H
@@ -0,0 +1,55 @@
+/*
+ *  IRcommon:  heapstats.cpp - Heap counters of the relay path.
+ *
+ *  The relay runs 24/7 on ~40KB of heap, so relaying a frame must not
+ *  allocate: every allocation costs allocator time and, over weeks, leaves
+ *  the heap too fragmented for the SDK. heapStatsMark() and heapStatsCheck()
+ *  bracket the relay of each frame, and any change of the free heap in
+ *  between is counted against the frame.
+*/
+#include <Arduino.h>
+#include "messages.h"
+#include "heapstats.h"
+
+static uint32_t markFreeHeap;
+static uint32_t minFreeHeap = UINT32_MAX;
+static uint32_t frames = 0;
+static uint32_t allocFrames = 0;
+
+// A frame is about to be relayed
+void heapStatsMark( void )
+{
+    markFreeHeap = ESP.getFreeHeap();
+}
+
+// The frame was relayed, did that leave anything allocated or free anything?
+void heapStatsCheck( void )
+{
+    uint32_t freeHeap = ESP.getFreeHeap();
+
+    ++ frames;
+
+    if( freeHeap != markFreeHeap )
+        ++ allocFrames;
+
+    if( freeHeap < minFreeHeap )
+        minFreeHeap = freeHeap;
+}
+
+void heapStatsGet( struct_heap_stats *stats )
+{
+    stats->freeHeap = ESP.getFreeHeap();
+    stats->minFreeHeap = ( frames != 0 ) ? minFreeHeap : stats->freeHeap;
+    stats->maxFreeBlock = ESP.getMaxFreeBlockSize();
+    stats->fragmentation = ESP.getHeapFragmentation();
+    stats->frames = frames;
+    stats->allocFrames = allocFrames;
+}
+
+void heapStatsPrint( const char *node, const struct_heap_stats *stats )
+{
+    Serial.printf("%s heap: %u free (min %u), largest block %u, %u%% fragmented, "
+                  "%u of %u frames changed the heap\n",
+                  node, stats->freeHeap, stats->minFreeHeap, stats->maxFreeBlock,
+                  stats->fragmentation, stats->allocFrames, stats->frames);
+}
@@ -0,0 +1,15 @@
+/*
+ *  IRcommon:  heapstats.h - Heap counters of the relay path.
+*/
+#ifndef HEAPSTATS_H
+#define HEAPSTATS_H
+
+#include <Arduino.h>
+#include "messages.h"
+
+void heapStatsMark( void );
+void heapStatsCheck( void );
+void heapStatsGet( struct_heap_stats *stats );
+void heapStatsPrint( const char *node, const struct_heap_stats *stats );
+
+#endif  // HEAPSTATS_H
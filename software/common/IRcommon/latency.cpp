@@ -0,0 +1,154 @@
+/*
+ *  IRcommon:  latency.cpp - Per-stage latency histograms.
+ *
+ *  Stages are timed with stamps of the CPU cycle counter, which is cheap
+ *  enough to read anywhere and only wraps after ~53s at 80MHz. Every sample
+ *  goes into a fixed set of power-of-2 buckets, so nothing is allocated and
+ *  the histograms fit into a single MSG_STATS packet.
+*/
+#include <Arduino.h>
+#include "messages.h"
+#include "latency.h"
+#include "heapstats.h"
+
+static_assert( STATS_MAX_STAGES >= 4, "a node's stages must fit into one MSG_STATS" );
+
+typedef struct struct_latency
+{
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t sumUs;
+    uint16_t buckets[LATENCY_BUCKETS];
+    uint32_t armedAt;           // stamp the armed stage started at
+    bool armed;                 // latencyEvent() ends it
+} struct_latency;
+
+static struct_latency stages[STAGE_COUNT];
+
+static const char *const stageNames[STAGE_COUNT] =
+{
+    "decode", "send", "radio", "log", "queue", "emit", "log", "transit"
+};
+
+// Stamp to time a stage with, in CPU cycles
+uint32_t latencyStamp( void )
+{
+    return ESP.getCycleCount();
+}
+
+// Add a sample of a stage that started at stamp from and ended at stamp to
+void latencyRecord( LATENCY_STAGE_E stage, uint32_t from, uint32_t to )
+{
+    latencyRecordUs( stage, ( to - from ) / ESP.getCpuFreqMHz() );
+}
+
+// Add a sample of us usecs to a stage
+void latencyRecordUs( LATENCY_STAGE_E stage, uint32_t us )
+{
+    struct_latency *s = &stages[stage];
+    int8_t bucket = 32 - __builtin_clz( us | 1 ) - 5;
+
+    if( bucket < 0 )
+        bucket = 0;
+    else if( bucket >= LATENCY_BUCKETS )
+        bucket = LATENCY_BUCKETS - 1;
+
+    if( s->buckets[bucket] != UINT16_MAX )
+        ++ s->buckets[bucket];
+
+    ++ s->count;
+    s->sumUs += us;
+
+    if( us > s->maxUs )
+        s->maxUs = us;
+}
+
+// Start a stage that ends with the next call of latencyEvent(), e.g. the
+// OnDataSent() of the last fragment of a frame
+void latencyArm( LATENCY_STAGE_E stage, uint32_t from )
+{
+    stages[stage].armedAt = from;
+    stages[stage].armed = true;
+}
+
+void latencyEvent( LATENCY_STAGE_E stage )
+{
+    struct_latency *s = &stages[stage];
+
+    if( s->armed )
+    {
+        s->armed = false;
+        latencyRecord( stage, s->armedAt, latencyStamp() );
+    }
+}
+
+// Build a MSG_STATS packet of the heap and of the stages that have samples.
+// Returns its length.
+uint8_t latencyEncode( uint8_t *buf, uint8_t bufSize )
+{
+    struct_stats_hdr *hdr = (struct_stats_hdr *)buf;
+    uint8_t len = sizeof(struct_stats_hdr);
+
+    hdr->msg_type = MSG_STATS;
+    hdr->stageCount = 0;
+    heapStatsGet( &hdr->heap );
+
+    for( uint8_t i = 0; i < STAGE_COUNT; i++ )
+    {
+        const struct_latency *s = &stages[i];
+        struct_latency_hist hist;
+
+        if( s->count == 0 || len + sizeof(hist) > bufSize )
+            continue;
+
+        hist.stage = i;
+        hist.count = s->count;
+        hist.meanUs = s->sumUs / s->count;
+        hist.maxUs = s->maxUs;
+        memcpy( hist.buckets, s->buckets, sizeof(hist.buckets) );
+
+        memcpy( buf + len, &hist, sizeof(hist) );
+        len += sizeof(hist);
+        ++ hdr->stageCount;
+    }
+
+    return len;
+}
+
+// Print the heap and histograms of a MSG_STATS packet, one line per stage
+void latencyPrint( const char *node, const uint8_t *stats, uint8_t len )
+{
+    const struct_stats_hdr *hdr = (const struct_stats_hdr *)stats;
+
+    if( len < sizeof(struct_stats_hdr) || len < sizeof(struct_stats_hdr) + hdr->stageCount * sizeof(struct_latency_hist) )
+        return;
+
+    heapStatsPrint( node, &hdr->heap );
+    Serial.printf("%s latency (usecs), bucket i counts [2^(i+4), 2^(i+5)):\n", node);
+
+    if( hdr->stageCount == 0 )
+        Serial.println("  no samples yet");
+
+    for( uint8_t i = 0; i < hdr->stageCount; i++ )
+    {
+        struct_latency_hist hist;
+
+        memcpy( &hist, stats + sizeof(struct_stats_hdr) + i * sizeof(hist), sizeof(hist) );
+
+        Serial.printf("  %-6s n=%u avg=%u max=%u |", hist.stage < STAGE_COUNT ? stageNames[hist.stage] : "?",
+                      hist.count, hist.meanUs, hist.maxUs);
+
+        for( uint8_t b = 0; b < LATENCY_BUCKETS; b++ )
+            Serial.printf(" %u", hist.buckets[b]);
+
+        Serial.println();
+    }
+}
+
+// Print the histograms of this node
+void latencyDump( const char *node )
+{
+    uint8_t buf[ESPNOW_MAX_PAYLOAD];
+
+    latencyPrint( node, buf, latencyEncode( buf, sizeof(buf) ));
+}
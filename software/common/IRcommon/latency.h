@@ -0,0 +1,19 @@
+/*
+ *  IRcommon:  latency.h - Per-stage latency histograms.
+*/
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <Arduino.h>
+#include "messages.h"
+
+uint32_t latencyStamp( void );
+void latencyRecord( LATENCY_STAGE_E stage, uint32_t from, uint32_t to );
+void latencyRecordUs( LATENCY_STAGE_E stage, uint32_t us );
+void latencyArm( LATENCY_STAGE_E stage, uint32_t from );
+void latencyEvent( LATENCY_STAGE_E stage );
+uint8_t latencyEncode( uint8_t *buf, uint8_t bufSize );
+void latencyPrint( const char *node, const uint8_t *stats, uint8_t len );
+void latencyDump( const char *node );
+
+#endif  // LATENCY_H
@@ -0,0 +1,463 @@
+/*
+ *  IRcommon:  link.cpp - Rolling quality statistics and adaptive heartbeat of the ESP-NOW link to another node.
+ *
+ *  Anything that comes in from a node shows its link is up, so liveness
+ *  rides on the frames and ACKs going back and forth. A MSG_HEARTBEAT is
+ *  only sent to a node we had nothing else to send to for a while. The
+ *  interval doubles with every heartbeat while the link is good, so an idle
+ *  link costs little airtime, and drops back to the shortest one as soon as
+ *  the link isn't. Each heartbeat announces the interval, the other node
+ *  waits for three of them before it calls the link down.
+ *
+ *  Besides liveness each link keeps the rate of unicasts that failed, the
+ *  RSSI of what comes in, how long the radio takes to report a send done and
+ *  how many frames had to be sent again. They decide whether a link is good
+ *  or marginal, and through linkLed() what the status LED shows.
+ *
+ *  Heartbeats, ACKs and the like are a few bytes each, far less than what
+ *  the radio spends on a packet. linkQueue() holds them back for up to
+ *  kBatchHoldUs and packs those to the same node into one MSG_BATCH. A
+ *  message linkSend() sends to that node takes the batch along if it fits.
+ *  On the receiving side linkNext() hands out the messages of a batch one
+ *  by one where they are in the packet.
+ *
+ *  ESP-NOW doesn't hand over the RSSI of a packet on the ESP8266, and
+ *  WiFi.RSSI() is only known while associated, which the nodes never are.
+ *  With linkRssiInit() the radio runs in promiscuous mode as well, and its
+ *  callback, which sees every packet right before ESP-NOW does, notes the
+ *  RSSI of the ESP-NOW packets by their sender for linkHeard().
+*/
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <user_interface.h>
+#include <espnow.h>
+#include "messages.h"
+#include "link.h"
+#include "events.h"
+
+// Heartbeat intervals, from a link that isn't good to one idle for long
+const uint32_t kHeartbeatMinMs = 1000;
+const uint32_t kHeartbeatMaxMs = 8000;
+
+// A link is down after three of the other node's heartbeats are missing, or
+// once this many unicasts in a row failed
+const uint32_t kHeartbeatsMissed = 3;
+const uint32_t kHeartbeatSlackMs = 500;
+const uint8_t kMaxFails = 5;
+
+// A link that is up is marginal beyond any of these
+const uint16_t kMarginalLoss = 65535 / 10;
+const int8_t kMarginalRssi = -80;
+const uint32_t kMarginalSendUs = 10000;
+
+// Blink periods of the status LED
+const uint32_t kBlinkMarginalMs = 1000;
+const uint32_t kBlinkDownMs = 250;
+
+// esp_now_send() stamps of the packets the radio hasn't reported done yet,
+// it reports them in order. A frame in full to every node fits.
+#define LINK_SENDS      64
+
+static uint32_t sendStamps[LINK_SENDS];
+static bool sendMarks[LINK_SENDS];      // linkMark() was called for it
+static uint8_t sendNext = 0;
+static uint8_t sendCount = 0;
+
+// Longest a queued message waits for others to the same node
+const uint32_t kBatchHoldUs = 2000;
+
+// Messages linkQueue() holds back, all to the same node
+static uint8_t batchMac[6];
+static uint8_t batchBuf[ESPNOW_MAX_PAYLOAD];
+static uint8_t batchLen = 0;            // 0 while none waits
+static uint8_t batchCount;              // messages in batchBuf[]
+static uint32_t batchSince;             // micros() when the first one was queued
+
+static uint32_t batchPackets = 0;       // batches sent
+static uint32_t batchMessages = 0;      // messages they carried
+
+// What the promiscuous callback is handed for a management frame, which an
+// ESP-NOW packet is: the SDK's RxControl, RSSI first, then the start of the
+// frame
+typedef struct __attribute__((packed)) struct_sniffed
+{
+    int8_t rssi;                // dBm
+    uint8_t rxControl[11];
+    uint8_t frame[112];         // 802.11 header and the start of the body
+    uint16_t count;
+    uint16_t len;
+} struct_sniffed;
+
+// An ESP-NOW packet is a vendor specific action frame with Espressif's OUI
+#define SNIFF_ACTION        0xD0    // frame control, first byte
+#define SNIFF_SENDER        10      // offset of the transmitter's address
+#define SNIFF_CATEGORY      24      // offset of the action category
+#define SNIFF_VENDOR        0x7F
+
+static const uint8_t kEspressifOui[3] = { 0x18, 0xFE, 0x34 };
+
+// RSSI of the last ESP-NOW packets, by sender, until linkHeard() takes them
+#define LINK_SNIFFED        4
+
+static uint8_t sniffedMacs[LINK_SNIFFED][6];
+static int8_t sniffedRssi[LINK_SNIFFED];    // 0 once taken
+static uint8_t sniffedNext = 0;
+
+// Note the RSSI of an ESP-NOW packet, called by the SDK for everything the
+// radio receives
+static void linkSniffed( uint8_t *buf, uint16_t len )
+{
+    const struct_sniffed *pkt = (const struct_sniffed *)buf;
+
+    if( len != sizeof(struct_sniffed) || pkt->frame[0] != SNIFF_ACTION ||
+        pkt->frame[SNIFF_CATEGORY] != SNIFF_VENDOR ||
+        memcmp( &pkt->frame[SNIFF_CATEGORY + 1], kEspressifOui, 3 ) != 0 )
+        return;
+
+    memcpy( sniffedMacs[sniffedNext], &pkt->frame[SNIFF_SENDER], 6 );
+    sniffedRssi[sniffedNext] = pkt->rssi;
+    sniffedNext = ( sniffedNext + 1 ) % LINK_SNIFFED;
+}
+
+// Take the RSSI of the packets that come in, call once ESP-NOW is up
+void linkRssiInit( void )
+{
+    wifi_set_promiscuous_rx_cb( linkSniffed );
+    wifi_promiscuous_enable( 1 );
+}
+
+void linkInit( struct_link *link )
+{
+    memset( link, 0, sizeof(*link) );
+    link->heartbeatMs = kHeartbeatMinMs;
+    link->peerHeartbeatMs = kHeartbeatMinMs;
+}
+
+// esp_now_send(), timed until linkSendDone().
+// Returns false if ESP-NOW refused the packet.
+static bool linkTransmit( uint8_t *mac, const void *data, uint8_t len )
+{
+    uint32_t stamp = micros();
+
+    if( esp_now_send( mac, (uint8_t *)data, len ) != 0 )
+        return false;
+
+    // Should reports ever go missing, the oldest stamp makes room
+    sendStamps[( sendNext + sendCount ) % LINK_SENDS] = stamp;
+    sendMarks[( sendNext + sendCount ) % LINK_SENDS] = false;
+
+    if( sendCount < LINK_SENDS )
+        ++ sendCount;
+    else
+        sendNext = ( sendNext + 1 ) % LINK_SENDS;
+
+    return true;
+}
+
+// Does a message fit behind what is queued for mac?
+static bool linkBatchFits( const uint8_t *mac, uint8_t len )
+{
+    return batchLen != 0 && memcmp( mac, batchMac, sizeof(batchMac) ) == 0 &&
+           batchLen + BATCH_RECORD_HDR + len <= ESPNOW_MAX_PAYLOAD;
+}
+
+static void linkBatchAdd( const void *data, uint8_t len )
+{
+    batchBuf[batchLen] = len;
+    memcpy( batchBuf + batchLen + BATCH_RECORD_HDR, data, len );
+    batchLen += BATCH_RECORD_HDR + len;
+    ++ batchCount;
+}
+
+// Send a message to the node now, along with what is queued for it.
+// Returns false if ESP-NOW refused the packet.
+bool linkSend( uint8_t *mac, const void *data, uint8_t len )
+{
+    if( linkBatchFits( mac, len ))
+    {
+        linkBatchAdd( data, len );
+        return linkFlush();
+    }
+
+    linkFlush();
+
+    return linkTransmit( mac, data, len );
+}
+
+// Send a small message to the node within kBatchHoldUs, in one packet with
+// the others queued for it by then.
+// Returns false if ESP-NOW refused a packet it had to be sent with now.
+bool linkQueue( uint8_t *mac, const void *data, uint8_t len )
+{
+    bool success = true;
+
+    if( sizeof(struct_batch_hdr) + BATCH_RECORD_HDR + len > ESPNOW_MAX_PAYLOAD )
+        return linkSend( mac, data, len );
+
+    if( batchLen != 0 && !linkBatchFits( mac, len ))
+        success = linkFlush();
+
+    if( batchLen == 0 )
+    {
+        memcpy( batchMac, mac, sizeof(batchMac) );
+        batchBuf[0] = MSG_BATCH;
+        batchLen = sizeof(struct_batch_hdr);
+        batchCount = 0;
+        batchSince = micros();
+        eventWakeIn( kBatchHoldUs );
+    }
+
+    linkBatchAdd( data, len );
+
+    return success;
+}
+
+// Send what is queued right away. A lone message goes out as it is.
+// Returns false if ESP-NOW refused the packet.
+bool linkFlush( void )
+{
+    bool success;
+
+    if( batchLen == 0 )
+        return true;
+
+    if( batchCount == 1 )
+        success = linkTransmit( batchMac, batchBuf + sizeof(struct_batch_hdr) + BATCH_RECORD_HDR,
+                                batchLen - sizeof(struct_batch_hdr) - BATCH_RECORD_HDR );
+    else
+    {
+        success = linkTransmit( batchMac, batchBuf, batchLen );
+        ++ batchPackets;
+        batchMessages += batchCount;
+    }
+
+    batchLen = 0;
+
+    return success;
+}
+
+// Send what is queued once it waited for kBatchHoldUs, called from loop().
+// linkQueue() has it woken up by then.
+void linkPoll( void )
+{
+    if( batchLen != 0 && micros() - batchSince >= kBatchHoldUs )
+        linkFlush();
+}
+
+// The next message of a packet that came in, where it is in the packet. A
+// MSG_BATCH hands out its records one by one, any other packet is a single
+// message. *offset starts out at 0.
+// Returns NULL once there is none left.
+const uint8_t *linkNext( const uint8_t *data, uint8_t len, uint8_t *offset, uint8_t *msgLen )
+{
+    if( len == 0 || data[0] != MSG_BATCH )
+    {
+        if( *offset != 0 || len == 0 )
+            return NULL;
+
+        *offset = len;
+        *msgLen = len;
+        return data;
+    }
+
+    if( *offset == 0 )
+        *offset = sizeof(struct_batch_hdr);
+
+    // A record running past the end of the packet ends it
+    if( *offset + BATCH_RECORD_HDR > len || data[*offset] == 0 ||
+        *offset + BATCH_RECORD_HDR + data[*offset] > len )
+        return NULL;
+
+    const uint8_t *msg = data + *offset + BATCH_RECORD_HDR;
+
+    *msgLen = data[*offset];
+    *offset += BATCH_RECORD_HDR + *msgLen;
+
+    return msg;
+}
+
+// Mark the packet sent last, e.g. the last fragment of a frame, so
+// linkSendDone() tells when the radio is done with it
+void linkMark( void )
+{
+    if( sendCount != 0 )
+        sendMarks[( sendNext + sendCount - 1 ) % LINK_SENDS] = true;
+}
+
+// The radio reported a packet done, called from OnDataSent(). *marked is set
+// if linkMark() was called for it.
+// Returns the usecs since it went to linkTransmit(), 0 if that's unknown.
+uint32_t linkSendDone( bool *marked )
+{
+    *marked = false;
+
+    if( sendCount == 0 )
+        return 0;
+
+    uint32_t stamp = sendStamps[sendNext];
+
+    *marked = sendMarks[sendNext];
+
+    sendNext = ( sendNext + 1 ) % LINK_SENDS;
+    -- sendCount;
+
+    return micros() - stamp;
+}
+
+// A packet went out that the node gets, a broadcast included
+void linkSent( struct_link *link, uint32_t now )
+{
+    link->lastSent = now;
+}
+
+// Move a rolling average an eighth of the way to sample. The step is
+// rounded away from zero, truncated it would stop short of the sample by up
+// to 7 and a link that stopped losing packets would never read 0% loss.
+static int32_t linkAverage( int32_t avg, int32_t sample )
+{
+    int32_t diff = sample - avg;
+
+    return avg + ( diff + ( diff < 0 ? -7 : 7 )) / 8;
+}
+
+// The radio's report of a unicast to the node, sendUs after it was sent
+void linkDelivered( struct_link *link, bool success, uint32_t sendUs )
+{
+    ++ link->sent;
+
+    if( success )
+        link->fails = 0;
+    else
+    {
+        ++ link->failed;
+
+        if( link->fails < kMaxFails )
+            ++ link->fails;
+    }
+
+    link->loss = linkAverage( link->loss, success ? 0 : 65535 );
+
+    if( sendUs != 0 )
+        link->sendUs = ( link->sendUs == 0 ) ? sendUs : linkAverage( link->sendUs, sendUs );
+}
+
+// A packet came in from the node at mac. Its RSSI is the one linkSniffed()
+// noted last for mac, if any.
+void linkHeard( struct_link *link, const uint8_t *mac, const uint8_t *data, uint8_t len, uint32_t now )
+{
+    int8_t rssi = 0;
+
+    link->lastHeard = now;
+
+    for( uint8_t i = 1; i <= LINK_SNIFFED && rssi == 0; i++ )
+    {
+        uint8_t j = ( sniffedNext + LINK_SNIFFED - i ) % LINK_SNIFFED;
+
+        if( sniffedRssi[j] != 0 && memcmp( sniffedMacs[j], mac, 6 ) == 0 )
+        {
+            rssi = sniffedRssi[j];
+            sniffedRssi[j] = 0;
+        }
+    }
+
+    if( rssi < 0 )
+        link->rssi = ( link->rssi == 0 ) ? rssi : linkAverage( link->rssi, rssi );
+
+    uint8_t offset = 0;
+    uint8_t msgLen;
+    const uint8_t *msg;
+
+    while(( msg = linkNext( data, len, &offset, &msgLen )) != NULL )
+    {
+        if( msgLen >= sizeof(struct_heartbeat_hdr) && msg[0] == MSG_HEARTBEAT )
+        {
+            uint16_t intervalMs = ((const struct_heartbeat_hdr *)msg)->intervalMs;
+
+            link->peerHeartbeatMs = ( intervalMs != 0 ) ? intervalMs : kHeartbeatMinMs;
+        }
+    }
+}
+
+// A frame had to be sent to the node again
+void linkRetransmit( struct_link *link )
+{
+    ++ link->retransmits;
+}
+
+// Send the node a heartbeat if we had nothing else for it for a while.
+// Returns true if one was sent.
+bool linkHeartbeat( uint8_t *mac, struct_link *link, uint32_t now )
+{
+    struct_heartbeat_hdr hdr;
+
+    if( now - link->lastSent < link->heartbeatMs )
+        return false;
+
+    if( linkQuality( link, now ) == LINK_GOOD && link->fails == 0 )
+        link->heartbeatMs = min( link->heartbeatMs * 2, kHeartbeatMaxMs );
+    else
+        link->heartbeatMs = kHeartbeatMinMs;
+
+    hdr.msg_type = MSG_HEARTBEAT;
+    hdr.intervalMs = link->heartbeatMs;
+
+    link->lastSent = now;
+    ++ link->heartbeats;
+
+    return linkQueue( mac, &hdr, sizeof(hdr) );
+}
+
+LINK_QUALITY_E linkQuality( const struct_link *link, uint32_t now )
+{
+    if( link->lastHeard == 0 || link->fails >= kMaxFails ||
+        now - link->lastHeard > kHeartbeatsMissed * link->peerHeartbeatMs + kHeartbeatSlackMs )
+        return LINK_DOWN;
+
+    if( link->loss > kMarginalLoss || ( link->rssi != 0 && link->rssi < kMarginalRssi ) ||
+        link->sendUs > kMarginalSendUs )
+        return LINK_MARGINAL;
+
+    return LINK_GOOD;
+}
+
+// Level of the status LED for the worst and the best of a node's links: on
+// while they are all good, off while they are all down, blinking slowly
+// while one is marginal and quickly while one is down.
+uint8_t linkLed( LINK_QUALITY_E worst, LINK_QUALITY_E best, uint32_t now )
+{
+    if( best == LINK_DOWN )
+        return LOW;
+
+    if( worst == LINK_GOOD )
+        return HIGH;
+
+    uint32_t period = ( worst == LINK_MARGINAL ) ? kBlinkMarginalMs : kBlinkDownMs;
+
+    return ( now % period < period / 2 ) ? HIGH : LOW;
+}
+
+// The rest of a line about the node, after its name
+void linkPrint( const struct_link *link, uint32_t now )
+{
+    static const char *qualities[] = { "down", "marginal", "good" };
+
+    Serial.printf("link %s, last heard %u ms ago, heartbeat every %u ms (theirs %u ms), loss %u.%u%%, ",
+                  qualities[linkQuality( link, now )], link->lastHeard != 0 ? now - link->lastHeard : 0,
+                  link->heartbeatMs, link->peerHeartbeatMs,
+                  link->loss * 1000 / 65535 / 10, link->loss * 1000 / 65535 % 10);
+
+    if( link->rssi != 0 )
+        Serial.printf("RSSI %d dBm, ", link->rssi);
+    else
+        Serial.printf("RSSI unknown, ");
+
+    Serial.printf("send %u us, %u of %u unicasts failed, %u heartbeats, %u retransmits\n",
+                  link->sendUs, link->failed, link->sent, link->heartbeats, link->retransmits);
+}
+
+// How much batching saved, for all the links
+void linkPrintBatches( void )
+{
+    Serial.printf("Batches: %u messages went out in %u packets instead of one each\n",
+                  batchMessages, batchPackets);
+}
@@ -0,0 +1,53 @@
+/*
+ *  IRcommon:  link.h - Rolling quality statistics and adaptive heartbeat of the ESP-NOW link to another node.
+*/
+#ifndef LINK_H
+#define LINK_H
+
+#include <Arduino.h>
+
+typedef enum
+{
+    LINK_DOWN = 0,          // not heard from in time, or unicasts keep failing
+    LINK_MARGINAL,          // up, but losing packets, weak or slow
+    LINK_GOOD
+} LINK_QUALITY_E;
+
+// Statistics of the link to one node. Rates and averages are rolling, each
+// sample counts for 1/8 of them.
+typedef struct struct_link
+{
+    uint32_t lastHeard;         // millis() when anything last came in from it, 0 if never
+    uint32_t lastSent;          // millis() when anything last went out to it
+    uint32_t heartbeatMs;       // our idle heartbeat interval
+    uint32_t peerHeartbeatMs;   // the one it announced
+    uint8_t fails;              // unicasts in a row that failed
+    uint16_t loss;              // rate of failed unicasts, 65535 is all of them
+    int8_t rssi;                // dBm of what came in, 0 if unknown
+    uint32_t sendUs;            // esp_now_send() to OnDataSent() of a unicast
+    uint32_t sent;              // unicasts sent
+    uint32_t failed;            // of those, the ones that failed
+    uint32_t heartbeats;        // heartbeats sent to it
+    uint32_t retransmits;       // frames that had to be sent again
+} struct_link;
+
+void linkRssiInit( void );
+void linkInit( struct_link *link );
+bool linkSend( uint8_t *mac, const void *data, uint8_t len );
+bool linkQueue( uint8_t *mac, const void *data, uint8_t len );
+bool linkFlush( void );
+void linkPoll( void );
+const uint8_t *linkNext( const uint8_t *data, uint8_t len, uint8_t *offset, uint8_t *msgLen );
+void linkMark( void );
+uint32_t linkSendDone( bool *marked );
+void linkSent( struct_link *link, uint32_t now );
+void linkDelivered( struct_link *link, bool success, uint32_t sendUs );
+void linkHeard( struct_link *link, const uint8_t *mac, const uint8_t *data, uint8_t len, uint32_t now );
+void linkRetransmit( struct_link *link );
+bool linkHeartbeat( uint8_t *mac, struct_link *link, uint32_t now );
+LINK_QUALITY_E linkQuality( const struct_link *link, uint32_t now );
+uint8_t linkLed( LINK_QUALITY_E worst, LINK_QUALITY_E best, uint32_t now );
+void linkPrint( const struct_link *link, uint32_t now );
+void linkPrintBatches( void );
+
+#endif  // LINK_H
@@ -0,0 +1,84 @@
+/*
+ *  IRcommon:  logring.cpp - Deferred log of fixed-size binary records.
+ *
+ *  Formatting text and pushing it through the UART at 115200 baud takes
+ *  milliseconds, which used to be spent between receiving a frame and
+ *  relaying it. Now the relay path only fills in a binary record. loop()
+ *  calls logDrain() once it's idle to print the records, and only as much
+ *  as fits into the UART FIFO, so printing never blocks either.
+ *  When the ring is full, new records are dropped and counted.
+*/
+#include <Arduino.h>
+#include "logring.h"
+
+// Free space the UART FIFO needs before another record is printed, about
+// the longest line a record prints as
+const int kLogLineMax = 96;
+
+static struct_logrec ring[LOGRING_SIZE];
+static uint8_t head = 0;            // next record to fill
+static uint8_t tail = 0;            // next record to print
+static uint32_t dropped = 0;        // records lost because the ring was full
+static LOG_LEVEL_E maxLevel = LOG_INFO;
+static void (*printRecord)( const struct_logrec * );
+
+// print formats a record and prints it to Serial
+void logInit( LOG_LEVEL_E level, void (*print)( const struct_logrec * ) )
+{
+    maxLevel = level;
+    printRecord = print;
+}
+
+LOG_LEVEL_E logLevel( void )
+{
+    return maxLevel;
+}
+
+void logSetLevel( LOG_LEVEL_E level )
+{
+    maxLevel = level;
+}
+
+// Get a new record to fill in. It is printed later by logDrain().
+// Returns NULL if the level is filtered out or the ring is full.
+struct_logrec *logNew( LOG_LEVEL_E level, LOG_EVENT_E event )
+{
+    if( level > maxLevel )
+        return NULL;
+
+    if( (uint8_t)( head - tail ) >= LOGRING_SIZE )
+    {
+        ++ dropped;
+        return NULL;
+    }
+
+    struct_logrec *rec = &ring[head % LOGRING_SIZE];
+
+    memset( rec, 0, sizeof(*rec) );
+    rec->time = millis();
+    rec->level = level;
+    rec->event = event;
+    ++ head;
+
+    return rec;
+}
+
+// Print waiting records, as long as the UART can take them without blocking
+void logDrain( void )
+{
+    while( Serial.availableForWrite() >= kLogLineMax )
+    {
+        if( head != tail )
+        {
+            printRecord( &ring[tail % LOGRING_SIZE] );
+            ++ tail;
+        }
+        else if( dropped != 0 )
+        {   // The records that were dropped came after all of those
+            Serial.printf("%u log record(s) dropped.\n", dropped);
+            dropped = 0;
+        }
+        else
+            break;
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ *  IRcommon:  logring.h - Deferred log of fixed-size binary records.
+*/
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <Arduino.h>
+
+// Number of records that can wait to be printed. Must be a power of 2.
+#define LOGRING_SIZE    32
+
+static_assert( (LOGRING_SIZE & (LOGRING_SIZE - 1)) == 0, "LOGRING_SIZE must be a power of 2" );
+
+typedef enum
+{
+    LOG_ERROR = 0,
+    LOG_INFO,
+    LOG_DEBUG
+} LOG_LEVEL_E;
+
+// What a record is about, this decides how it's printed. Each node prints
+// its own, the fields it fills in are listed by node.
+typedef enum
+{
+    LOG_EV_FRAME = 0,       // IRrecv: protocol, bits, success, arg[0] decode usecs, arg[1] send usecs
+                            // IRsend: frameId, protocol, bits, success, arg[0] frames still queued
+    LOG_EV_REPEAT,          // IRrecv: protocol, success
+                            // IRsend: frameId, success, arg[0] number of repeats
+    LOG_EV_SENT,            // IRrecv: success of an esp_now_send()
+    LOG_EV_RETRY,           // IRrecv: frameId, arg[0] times it was sent before
+    LOG_EV_EXPIRED,         // IRrecv: frameId, arg[0] times it was sent, arg[1] mask of the peers that missed it
+    LOG_EV_UNROUTED,        // IRrecv: protocol, bits
+    LOG_EV_OVERFLOW,        // IRsend: frameId of a frame that didn't fit into IRrecv's capture buffer
+    LOG_EV_STREAM           // IRsend: frameId, success of a streamed capture, arg[0] timings emitted
+} LOG_EVENT_E;
+
+typedef struct struct_logrec
+{
+    uint32_t time;          // millis() when it was logged
+    uint8_t  level;         // LOG_LEVEL_E
+    uint8_t  event;         // LOG_EVENT_E
+    uint8_t  frameId;
+    uint8_t  success;
+    int16_t  protocol;      // decode_type_t
+    uint16_t bits;
+    uint32_t arg[2];
+} struct_logrec;
+
+void logInit( LOG_LEVEL_E level, void (*print)( const struct_logrec * ) );
+LOG_LEVEL_E logLevel( void );
+void logSetLevel( LOG_LEVEL_E level );
+struct_logrec *logNew( LOG_LEVEL_E level, LOG_EVENT_E event );
+void logDrain( void );
+
+#endif  // LOGRING_H
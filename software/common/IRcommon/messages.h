@@ -0,0 +1,229 @@
+/*
+ *  IRcommon:  messages.h - The ESP-NOW messages between the IRrecv and IRsend nodes.
+*/
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include <IRrecv.h>
+
+typedef enum
+{
+    MSG_IR          = 0x00,
+    MSG_IR_ACK      = 0x01,
+    MSG_IR_REPEAT   = 0x02,
+    MSG_STATS_REQ   = 0x03,
+    MSG_STATS       = 0x04,
+    MSG_IR_CODE     = 0x05,
+    MSG_IR_MISS     = 0x06,
+    MSG_IR_STREAM   = 0x07,
+    MSG_TIME_REQ    = 0x08,
+    MSG_TIME        = 0x09,
+    MSG_BATCH       = 0x0A,
+    MSG_HEARTBEAT   = 0xFF
+} MESSAGE_TYPE_E;
+
+// ==================== begin of IR frame wire format ====================
+// An IR capture is serialized into a self-contained frame (struct_IRframe_hdr
+// followed by its state[] and raw timings) and the frame is split into one or
+// more MSG_IR fragments that each fit into a single ESP-NOW packet.
+
+// ESP-NOW will not carry more than this many bytes in a single packet
+#define ESPNOW_MAX_PAYLOAD      250
+
+// Largest number of raw mark/space timings a frame can carry.
+// Matches kCaptureBufferSize (1024 == ~511 bits).
+#define IRFRAME_MAX_RAW         1024
+
+// struct_IRframe_hdr.flags
+#define IRFRAME_FLAG_REPEAT     0x01    // decode_results.repeat was set
+#define IRFRAME_FLAG_OVERFLOW   0x02    // capture did not fit, raw timings are truncated
+#define IRFRAME_FLAG_PACKED     0x04    // raw timings are packed by rawPack(), see rawpack.cpp
+
+// Header of every IR frame fragment. msg_type lines up with the first byte of
+// the other messages so the receiver can dispatch on incomingData[0].
+typedef struct __attribute__((packed)) struct_IRfragment_hdr
+{
+    uint8_t  msg_type;      // MSG_IR
+    uint8_t  frameId;       // rolling sequence number, all fragments and retransmits of a frame share it
+    uint8_t  fragIndex;     // 0 .. fragCount - 1
+    uint8_t  fragCount;     // number of fragments the frame was split into
+    uint16_t frameLen;      // length of the whole serialized frame in bytes
+    uint32_t captureUs;     // IRrecv's micros() when the capture was over
+} struct_IRfragment_hdr;
+
+// Bytes of frame data that fit behind the header of a single fragment
+#define IRFRAGMENT_MAX_DATA     (ESPNOW_MAX_PAYLOAD - sizeof(struct_IRfragment_hdr))
+
+// Serialized IR frame. The header is followed by stateLen bytes of state[]
+// (only for protocols that need one) padded to an even length, and then by
+// rawLen mark/space timings in micro-seconds, ready to be used by sendRaw().
+// With IRFRAME_FLAG_PACKED the timings are packed instead, up to the end of
+// the frame.
+typedef struct __attribute__((packed)) struct_IRframe_hdr
+{
+    int16_t  protocol;      // decode_type_t
+    uint16_t bits;
+    uint64_t value;
+    uint32_t address;
+    uint32_t command;
+    uint8_t  flags;         // IRFRAME_FLAG_xxx
+    uint8_t  stateLen;      // bytes of state[] following the header
+    uint16_t rawLen;        // mark/space timings following the state[]
+} struct_IRframe_hdr;
+
+// Largest serialized frame, and the number of fragments needed to carry it
+#define IRFRAME_MAX_LEN         (sizeof(struct_IRframe_hdr) + kStateSizeMax + 1 + 2 * IRFRAME_MAX_RAW)
+#define IRFRAME_MAX_FRAGMENTS   ((IRFRAME_MAX_LEN + IRFRAGMENT_MAX_DATA - 1) / IRFRAGMENT_MAX_DATA)
+
+// Sent instead of a full frame while a button is held down, to repeat the
+// last frame sent in full. Protocols that use a dedicated repeat code (e.g.
+// NEC) carry its timings in micro-seconds after the header, the others are
+// regenerated from the full frame.
+typedef struct __attribute__((packed)) struct_IRrepeat_hdr
+{
+    uint8_t  msg_type;      // MSG_IR_REPEAT
+    uint8_t  frameId;       // id of the full frame being repeated
+    uint8_t  count;         // number of times to repeat it
+    uint8_t  rawLen;        // repeat code timings following, 0 to repeat the full frame
+    uint32_t captureUs;     // IRrecv's micros() when the capture of the repeat was over
+} struct_IRrepeat_hdr;
+
+// Largest protocol repeat code that is sent along with a repeat
+#define IRREPEAT_MAX_RAW        16
+
+// Sent back by IRsend once it has all fragments of a frame, including for a
+// retransmit of a frame it already had. Repeats aren't acknowledged, the next
+// one follows shortly anyway.
+typedef struct __attribute__((packed)) struct_IRack_hdr
+{
+    uint8_t  msg_type;      // MSG_IR_ACK
+    uint8_t  frameId;       // id of the frame received
+} struct_IRack_hdr;
+
+// Sent instead of the full frame once IRsend has learned it, see codekey.cpp.
+// Acknowledged like a frame, or answered with a MSG_IR_MISS if IRsend doesn't
+// have the code (any more), and IRrecv then sends the frame in full.
+typedef struct __attribute__((packed)) struct_IRcode_hdr
+{
+    uint8_t  msg_type;      // MSG_IR_CODE
+    uint8_t  frameId;       // shared with the full frame if it has to be sent after all
+    uint32_t code;          // irCodeKey() of the frame
+    uint32_t captureUs;     // IRrecv's micros() when the capture was over
+} struct_IRcode_hdr;
+
+// IRsend doesn't have the code of a MSG_IR_CODE
+typedef struct __attribute__((packed)) struct_IRmiss_hdr
+{
+    uint8_t  msg_type;      // MSG_IR_MISS
+    uint8_t  frameId;       // id of the MSG_IR_CODE
+} struct_IRmiss_hdr;
+
+// Raw timings of a long capture, sent while it is still coming in so IRsend
+// can start emitting it before it's over. The complete frame follows under the
+// same frameId once it is decoded, IRsend only emits it if the stream failed.
+typedef struct __attribute__((packed)) struct_IRstream_hdr
+{
+    uint8_t  msg_type;      // MSG_IR_STREAM
+    uint8_t  frameId;       // shared with the frame sent once the capture is over
+    uint16_t offset;        // index in the capture of the first timing following
+    uint8_t  count;         // mark/space timings in usecs following
+    uint8_t  flags;         // IRSTREAM_FLAG_xxx
+} struct_IRstream_hdr;
+
+// struct_IRstream_hdr.flags
+#define IRSTREAM_FLAG_END       0x01    // the capture is over, this is its last chunk
+
+// Most timings a single MSG_IR_STREAM carries
+#define IRSTREAM_MAX_RAW        ((ESPNOW_MAX_PAYLOAD - sizeof(struct_IRstream_hdr)) / 2)
+
+// Sent to a node we had nothing else to send to for a while, so it knows the
+// link is up. Anything else that comes in from a node shows that as well.
+typedef struct __attribute__((packed)) struct_heartbeat_hdr
+{
+    uint8_t  msg_type;      // MSG_HEARTBEAT
+    uint16_t intervalMs;    // the next one follows at the latest this much later
+} struct_heartbeat_hdr;
+
+// Several small messages to the same node in one packet, so they share the
+// per-packet overhead of the radio. The header is followed by records that
+// each are a length byte and the message itself, msg_type first, up to the
+// end of the packet.
+typedef struct __attribute__((packed)) struct_batch_hdr
+{
+    uint8_t  msg_type;      // MSG_BATCH
+} struct_batch_hdr;
+
+// Bytes of a batch record besides its message
+#define BATCH_RECORD_HDR        1
+
+// Clock sync, NTP style: IRsend asks an IRrecv for the time with a
+// MSG_TIME_REQ, the MSG_TIME reply echoes requestUs. Each time is the
+// micros() of the node that took it.
+typedef struct __attribute__((packed)) struct_time_hdr
+{
+    uint8_t  msg_type;      // MSG_TIME_REQ or MSG_TIME
+    uint32_t requestUs;     // IRsend: the request was sent
+    uint32_t receiveUs;     // IRrecv: the request came in, MSG_TIME only
+    uint32_t replyUs;       // IRrecv: the reply was sent, MSG_TIME only
+} struct_time_hdr;
+
+// Stages the relay latency is split into. Each node times its own stages
+// and sends them back in a MSG_STATS reply to a MSG_STATS_REQ.
+typedef enum
+{
+    STAGE_DECODE = 0,       // IRrecv: capture copied out -> decoded
+    STAGE_SEND,             // IRrecv: decoded -> esp_now_send() of the first fragment
+    STAGE_RADIO,            // IRrecv: esp_now_send() -> OnDataSent() of the last fragment
+    STAGE_RECV_LOG,         // IRrecv: serial output for a capture
+    STAGE_QUEUE,            // IRsend: frame received -> IR emission starts
+    STAGE_EMIT,             // IRsend: IR emission start -> end
+    STAGE_SEND_LOG,         // IRsend: serial output for a frame
+    STAGE_TRANSIT,          // IRsend: capture over on IRrecv -> frame received, once the clocks are synced
+    STAGE_COUNT
+} LATENCY_STAGE_E;
+
+// Latencies are counted in buckets of powers of 2: bucket 0 holds everything
+// below 32 usecs, bucket i the latencies of 2^(i+4) up to 2^(i+5) usecs, and
+// the last bucket everything from 2^19 usecs (~0.5s) on.
+#define LATENCY_BUCKETS         16
+
+// Histogram of one stage, as carried by MSG_STATS
+typedef struct __attribute__((packed)) struct_latency_hist
+{
+    uint8_t  stage;         // LATENCY_STAGE_E
+    uint32_t count;         // samples taken
+    uint32_t meanUs;
+    uint32_t maxUs;
+    uint16_t buckets[LATENCY_BUCKETS];  // saturate at 65535
+} struct_latency_hist;
+
+// Heap of a node, to check that relaying frames doesn't allocate
+typedef struct __attribute__((packed)) struct_heap_stats
+{
+    uint32_t freeHeap;      // free heap now
+    uint32_t minFreeHeap;   // lowest free heap seen after a frame
+    uint32_t maxFreeBlock;  // largest block that can be allocated now
+    uint8_t  fragmentation; // heap fragmentation in %
+    uint32_t frames;        // frames relayed
+    uint32_t allocFrames;   // of those, frames whose relay changed the free heap
+} struct_heap_stats;
+
+// Asks an IRsend for its latency histograms
+typedef struct __attribute__((packed)) struct_stats_req_hdr
+{
+    uint8_t  msg_type;      // MSG_STATS_REQ
+} struct_stats_req_hdr;
+
+// MSG_STATS, followed by stageCount histograms
+typedef struct __attribute__((packed)) struct_stats_hdr
+{
+    uint8_t  msg_type;      // MSG_STATS
+    uint8_t  stageCount;
+    struct_heap_stats heap;
+} struct_stats_hdr;
+
+#define STATS_MAX_STAGES        ((ESPNOW_MAX_PAYLOAD - sizeof(struct_stats_hdr)) / sizeof(struct_latency_hist))
+
+// ==================== end of IR frame wire format ====================
+
+#endif  // MESSAGES_H
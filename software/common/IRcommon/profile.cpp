@@ -0,0 +1,18 @@
+/*
+ *  IRcommon:  profile.cpp - The protocols of the profile the firmware was built for.
+*/
+#include <Arduino.h>
+#include <IRutils.h>
+#include "profile.h"
+
+// Name the profile and its protocols, so decode times and image sizes can be
+// told apart between builds
+void profilePrint( void )
+{
+    Serial.printf("Protocol profile: %s", kProfileName);
+
+    for( uint8_t i = 0; i < kProfileCount; i++ )
+        Serial.printf("%s%s", i == 0 ? " (" : ", ", typeToString( kProfileProtocols[i] ).c_str());
+
+    Serial.println( kProfileCount != 0 ? ")" : ", every protocol of the library" );
+}
@@ -0,0 +1,42 @@
+/*
+ *  IRcommon:  profile.h - The protocols of the profile the firmware was built for.
+ *
+ *  A PlatformIO environment with custom_ir_profile set (see
+ *  ../../profiles/profile.py) only builds the library's decoders and
+ *  encoders of the protocols its profile lists, and hands the list over as
+ *  IR_PROFILE_PROTOCOLS, most frequent first. Without a profile the whole
+ *  library is built and every protocol is in it.
+*/
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+
+#ifdef IR_PROFILE_PROTOCOLS
+constexpr char kProfileName[] = IR_PROFILE;
+constexpr decode_type_t kProfileProtocols[] = { IR_PROFILE_PROTOCOLS };
+constexpr uint8_t kProfileCount = sizeof(kProfileProtocols) / sizeof(kProfileProtocols[0]);
+#else  // IR_PROFILE_PROTOCOLS
+constexpr char kProfileName[] = "all";
+constexpr decode_type_t kProfileProtocols[] = { decode_type_t::UNKNOWN };
+constexpr uint8_t kProfileCount = 0;
+#endif  // IR_PROFILE_PROTOCOLS
+
+// Rank of a protocol in the profile, 0 for the most frequent one. A
+// protocol outside of it ranks after all of them, and without a profile
+// they all rank the same.
+constexpr uint8_t profileRank( decode_type_t protocol, uint8_t i = 0 )
+{
+    return ( i >= kProfileCount || kProfileProtocols[i] == protocol ) ? i : profileRank( protocol, i + 1 );
+}
+
+// Can the build decode and send the protocol?
+constexpr bool profileHas( decode_type_t protocol )
+{
+    return kProfileCount == 0 || profileRank( protocol ) < kProfileCount;
+}
+
+void profilePrint( void );
+
+#endif  // PROFILE_H
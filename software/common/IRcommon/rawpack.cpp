@@ -0,0 +1,484 @@
+/*
+ *  IRcommon:  rawpack.cpp - Compact encoding of the raw timings of a frame.
+ *
+ *  Raw timings take 2 bytes each, so a long capture takes many ESP-NOW
+ *  packets. But a protocol only uses a handful of durations, and mostly the
+ *  same few mark/space pairs of them. rawPack() clusters the timings into
+ *  durations, quantized to a base tick of the shortest of them, and names the
+ *  mark/space pairs of those. The timings then become a stream of pair
+ *  symbols of as few bits as there are pairs to tell apart. A pair that comes
+ *  kMinRun times or more in a row is sent once, followed by an escape symbol
+ *  and how many more times it comes. Every timing is sent as the duration it
+ *  is close to, so what rawUnpack() makes of it is the same for every capture
+ *  of a button, ready for sendRaw().
+ *
+ *  Layout of packed timings:
+ *    byte      number of durations, RAWPACK_RUNS if runs are escaped
+ *    byte      number of pairs
+ *    varint    base tick in usecs
+ *    varints   each duration in ticks
+ *    bytes     each pair, mark duration | space duration << 4
+ *    bits      the pair symbols, least significant bit first
+ *  A varint has 7 bits a byte, least significant first, the top bit is set on
+ *  all but its last byte. The count of a run has 3 bits a nibble the same way.
+ *  An odd number of timings ends with a mark, the space of its pair isn't used.
+*/
+#include <Arduino.h>
+#include "rawpack.h"
+
+// A timing within kTolerance % of a duration is sent as that duration. Gaps,
+// longer than kGapUs, only within 1 %, they can be of any length.
+const uint8_t kTolerance = 20;
+const uint16_t kGapUs = 16000;
+
+// The base tick is this fraction of the shortest duration
+const uint8_t kTickDivisor = 8;
+
+// Shortest run of a pair sent with an escape
+const uint8_t kMinRun = 4;
+
+// Longest run that can be unpacked, a frame has fewer pairs
+const uint16_t kMaxRun = 1024;
+
+// First byte of packed timings
+#define RAWPACK_RUNS        0x80
+
+typedef struct struct_cluster
+{
+    uint32_t sum;
+    uint16_t count;
+} struct_cluster;
+
+// Bits it takes to tell this many values apart
+static uint8_t rawPackBits( uint8_t values )
+{
+    uint8_t bits = 1;
+
+    while( ( 1 << bits ) < values )
+        ++ bits;
+
+    return bits;
+}
+
+static uint8_t rawPackVarintLen( uint32_t value )
+{
+    uint8_t len = 1;
+
+    while( value >= 0x80 )
+    {
+        value >>= 7;
+        ++ len;
+    }
+
+    return len;
+}
+
+static uint16_t rawPackVarint( uint8_t *buf, uint32_t value )
+{
+    uint16_t len = 0;
+
+    while( value >= 0x80 )
+    {
+        buf[len++] = ( value & 0x7F ) | 0x80;
+        value >>= 7;
+    }
+
+    buf[len++] = value;
+
+    return len;
+}
+
+static bool rawUnpackVarint( const uint8_t *buf, uint16_t len, uint16_t *pos, uint32_t *value )
+{
+    *value = 0;
+
+    for( uint8_t shift = 0; shift < 32; shift += 7 )
+    {
+        if( *pos >= len )
+            return false;
+
+        uint8_t byte = buf[(*pos)++];
+
+        *value |= (uint32_t)( byte & 0x7F ) << shift;
+
+        if( !( byte & 0x80 ))
+            return true;
+    }
+
+    return false;
+}
+
+// Append bits to the stream in out, or only count them if out is NULL
+static void rawPackPut( uint8_t *out, uint32_t *pos, uint32_t value, uint8_t bits )
+{
+    for( uint8_t i = 0; i < bits; i++, (*pos)++ )
+    {
+        if( out == NULL )
+            continue;
+
+        if( ( *pos & 7 ) == 0 )
+            out[*pos >> 3] = 0;
+
+        if( ( value >> i ) & 1 )
+            out[*pos >> 3] |= 1 << ( *pos & 7 );
+    }
+}
+
+static bool rawUnpackGet( struct_rawunpack *u, uint8_t bits, uint32_t *value )
+{
+    if( u->bitPos + bits > u->streamLen * 8UL )
+        return false;
+
+    *value = 0;
+
+    for( uint8_t i = 0; i < bits; i++, u->bitPos++ )
+    {
+        if( ( u->stream[u->bitPos >> 3] >> ( u->bitPos & 7 )) & 1 )
+            *value |= 1UL << i;
+    }
+
+    return true;
+}
+
+static bool rawPackNear( uint32_t t, const struct_cluster *c )
+{
+    uint32_t mean = c->sum / c->count;
+    uint32_t tolerance = ( mean <= kGapUs ) ? mean * kTolerance / 100 : mean / 100;
+
+    return t + tolerance >= mean && t <= mean + tolerance;
+}
+
+// The duration closest to t
+static uint8_t rawPackNearest( const uint16_t *durations, uint8_t count, uint16_t t )
+{
+    uint8_t best = 0;
+
+    for( uint8_t j = 1; j < count; j++ )
+    {
+        if( abs( (int32_t)durations[j] - t ) < abs( (int32_t)durations[best] - t ))
+            best = j;
+    }
+
+    return best;
+}
+
+// Index of a pair, -1 if it isn't one of them
+static int8_t rawPackIndex( const uint8_t *pairs, uint8_t pairCount, uint8_t pair )
+{
+    for( uint8_t i = 0; i < pairCount; i++ )
+    {
+        if( pairs[i] == pair )
+            return i;
+    }
+
+    return -1;
+}
+
+// The pair of durations of the timings at i and i + 1. The last mark of an
+// odd number of timings takes the space of a pair it already is in.
+static uint8_t rawPackPair( const uint16_t *raw, uint16_t rawLen, uint16_t i, const uint16_t *durations,
+                            uint8_t count, const uint8_t *pairs, uint8_t pairCount )
+{
+    uint8_t mark = rawPackNearest( durations, count, raw[i] );
+
+    if( i + 1 < rawLen )
+        return mark | rawPackNearest( durations, count, raw[i + 1] ) << 4;
+
+    for( uint8_t p = 0; p < pairCount; p++ )
+    {
+        if( ( pairs[p] & 0x0F ) == mark )
+            return pairs[p];
+    }
+
+    return mark;
+}
+
+// A pair that came run more times after it was sent
+static void rawPackRun( uint8_t *out, uint32_t *pos, uint8_t bits, uint8_t escape, uint8_t pair, uint16_t run )
+{
+    if( run < kMinRun )
+    {
+        while( run-- != 0 )
+            rawPackPut( out, pos, pair, bits );
+
+        return;
+    }
+
+    rawPackPut( out, pos, escape, bits );
+    run -= kMinRun;
+
+    while( run >= 8 )
+    {
+        rawPackPut( out, pos, ( run & 7 ) | 8, 4 );
+        run >>= 3;
+    }
+
+    rawPackPut( out, pos, run, 4 );
+}
+
+// Write the stream of pair symbols of the timings to out, or only count its
+// bits if out is NULL. out may be raw itself, it never gets ahead of what was
+// read.
+// Returns the bits of the stream.
+static uint32_t rawPackStream( const uint16_t *raw, uint16_t rawLen, const uint16_t *durations, uint8_t count,
+                               const uint8_t *pairs, uint8_t pairCount, bool runs, uint8_t *out )
+{
+    uint8_t bits = rawPackBits( pairCount + runs );
+    uint32_t pos = 0;
+    int8_t last = -1;
+    uint16_t run = 0;
+
+    for( uint16_t i = 0; i < rawLen; i += 2 )
+    {
+        int8_t index = rawPackIndex( pairs, pairCount, rawPackPair( raw, rawLen, i, durations, count, pairs, pairCount ));
+
+        if( runs && index == last )
+        {
+            ++ run;
+            continue;
+        }
+
+        rawPackRun( out, &pos, bits, pairCount, last, run );
+        rawPackPut( out, &pos, index, bits );
+        last = index;
+        run = 0;
+    }
+
+    rawPackRun( out, &pos, bits, pairCount, last, run );
+
+    return pos;
+}
+
+// Pack rawLen timings in place.
+// Returns the bytes they take now, or 0 if they are left as they are because
+// packing them doesn't make them shorter, or they have more distinct
+// durations or pairs than fit.
+uint16_t rawPack( uint16_t *raw, uint16_t rawLen )
+{
+    struct_cluster clusters[RAWPACK_SYMBOLS];
+    uint16_t durations[RAWPACK_SYMBOLS];
+    uint16_t ticks[RAWPACK_SYMBOLS];
+    uint8_t pairs[RAWPACK_PAIRS];
+    uint8_t count = 0;
+    uint8_t pairCount = 0;
+    uint32_t tick = 0;
+
+    if( rawLen < 2 )
+        return 0;
+
+    // Cluster the timings, each joins the first one it is close to
+    for( uint16_t i = 0; i < rawLen; i++ )
+    {
+        uint8_t j = 0;
+
+        while( j < count && !rawPackNear( raw[i], &clusters[j] ))
+            ++ j;
+
+        if( j == count )
+        {
+            if( count == RAWPACK_SYMBOLS )
+                return 0;
+
+            clusters[count].sum = 0;
+            clusters[count].count = 0;
+            ++ count;
+        }
+
+        clusters[j].sum += raw[i];
+        ++ clusters[j].count;
+    }
+
+    // Their means are the durations, to the base tick
+    for( uint8_t j = 0; j < count; j++ )
+    {
+        uint32_t mean = ( clusters[j].sum + clusters[j].count / 2 ) / clusters[j].count;
+
+        if( mean != 0 && ( tick == 0 || mean < tick ))
+            tick = mean;
+    }
+
+    tick = max( tick / kTickDivisor, (uint32_t)1 );
+
+    for( uint8_t j = 0; j < count; j++ )
+    {
+        uint32_t mean = ( clusters[j].sum + clusters[j].count / 2 ) / clusters[j].count;
+
+        ticks[j] = ( mean + tick / 2 ) / tick;
+        durations[j] = min( ticks[j] * tick, (uint32_t)UINT16_MAX );
+    }
+
+    // The pairs of them
+    for( uint16_t i = 0; i < rawLen; i += 2 )
+    {
+        uint8_t pair = rawPackPair( raw, rawLen, i, durations, count, pairs, pairCount );
+
+        if( rawPackIndex( pairs, pairCount, pair ) < 0 )
+        {
+            if( pairCount == RAWPACK_PAIRS )
+                return 0;
+
+            pairs[pairCount++] = pair;
+        }
+    }
+
+    // Escape runs only if that makes the stream shorter
+    uint32_t plainBits = rawPackStream( raw, rawLen, durations, count, pairs, pairCount, false, NULL );
+    uint32_t runBits = rawPackStream( raw, rawLen, durations, count, pairs, pairCount, true, NULL );
+    bool runs = runBits < plainBits;
+    uint16_t streamLen = (( runs ? runBits : plainBits ) + 7 ) / 8;
+    uint16_t headerLen = 2 + rawPackVarintLen( tick ) + pairCount;
+
+    for( uint8_t j = 0; j < count; j++ )
+        headerLen += rawPackVarintLen( ticks[j] );
+
+    if( headerLen + streamLen >= rawLen * 2 )
+        return 0;
+
+    // The stream first, over the timings already read, then moved behind the
+    // header
+    uint8_t *out = (uint8_t *)raw;
+
+    rawPackStream( raw, rawLen, durations, count, pairs, pairCount, runs, out );
+    memmove( out + headerLen, out, streamLen );
+
+    uint16_t pos = 0;
+
+    out[pos++] = count | ( runs ? RAWPACK_RUNS : 0 );
+    out[pos++] = pairCount;
+    pos += rawPackVarint( out + pos, tick );
+
+    for( uint8_t j = 0; j < count; j++ )
+        pos += rawPackVarint( out + pos, ticks[j] );
+
+    memcpy( out + pos, pairs, pairCount );
+
+    return headerLen + streamLen;
+}
+
+// Start reading the timings packed into len bytes of buf.
+// Returns false if the header is malformed.
+bool rawUnpackInit( struct_rawunpack *u, const uint8_t *buf, uint16_t len )
+{
+    uint16_t pos = 2;
+    uint32_t tick;
+    uint32_t ticks;
+
+    if( len < 2 )
+        return false;
+
+    uint8_t count = buf[0] & ~RAWPACK_RUNS;
+
+    u->runs = buf[0] & RAWPACK_RUNS;
+    u->pairCount = buf[1];
+
+    if( count == 0 || count > RAWPACK_SYMBOLS || u->pairCount == 0 || u->pairCount > RAWPACK_PAIRS ||
+        !rawUnpackVarint( buf, len, &pos, &tick ))
+        return false;
+
+    for( uint8_t j = 0; j < count; j++ )
+    {
+        if( !rawUnpackVarint( buf, len, &pos, &ticks ))
+            return false;
+
+        u->durations[j] = min( (uint64_t)ticks * tick, (uint64_t)UINT16_MAX );
+    }
+
+    if( pos + u->pairCount > len )
+        return false;
+
+    for( uint8_t p = 0; p < u->pairCount; p++ )
+    {
+        u->pairs[p] = buf[pos++];
+
+        if( ( u->pairs[p] & 0x0F ) >= count || ( u->pairs[p] >> 4 ) >= count )
+            return false;
+    }
+
+    u->stream = buf + pos;
+    u->streamLen = len - pos;
+    u->bitPos = 0;
+    u->bits = rawPackBits( u->pairCount + u->runs );
+    u->started = false;
+    u->space = false;
+    u->repeat = 0;
+
+    return true;
+}
+
+// The next timing.
+// Returns false if the stream is over or malformed.
+bool rawUnpackNext( struct_rawunpack *u, uint16_t *timing )
+{
+    uint32_t symbol;
+
+    if( u->space )
+    {
+        u->space = false;
+        *timing = u->durations[u->pairs[u->pair] >> 4];
+        return true;
+    }
+
+    if( u->repeat != 0 )
+        -- u->repeat;
+    else
+    {
+        if( !rawUnpackGet( u, u->bits, &symbol ))
+            return false;
+
+        if( u->runs && symbol == u->pairCount )
+        {   // The last pair comes again
+            uint32_t run = 0;
+            uint32_t nibble;
+
+            for( uint8_t shift = 0; ; shift += 3 )
+            {
+                if( shift > 12 || !rawUnpackGet( u, 4, &nibble ))
+                    return false;
+
+                run |= ( nibble & 7 ) << shift;
+
+                if( !( nibble & 8 ))
+                    break;
+            }
+
+            if( !u->started || run + kMinRun > kMaxRun )
+                return false;
+
+            u->repeat = run + kMinRun - 1;
+        }
+        else if( symbol < u->pairCount )
+            u->pair = symbol;
+        else
+            return false;
+
+        u->started = true;
+    }
+
+    u->space = true;
+    *timing = u->durations[u->pairs[u->pair] & 0x0F];
+
+    return true;
+}
+
+// Unpack exactly rawLen timings from the len bytes of buf into raw, or only
+// check that they are there if raw is NULL.
+// Returns false if buf doesn't hold exactly rawLen timings.
+bool rawUnpack( const uint8_t *buf, uint16_t len, uint16_t *raw, uint16_t rawLen )
+{
+    struct_rawunpack u;
+    uint16_t timing;
+
+    if( !rawUnpackInit( &u, buf, len ))
+        return false;
+
+    for( uint16_t i = 0; i < rawLen; i++ )
+    {
+        if( !rawUnpackNext( &u, &timing ))
+            return false;
+
+        if( raw != NULL )
+            raw[i] = timing;
+    }
+
+    return u.repeat == 0 && ( u.bitPos + 7 ) / 8 == u.streamLen;
+}
@@ -0,0 +1,36 @@
+/*
+ *  IRcommon:  rawpack.h - Compact encoding of the raw timings of a frame.
+*/
+#ifndef RAWPACK_H
+#define RAWPACK_H
+
+#include <Arduino.h>
+
+// Distinct durations, and distinct mark/space pairs of them, a packed frame
+// can use. Any protocol has far fewer.
+#define RAWPACK_SYMBOLS     16
+#define RAWPACK_PAIRS       16
+
+// Reads the timings of a packed frame one by one
+typedef struct struct_rawunpack
+{
+    const uint8_t *stream;      // the packed pairs, after the header
+    uint16_t streamLen;         // bytes
+    uint32_t bitPos;            // next bit of the stream
+    uint16_t durations[RAWPACK_SYMBOLS];
+    uint8_t pairs[RAWPACK_PAIRS];   // mark symbol | space symbol << 4
+    uint8_t pairCount;
+    uint8_t bits;               // bits per pair in the stream
+    bool runs;                  // runs of a pair are counted after an escape
+    bool started;               // a pair was read
+    bool space;                 // the space of the pair is next
+    uint8_t pair;               // pair being read
+    uint16_t repeat;            // times it comes again
+} struct_rawunpack;
+
+uint16_t rawPack( uint16_t *raw, uint16_t rawLen );
+bool rawUnpackInit( struct_rawunpack *u, const uint8_t *buf, uint16_t len );
+bool rawUnpackNext( struct_rawunpack *u, uint16_t *timing );
+bool rawUnpack( const uint8_t *buf, uint16_t len, uint16_t *raw, uint16_t rawLen );
+
+#endif  // RAWPACK_H
@@ -0,0 +1,132 @@
+/*
+ *  IRsim:  Arduino.h - Host stand-in for the parts of the ESP8266 Arduino core the firmware uses.
+*/
+#ifndef IRSIM_ARDUINO_H
+#define IRSIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string>
+#include <algorithm>
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define CHANGE          3
+#define RISING          1
+#define FALLING         2
+#define SERIAL_8N1      0
+
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+
+using std::min;
+using std::max;
+
+class String : public std::string
+{
+public:
+    String() {}
+    String( const char *s ) : std::string( s ) {}
+    String( const std::string &s ) : std::string( s ) {}
+    String( int v ) : std::string( std::to_string( v )) {}
+    String( unsigned int v ) : std::string( std::to_string( v )) {}
+    String( long v ) : std::string( std::to_string( v )) {}
+    String( unsigned long v ) : std::string( std::to_string( v )) {}
+
+    String operator+( const String &o ) const { return String( (const std::string &)*this + (const std::string &)o ); }
+    String operator+( const char *o ) const { return String( (const std::string &)*this + o ); }
+};
+
+inline String operator+( const char *a, const String &b ) { return String( a + (const std::string &)b ); }
+
+// Serial output goes to stdout. The UART is modelled at the configured baud
+// rate, so printing blocks once its FIFO is full just like on the device.
+class HardwareSerial
+{
+public:
+    void begin( uint32_t baud, int config = SERIAL_8N1 );
+    operator bool() const { return true; }
+    int printf( const char *fmt, ... ) __attribute__((format(printf, 2, 3)));
+    size_t write( const uint8_t *buf, size_t size );
+    size_t write( uint8_t c ) { return write( &c, 1 ); }
+    size_t print( const char *s ) { return write( (const uint8_t *)s, strlen( s )); }
+    size_t print( const String &s ) { return write( (const uint8_t *)s.c_str(), s.length() ); }
+    size_t print( char c ) { return write( (uint8_t)c ); }
+    size_t print( long v ) { return printf( "%ld", v ); }
+    size_t print( unsigned long v ) { return printf( "%lu", v ); }
+    size_t print( int v ) { return printf( "%d", v ); }
+    size_t print( unsigned int v ) { return printf( "%u", v ); }
+    size_t println() { return print( "\r\n" ); }
+    template <typename T> size_t println( T v ) { return print( v ) + println(); }
+    int available( void );
+    int read( void );
+    int availableForWrite( void );
+    void flush( void );
+
+private:
+    uint32_t usPerByte = 87;
+    uint64_t txIdleAt = 0;      // time the modelled UART FIFO runs empty
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    uint32_t getCycleCount( void );
+    uint32_t getFreeHeap( void );
+    uint32_t getMaxFreeBlockSize( void );
+    uint8_t getHeapFragmentation( void );
+    uint8_t getCpuFreqMHz( void ) { return 80; }
+    void restart( void ) { exit( 0 ); }
+};
+
+extern EspClass ESP;
+
+uint32_t millis( void );
+uint32_t micros( void );
+void delay( uint32_t ms );
+void delayMicroseconds( uint32_t us );
+void yield( void );
+
+// There is no ISR to keep out
+inline void noInterrupts( void ) {}
+inline void interrupts( void ) {}
+
+void pinMode( uint8_t pin, uint8_t mode );
+void digitalWrite( uint8_t pin, uint8_t val );
+int digitalRead( uint8_t pin );
+uint8_t digitalPinToInterrupt( uint8_t pin );
+void attachInterrupt( uint8_t pin, void (*isr)( void ), int mode );
+void detachInterrupt( uint8_t pin );
+
+// timer1, the hardware timer. Its interrupt is run by irsimPoll() once it is
+// due, and sees the clock as it was then.
+#define TIM_DIV1        0       // 80MHz
+#define TIM_DIV16       1       // 5MHz
+#define TIM_DIV256      3       // 312.5kHz
+#define TIM_EDGE        0
+#define TIM_LEVEL       1
+#define TIM_SINGLE      0
+#define TIM_LOOP        1
+
+typedef void (*timercallback)( void );
+
+void timer1_attachInterrupt( timercallback userFunc );
+void timer1_detachInterrupt( void );
+void timer1_enable( uint8_t divider, uint8_t int_type, uint8_t reload );
+void timer1_disable( void );
+void timer1_write( uint32_t ticks );
+
+// Implemented by the firmware
+void setup( void );
+void loop( void );
+
+#endif  // IRSIM_ARDUINO_H
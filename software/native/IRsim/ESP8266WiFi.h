@@ -0,0 +1,23 @@
+/*
+ *  IRsim:  ESP8266WiFi.h - Host stand-in for the WiFi object of the ESP8266 Arduino core.
+*/
+#ifndef IRSIM_ESP8266WIFI_H
+#define IRSIM_ESP8266WIFI_H
+
+#include <Arduino.h>
+
+#define WIFI_OFF    0
+#define WIFI_STA    1
+
+class WiFiClass
+{
+public:
+    String macAddress( void );
+    void mode( int m ) { (void)m; }
+    void setSleep( bool enable ) { (void)enable; }
+    int32_t RSSI( void );
+};
+
+extern WiFiClass WiFi;
+
+#endif  // IRSIM_ESP8266WIFI_H
@@ -0,0 +1,15 @@
+/*
+ *  IRsim:  IRac.h - Host stand-in for the A/C helpers of IRremoteESP8266.
+*/
+#ifndef IRSIM_IRAC_H
+#define IRSIM_IRAC_H
+
+#include <Arduino.h>
+#include <IRrecv.h>
+
+namespace IRAcUtils
+{
+    String resultAcToString( const decode_results * const results );
+}
+
+#endif  // IRSIM_IRAC_H
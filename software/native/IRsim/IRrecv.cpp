@@ -0,0 +1,260 @@
+/*
+ *  IRsim:  IRrecv.cpp - Host stand-in for the IRrecv class of IRremoteESP8266.
+ *
+ *  The corpus is played back over and over, starting a capture every
+ *  IRSIM_INTERVAL_MS, or 20ms after the previous one ended if it is longer
+ *  than that. Its edges go into _IRrecv::params as they come due, so the
+ *  firmware can watch a capture grow as it would on the device. Each capture
+ *  is reported as a capture event at the time of its last edge, and decode()
+ *  hands it out once the ISR state is stopped: kTimeout later, like the real
+ *  ISR, unless the firmware stopped it sooner. A capture the firmware drops
+ *  with resume() instead is done with all the same.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include "irsim.h"
+
+// The ISR state, the library keeps it in the same place
+namespace _IRrecv
+{
+volatile irparams_t params;
+}
+
+using _IRrecv::params;
+
+static bool enabled = false;
+static uint64_t nextStart = 0;      // time the next played back capture starts
+static uint64_t lastEdge = 0;       // time of the last edge played into params
+static uint32_t captureCount = 0;   // captures played back so far
+static bool logged = false;         // the current capture was logged
+
+static uint64_t interval( void )
+{
+    return strtoull( irsimEnv( "IRSIM_INTERVAL_MS", "150" ), NULL, 10 ) * 1000;
+}
+
+// Time from the start of capture c to the next, a trace keeps the recorded
+// one unless IRSIM_INTERVAL_MS says otherwise
+static uint64_t gap( const irsim_capture &c )
+{
+    if( c.gapUs != 0 && irsimEnv( "IRSIM_INTERVAL_MS", NULL ) == NULL )
+        return c.gapUs;
+
+    return interval();
+}
+
+// Log a played back capture as captured, or as noise, and move on to the next one
+static void logCapture( const irsim_capture &c )
+{
+    uint64_t end = nextStart + irsimRawDuration( c.raw.data(), c.raw.size() );
+
+    irsimEvent( "%s %llu %d %llu", c.noise ? "N" : "C", (unsigned long long)end, c.id, (unsigned long long)nextStart );
+    captureCount++;
+    nextStart = std::max( nextStart + gap( c ), end + 20000 );
+}
+
+// The capture the ISR stopped at is done with, copied out or dropped, which
+// decode() can do both of. The ISR only resumes now and the remote didn't
+// wait, so every frame that started in the meantime is lost.
+static void consume( void )
+{
+    const std::vector<irsim_capture> &corpus = irsimCorpus();
+
+    if( corpus.empty() || params.rawlen == 0 || logged )
+        return;
+
+    logged = true;
+    logCapture( corpus[captureCount % corpus.size()] );
+
+    while( nextStart < irsimNowUs() )
+        logCapture( corpus[captureCount % corpus.size()] );
+}
+
+// Play the edges of the current capture that came due into params, like the
+// ISR would. Gaps inside a capture don't end it, the corpus says where frames
+// end. Once its last edge is kTimeout old the capture is stopped.
+void irsimIrPoll( void )
+{
+    const std::vector<irsim_capture> &corpus = irsimCorpus();
+    uint64_t now = irsimNowUs();
+
+    if( !enabled || corpus.empty() || params.rcvstate == kStopState || now < nextStart )
+        return;
+
+    const irsim_capture &c = corpus[captureCount % corpus.size()];
+
+    if( params.rawlen == 0 )
+    {   // The first edge, rawbuf[0] is the gap before the frame
+        params.rawbuf[0] = interval() / kRawTick;
+        params.rawlen = 1;
+        params.rcvstate = kMarkState;
+        lastEdge = nextStart;
+        logged = false;
+    }
+
+    while( params.rawlen <= c.raw.size() && lastEdge + c.raw[params.rawlen - 1] <= now )
+    {
+        if( params.rawlen >= params.bufsize )
+        {
+            params.overflow = true;
+            params.rcvstate = kStopState;
+            return;
+        }
+
+        lastEdge += c.raw[params.rawlen - 1];
+        params.rawbuf[params.rawlen] = c.raw[params.rawlen - 1] / kRawTick;
+        params.rcvstate = ( params.rawlen & 1 ) ? kSpaceState : kMarkState;
+        params.rawlen++;
+    }
+
+    if( params.rawlen > c.raw.size() && now >= lastEdge + params.timeout * 1000 )
+        params.rcvstate = kStopState;
+}
+
+IRrecv::IRrecv( const uint16_t recvpin, const uint16_t bufsize, const uint8_t timeout,
+                const bool save_buffer, const uint8_t timer_num )
+{
+    (void)timer_num;
+
+    params.recvpin = recvpin;
+    params.bufsize = bufsize;
+    params.timeout = timeout;
+    params.rawbuf = new uint16_t[bufsize];
+    params.rawlen = 0;
+    params.overflow = false;
+    params.rcvstate = kIdleState;
+    params_save = NULL;
+    _tolerance = kTolerance;
+    _unknown_threshold = 6;
+
+    if( save_buffer )
+    {
+        params_save = new irparams_t;
+        params_save->rawbuf = new uint16_t[bufsize];
+    }
+}
+
+IRrecv::~IRrecv( void )
+{
+    delete [] params.rawbuf;
+
+    if( params_save != NULL )
+    {
+        delete [] params_save->rawbuf;
+        delete params_save;
+    }
+}
+
+void IRrecv::setTolerance( const uint8_t percent )
+{
+    _tolerance = percent;
+}
+
+uint8_t IRrecv::getTolerance( void )
+{
+    return _tolerance;
+}
+
+void IRrecv::setUnknownThreshold( const uint16_t length )
+{
+    _unknown_threshold = length;
+}
+
+uint16_t IRrecv::getBufSize( void )
+{
+    return params.bufsize;
+}
+
+void IRrecv::enableIRIn( const bool pullup )
+{
+    (void)pullup;
+
+    enabled = true;
+    nextStart = irsimNowUs() + 500000;      // give IRsend time to come up
+    resume();
+}
+
+void IRrecv::disableIRIn( void )
+{
+    enabled = false;
+}
+
+void IRrecv::pause( void )
+{
+    params.rcvstate = kStopState;
+}
+
+void IRrecv::resume( void )
+{
+    if( params.rcvstate == kStopState )
+        consume();
+
+    params.rcvstate = kIdleState;
+    params.rawlen = 0;
+    params.overflow = false;
+}
+
+bool IRrecv::decode( decode_results *results, irparams_t *save, uint8_t max_skip, uint16_t noise_floor )
+{
+    const std::vector<irsim_capture> &corpus = irsimCorpus();
+
+    (void)max_skip;
+    (void)noise_floor;
+
+    irsimIrPoll();
+
+    if( !enabled || corpus.empty() || params.rcvstate != kStopState )
+        return false;
+
+    const irsim_capture &c = corpus[captureCount % corpus.size()];
+    bool complete = params.rawlen > c.raw.size() || params.overflow;
+
+    consume();
+
+    if( save == NULL )
+        save = params_save;
+
+    // Copy the capture out and capture again, or decode it where it is
+    irparams_t *p = ( save != NULL ) ? save : (irparams_t *)&params;
+
+    if( save != NULL )
+    {
+        p->bufsize = params.bufsize;
+        p->rawlen = params.rawlen;
+        p->overflow = params.overflow;
+        memcpy( p->rawbuf, params.rawbuf, params.rawlen * sizeof(uint16_t) );
+        resume();
+    }
+
+    memset( results, 0, sizeof(decode_results) );
+    results->rawbuf = p->rawbuf;
+    results->rawlen = p->rawlen;
+    results->overflow = p->overflow;
+
+    // Stopped before its last edge, what is left doesn't decode
+    if( !complete )
+        return results->rawlen >= _unknown_threshold;
+
+    // Without its decoder a frame is only hashed, like noise
+    if( c.protocol == UNKNOWN || !irsimDecodes( c.protocol ))
+    {
+        if( !irsimDecodes( UNKNOWN ) || c.raw.size() < _unknown_threshold )
+            return false;
+
+        results->decode_type = UNKNOWN;
+        results->bits = 32;
+        results->value = c.hash;
+        return true;
+    }
+
+    results->decode_type = c.protocol;
+    results->bits = c.bits;
+    results->repeat = c.repeat;
+
+    if( c.stateLen != 0 )
+        memcpy( results->state, c.state, c.stateLen );
+    else
+        results->value = c.repeat ? kRepeat : c.value;
+
+    return true;
+}
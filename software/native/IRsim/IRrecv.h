@@ -0,0 +1,91 @@
+/*
+ *  IRsim:  IRrecv.h - Host stand-in for the IRrecv class of IRremoteESP8266.
+ *
+ *  Instead of an ISR, the captures listed in the file named by IRSIM_CAPTURES
+ *  (see irsim.h) are played back into _IRrecv::params as their edges come due.
+ *  A capture is stopped kTimeout after its last edge, just like on the device,
+ *  and decode() hands it out once it is.
+*/
+#ifndef IRSIM_IRRECV_H
+#define IRSIM_IRRECV_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+
+const uint16_t kRawTick = 2;            // usecs per rawbuf tick
+const uint16_t kMarkExcess = 50;        // usecs a demodulated mark comes out longer
+const uint16_t kRawBuf = 100;
+const uint16_t kStartOffset = 1;
+const uint8_t kTimeoutMs = 15;
+const uint8_t kMaxTimeoutMs = 130;
+const uint8_t kTolerance = 25;
+const uint8_t kUseDefTol = 255;
+const uint8_t kIdleState = 2;
+const uint8_t kMarkState = 3;
+const uint8_t kSpaceState = 4;
+const uint8_t kStopState = 5;
+
+typedef struct
+{
+    uint8_t recvpin;
+    uint8_t rcvstate;
+    uint16_t timer;
+    uint16_t bufsize;
+    uint16_t *rawbuf;
+    uint16_t rawlen;
+    uint8_t overflow;
+    uint8_t timeout;
+} irparams_t;
+
+class decode_results
+{
+public:
+    decode_type_t decode_type;
+    union
+    {
+        struct
+        {
+            uint64_t value;
+            uint32_t address;
+            uint32_t command;
+        };
+        uint8_t state[kStateSizeMax];
+    };
+    uint16_t bits;
+    volatile uint16_t *rawbuf;
+    uint16_t rawlen;
+    bool overflow;
+    bool repeat;
+};
+
+class IRrecv
+{
+public:
+    explicit IRrecv( const uint16_t recvpin, const uint16_t bufsize = kRawBuf,
+                     const uint8_t timeout = kTimeoutMs, const bool save_buffer = false,
+                     const uint8_t timer_num = 0 );
+    ~IRrecv( void );
+    void setTolerance( const uint8_t percent = kTolerance );
+    uint8_t getTolerance( void );
+    bool decode( decode_results *results, irparams_t *save = NULL, uint8_t max_skip = 0,
+                 uint16_t noise_floor = 0 );
+    void enableIRIn( const bool pullup = false );
+    void disableIRIn( void );
+    void pause( void );
+    void resume( void );
+    uint16_t getBufSize( void );
+    void setUnknownThreshold( const uint16_t length );
+
+private:
+    irparams_t *params_save;
+    uint8_t _tolerance;
+    uint16_t _unknown_threshold;
+};
+
+// The ISR state, the library keeps it in the same place
+namespace _IRrecv
+{
+extern volatile irparams_t params;
+}
+
+#endif  // IRSIM_IRRECV_H
@@ -0,0 +1,195 @@
+/*
+ *  IRsim:  IRremoteESP8266.h - Host stand-in for the IRremoteESP8266 library definitions.
+ *
+ *  Only what the firmware uses is modelled. The protocol list is a subset of
+ *  the library's, anything not listed here can't be simulated.
+*/
+#ifndef IRSIM_IRREMOTEESP8266_H
+#define IRSIM_IRREMOTEESP8266_H
+
+#include <stdint.h>
+
+#define _IRREMOTEESP8266_VERSION_STR    "2.8.6-irsim"
+
+#ifndef _IR_ENABLE_DEFAULT_
+#define _IR_ENABLE_DEFAULT_ true
+#endif  // _IR_ENABLE_DEFAULT_
+
+#ifndef SEND_RAW
+#define SEND_RAW    _IR_ENABLE_DEFAULT_
+#endif  // SEND_RAW
+#ifndef DECODE_HASH
+#define DECODE_HASH _IR_ENABLE_DEFAULT_
+#endif  // DECODE_HASH
+
+// Like the library, a build can leave out the decoder and encoder of each
+// protocol. RC5X goes with RC5 and SANYO_LC7461 with SANYO.
+#ifndef DECODE_RC5
+#define DECODE_RC5 _IR_ENABLE_DEFAULT_
+#endif  // DECODE_RC5
+#ifndef DECODE_RC6
+#define DECODE_RC6 _IR_ENABLE_DEFAULT_
+#endif  // DECODE_RC6
+#ifndef DECODE_NEC
+#define DECODE_NEC _IR_ENABLE_DEFAULT_
+#endif  // DECODE_NEC
+#ifndef DECODE_SONY
+#define DECODE_SONY _IR_ENABLE_DEFAULT_
+#endif  // DECODE_SONY
+#ifndef DECODE_PANASONIC
+#define DECODE_PANASONIC _IR_ENABLE_DEFAULT_
+#endif  // DECODE_PANASONIC
+#ifndef DECODE_JVC
+#define DECODE_JVC _IR_ENABLE_DEFAULT_
+#endif  // DECODE_JVC
+#ifndef DECODE_SAMSUNG
+#define DECODE_SAMSUNG _IR_ENABLE_DEFAULT_
+#endif  // DECODE_SAMSUNG
+#ifndef DECODE_WHYNTER
+#define DECODE_WHYNTER _IR_ENABLE_DEFAULT_
+#endif  // DECODE_WHYNTER
+#ifndef DECODE_AIWA_RC_T501
+#define DECODE_AIWA_RC_T501 _IR_ENABLE_DEFAULT_
+#endif  // DECODE_AIWA_RC_T501
+#ifndef DECODE_LG
+#define DECODE_LG _IR_ENABLE_DEFAULT_
+#endif  // DECODE_LG
+#ifndef DECODE_SANYO
+#define DECODE_SANYO _IR_ENABLE_DEFAULT_
+#endif  // DECODE_SANYO
+#ifndef DECODE_MITSUBISHI
+#define DECODE_MITSUBISHI _IR_ENABLE_DEFAULT_
+#endif  // DECODE_MITSUBISHI
+#ifndef DECODE_DISH
+#define DECODE_DISH _IR_ENABLE_DEFAULT_
+#endif  // DECODE_DISH
+#ifndef DECODE_SHARP
+#define DECODE_SHARP _IR_ENABLE_DEFAULT_
+#endif  // DECODE_SHARP
+#ifndef DECODE_COOLIX
+#define DECODE_COOLIX _IR_ENABLE_DEFAULT_
+#endif  // DECODE_COOLIX
+#ifndef DECODE_DAIKIN
+#define DECODE_DAIKIN _IR_ENABLE_DEFAULT_
+#endif  // DECODE_DAIKIN
+#ifndef DECODE_DENON
+#define DECODE_DENON _IR_ENABLE_DEFAULT_
+#endif  // DECODE_DENON
+#ifndef DECODE_KELVINATOR
+#define DECODE_KELVINATOR _IR_ENABLE_DEFAULT_
+#endif  // DECODE_KELVINATOR
+#ifndef DECODE_SHERWOOD
+#define DECODE_SHERWOOD _IR_ENABLE_DEFAULT_
+#endif  // DECODE_SHERWOOD
+#ifndef DECODE_MITSUBISHI_AC
+#define DECODE_MITSUBISHI_AC _IR_ENABLE_DEFAULT_
+#endif  // DECODE_MITSUBISHI_AC
+#ifndef DECODE_RCMM
+#define DECODE_RCMM _IR_ENABLE_DEFAULT_
+#endif  // DECODE_RCMM
+#ifndef DECODE_GREE
+#define DECODE_GREE _IR_ENABLE_DEFAULT_
+#endif  // DECODE_GREE
+#ifndef SEND_RC5
+#define SEND_RC5 _IR_ENABLE_DEFAULT_
+#endif  // SEND_RC5
+#ifndef SEND_RC6
+#define SEND_RC6 _IR_ENABLE_DEFAULT_
+#endif  // SEND_RC6
+#ifndef SEND_NEC
+#define SEND_NEC _IR_ENABLE_DEFAULT_
+#endif  // SEND_NEC
+#ifndef SEND_SONY
+#define SEND_SONY _IR_ENABLE_DEFAULT_
+#endif  // SEND_SONY
+#ifndef SEND_PANASONIC
+#define SEND_PANASONIC _IR_ENABLE_DEFAULT_
+#endif  // SEND_PANASONIC
+#ifndef SEND_JVC
+#define SEND_JVC _IR_ENABLE_DEFAULT_
+#endif  // SEND_JVC
+#ifndef SEND_SAMSUNG
+#define SEND_SAMSUNG _IR_ENABLE_DEFAULT_
+#endif  // SEND_SAMSUNG
+#ifndef SEND_WHYNTER
+#define SEND_WHYNTER _IR_ENABLE_DEFAULT_
+#endif  // SEND_WHYNTER
+#ifndef SEND_AIWA_RC_T501
+#define SEND_AIWA_RC_T501 _IR_ENABLE_DEFAULT_
+#endif  // SEND_AIWA_RC_T501
+#ifndef SEND_LG
+#define SEND_LG _IR_ENABLE_DEFAULT_
+#endif  // SEND_LG
+#ifndef SEND_SANYO
+#define SEND_SANYO _IR_ENABLE_DEFAULT_
+#endif  // SEND_SANYO
+#ifndef SEND_MITSUBISHI
+#define SEND_MITSUBISHI _IR_ENABLE_DEFAULT_
+#endif  // SEND_MITSUBISHI
+#ifndef SEND_DISH
+#define SEND_DISH _IR_ENABLE_DEFAULT_
+#endif  // SEND_DISH
+#ifndef SEND_SHARP
+#define SEND_SHARP _IR_ENABLE_DEFAULT_
+#endif  // SEND_SHARP
+#ifndef SEND_COOLIX
+#define SEND_COOLIX _IR_ENABLE_DEFAULT_
+#endif  // SEND_COOLIX
+#ifndef SEND_DAIKIN
+#define SEND_DAIKIN _IR_ENABLE_DEFAULT_
+#endif  // SEND_DAIKIN
+#ifndef SEND_DENON
+#define SEND_DENON _IR_ENABLE_DEFAULT_
+#endif  // SEND_DENON
+#ifndef SEND_KELVINATOR
+#define SEND_KELVINATOR _IR_ENABLE_DEFAULT_
+#endif  // SEND_KELVINATOR
+#ifndef SEND_SHERWOOD
+#define SEND_SHERWOOD _IR_ENABLE_DEFAULT_
+#endif  // SEND_SHERWOOD
+#ifndef SEND_MITSUBISHI_AC
+#define SEND_MITSUBISHI_AC _IR_ENABLE_DEFAULT_
+#endif  // SEND_MITSUBISHI_AC
+#ifndef SEND_RCMM
+#define SEND_RCMM _IR_ENABLE_DEFAULT_
+#endif  // SEND_RCMM
+#ifndef SEND_GREE
+#define SEND_GREE _IR_ENABLE_DEFAULT_
+#endif  // SEND_GREE
+
+enum decode_type_t
+{
+    UNKNOWN = -1,
+    UNUSED = 0,
+    RC5,
+    RC6,
+    NEC,
+    SONY,
+    PANASONIC,
+    JVC,
+    SAMSUNG,
+    WHYNTER,
+    AIWA_RC_T501,
+    LG,
+    SANYO,
+    MITSUBISHI,
+    DISH,
+    SHARP,
+    COOLIX,
+    DAIKIN,
+    DENON,
+    KELVINATOR,
+    SHERWOOD,
+    MITSUBISHI_AC,
+    RCMM,
+    SANYO_LC7461,
+    RC5X,
+    GREE,
+    kLastDecodeType = GREE
+};
+
+const uint16_t kNoRepeat = 0;
+const uint16_t kStateSizeMax = 53;
+const uint64_t kRepeat = UINT64_MAX;
+
+#endif  // IRSIM_IRREMOTEESP8266_H
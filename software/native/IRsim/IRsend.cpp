@@ -0,0 +1,324 @@
+/*
+ *  IRsim:  IRsend.cpp - Host stand-in for the IRsend class of IRremoteESP8266.
+ *
+ *  Emissions take as long as they would on the air and are matched against
+ *  the corpus, so the benchmark can tell which capture they relay. Frames
+ *  sent with sendRaw() in several pieces are put back together first.
+ *
+ *  A firmware that modulates the LED itself from the timer1 interrupt has
+ *  the LED watched instead, while timer1 runs: its marks are told from the
+ *  carrier by the gaps between them.
+*/
+#include <Arduino.h>
+#include <IRsend.h>
+#include <IRutils.h>
+#include "irsim.h"
+
+// Timings of the protocols the simulation knows how to time, in usecs
+static const struct
+{
+    decode_type_t protocol;
+    uint16_t hdrMark, hdrSpace, bitMark, oneSpace, zeroSpace;
+    uint32_t mesgTime;      // minimum time from the start of one frame to the next
+    uint16_t minRepeats;
+    uint16_t defaultBits;
+} timings[] =
+{
+    { NEC, 9000, 4500, 560, 1690, 560, 108000, 0, 32 },
+    { SAMSUNG, 4480, 4480, 560, 1680, 560, 108000, 0, 32 },
+    { LG, 8500, 4250, 550, 1600, 550, 108000, 0, 28 },
+    { SONY, 2400, 600, 1200, 600, 600, 45000, 2, 12 },    // pulse width, the mark carries the bit
+    { RC5, 0, 0, 889, 889, 889, 114000, 0, 13 },
+    { RC6, 2666, 889, 444, 444, 444, 83000, 0, 20 },
+    { DAIKIN, 3650, 1623, 428, 1280, 428, 0, 0, 280 },
+    { KELVINATOR, 9010, 4505, 680, 1530, 510, 0, 0, 128 },
+    { MITSUBISHI_AC, 3400, 1750, 450, 1300, 420, 0, 0, 144 },
+    { GREE, 9000, 4500, 620, 1600, 540, 0, 0, 64 },
+};
+
+static uint32_t frameDuration( const decode_type_t protocol, const uint8_t *data, uint16_t nbits )
+{
+    for( auto &t : timings )
+    {
+        if( t.protocol != protocol )
+            continue;
+
+        uint32_t duration = t.hdrMark + t.hdrSpace + t.bitMark;
+
+        for( uint16_t i = 0; i < nbits; i++ )
+        {
+            bool one = ( data[i / 8] >> ( i % 8 )) & 1;
+
+            duration += t.bitMark + ( one ? t.oneSpace : t.zeroSpace );
+        }
+
+        return std::max( duration, t.mesgTime );
+    }
+
+    // Anything else, roughly a millisecond per bit
+    return 10000 + nbits * 1000;
+}
+
+// The emission sendRaw() calls are building up: its timings, the number of
+// them its first call sent, when it started and when its last call returned
+static std::vector<uint16_t> raw;
+static uint16_t firstLen = 0;
+static uint64_t rawStart = 0;
+static uint64_t rawEnd = 0;
+static bool afterRaw = false;       // only a space() came since the last sendRaw()
+static uint32_t rawGap = 0;         // how long the LED was off since, timed as
+                                    // the chip would, without the host's sleep overshoot
+
+// An emission that takes no more calls is over after this long
+const uint64_t kRawIdleUs = 200000;
+
+// Pieces of one frame are never further apart than this, the longest space
+// in the corpus is about 30 ms
+const uint64_t kPieceGapUs = 35000;
+
+static void emit( int id, uint64_t start, uint32_t duration )
+{
+    irsimEvent( "E %llu %d %u", (unsigned long long)start, id, duration );
+}
+
+// Report the emission of the sendRaw() calls so far
+static void rawFlush( void )
+{
+    if( raw.empty() )
+        return;
+
+    emit( irsimCorpusFindRaw( raw.data(), raw.size() ), rawStart, rawEnd - rawStart );
+    raw.clear();
+    afterRaw = false;
+}
+
+void irsimEmitPoll( void )
+{
+    if( !raw.empty() && irsimNowUs() > rawEnd + kRawIdleUs )
+        rawFlush();
+}
+
+// What the IR LED did while timer1 ran: the marks and spaces so far, when
+// they and the current mark started and when it was last switched off
+static uint8_t ledPin = UINT8_MAX;
+static bool watching = false;
+static std::vector<uint16_t> led;
+static uint64_t ledStart;
+static uint64_t markStart;
+static bool lit = false;            // it was switched on at all
+static uint64_t lastOff;
+static bool ledOn = false;
+
+// Off for longer than this ends a mark, the carrier's periods are shorter
+const uint64_t kCarrierGapUs = 100;
+
+void irsimLedWrite( uint8_t pin, uint8_t val )
+{
+    uint64_t now = irsimCpuUs();
+
+    if( !watching || pin != ledPin || ( val == HIGH ) == ledOn )
+        return;
+
+    ledOn = val == HIGH;
+
+    if( !ledOn )
+        lastOff = now;
+    else if( !lit )
+    {
+        ledStart = markStart = now;
+        lit = true;
+    }
+    else if( now - lastOff > kCarrierGapUs )
+    {
+        led.push_back( lastOff - markStart );
+        led.push_back( now - lastOff );
+        markStart = now;
+    }
+}
+
+// Report what the LED emitted. A frame played again after a space is its
+// repeat, one emission as with send(). Repeat codes are presses of their own
+// though, each of them relays a capture.
+static void ledReport( void )
+{
+    size_t len = led.size();
+
+    for( size_t copies = 1; copies <= ( len + 1 ) / 2; copies++ )
+    {
+        size_t n = ( len + 1 ) / copies - 1;
+
+        if( ( len + 1 ) % copies != 0 || ( n & 1 ) == 0 )
+            continue;
+
+        int id = irsimCorpusFindRaw( led.data(), n );
+
+        for( size_t k = 1; id >= 0 && k < copies; k++ )
+        {
+            if( irsimCorpusFindRaw( &led[k * ( n + 1 )], n ) != id )
+                id = -1;
+        }
+
+        if( id < 0 )
+            continue;
+
+        if( !irsimCorpus()[id].repeat )
+        {
+            emit( id, ledStart, lastOff - ledStart );
+            return;
+        }
+
+        uint64_t start = ledStart;
+
+        for( size_t k = 0; k < copies; k++ )
+        {
+            uint32_t duration = irsimRawDuration( &led[k * ( n + 1 )], n );
+
+            emit( id, start, duration );
+
+            if( k + 1 < copies )
+                start += duration + led[k * ( n + 1 ) + n];
+        }
+
+        return;
+    }
+
+    emit( -1, ledStart, lastOff - ledStart );
+}
+
+void irsimLedTimer( bool running )
+{
+    if( running )
+    {   // Whatever sendRaw() emitted is over
+        rawFlush();
+        led.clear();
+        lit = false;
+        ledOn = false;
+    }
+    else if( watching && lit )
+    {
+        led.push_back( lastOff - markStart );
+        ledReport();
+    }
+
+    watching = running;
+}
+
+IRsend::IRsend( uint16_t IRsendPin, bool inverted, bool use_modulation )
+{
+    ledPin = IRsendPin;
+    (void)inverted;
+    (void)use_modulation;
+    freq = 38000;
+}
+
+void IRsend::begin( void )
+{
+}
+
+void IRsend::enableIROut( uint32_t freq, uint8_t duty )
+{
+    (void)duty;
+    this->freq = freq;
+}
+
+uint16_t IRsend::mark( uint16_t usec )
+{
+    rawFlush();
+    delayMicroseconds( usec );
+    return usec * freq / 1000000;
+}
+
+void IRsend::space( uint32_t usec )
+{
+    if( !raw.empty() )
+    {
+        rawGap = irsimNowUs() - rawEnd + usec;
+        afterRaw = true;
+    }
+
+    delayMicroseconds( usec );
+}
+
+// A sendRaw() after nothing but a space() goes on with the same emission: the
+// same frame again is a repeat, as with send(), anything else soon enough is
+// the rest of the frame. Otherwise it starts a new emission.
+void IRsend::sendRaw( const uint16_t buf[], const uint16_t len, const uint16_t hz )
+{
+    uint64_t now = irsimNowUs();
+    uint32_t duration = irsimRawDuration( buf, len );
+
+    bool repeat = afterRaw && raw.size() == firstLen && len == firstLen && std::equal( buf, buf + len, raw.begin() );
+    bool piece = afterRaw && ( raw.size() & 1 ) && rawGap <= kPieceGapUs;
+
+    if( !repeat && !piece )
+        rawFlush();
+
+    enableIROut( hz );
+
+    if( raw.empty() )
+    {
+        raw.assign( buf, buf + len );
+        firstLen = len;
+        rawStart = now;
+    }
+    else if( !repeat )
+    {
+        raw.push_back( rawGap );
+        raw.insert( raw.end(), buf, buf + len );
+    }
+
+    afterRaw = false;
+    irsimSleepUntil( now + duration );
+    rawEnd = irsimNowUs();
+}
+
+bool IRsend::send( const decode_type_t type, const uint64_t data, const uint16_t nbits, const uint16_t repeat )
+{
+    if( type == UNKNOWN || hasACState( type ) || !irsimSends( type ))
+        return false;
+
+    uint16_t frames = 1 + std::max( repeat, minRepeats( type ));
+    uint32_t duration = frames * frameDuration( type, (const uint8_t *)&data, nbits );
+
+    rawFlush();
+    emit( irsimCorpusFind( type, data, NULL, 0 ), irsimNowUs(), duration );
+    irsimSleepUntil( irsimNowUs() + duration );
+
+    return true;
+}
+
+bool IRsend::send( const decode_type_t type, const uint8_t *state, const uint16_t nbytes )
+{
+    if( !hasACState( type ) || !irsimSends( type ))
+        return false;
+
+    uint32_t duration = frameDuration( type, state, nbytes * 8 );
+
+    rawFlush();
+    emit( irsimCorpusFind( type, 0, state, nbytes ), irsimNowUs(), duration );
+    irsimSleepUntil( irsimNowUs() + duration );
+
+    return true;
+}
+
+uint16_t IRsend::minRepeats( const decode_type_t protocol )
+{
+    for( auto &t : timings )
+    {
+        if( t.protocol == protocol )
+            return t.minRepeats;
+    }
+
+    return 0;
+}
+
+uint16_t IRsend::defaultBits( const decode_type_t protocol )
+{
+    for( auto &t : timings )
+    {
+        if( t.protocol == protocol )
+            return t.defaultBits;
+    }
+
+    return 0;
+}
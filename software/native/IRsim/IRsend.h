@@ -0,0 +1,39 @@
+/*
+ *  IRsim:  IRsend.h - Host stand-in for the IRsend class of IRremoteESP8266.
+ *
+ *  Nothing is modulated. Every emission is timed like the real one, blocking
+ *  for as long as the frame would be on the air, and is reported to the
+ *  benchmark through the IRSIM_EVENTS log (see irsim.h). sendRaw() calls
+ *  with nothing but a space() in between are one emission: a frame played
+ *  again is its repeat, as it would be with send(), anything else is the rest
+ *  of the frame played in pieces.
+*/
+#ifndef IRSIM_IRSEND_H
+#define IRSIM_IRSEND_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+
+const uint8_t kDutyDefault = 50;
+const uint8_t kDutyMax = 100;
+
+class IRsend
+{
+public:
+    explicit IRsend( uint16_t IRsendPin, bool inverted = false, bool use_modulation = true );
+    void begin( void );
+    void enableIROut( uint32_t freq, uint8_t duty = kDutyDefault );
+    uint16_t mark( uint16_t usec );
+    void space( uint32_t usec );
+    void sendRaw( const uint16_t buf[], const uint16_t len, const uint16_t hz );
+    bool send( const decode_type_t type, const uint64_t data, const uint16_t nbits,
+               const uint16_t repeat = kNoRepeat );
+    bool send( const decode_type_t type, const uint8_t *state, const uint16_t nbytes );
+    static uint16_t minRepeats( const decode_type_t protocol );
+    static uint16_t defaultBits( const decode_type_t protocol );
+
+private:
+    uint32_t freq;
+};
+
+#endif  // IRSIM_IRSEND_H
@@ -0,0 +1,14 @@
+/*
+ *  IRsim:  IRtext.h - Host stand-in for the IRremoteESP8266 text constants.
+*/
+#ifndef IRSIM_IRTEXT_H
+#define IRSIM_IRTEXT_H
+
+#define D_STR_TIMESTAMP             "Timestamp"
+#define D_STR_LIBRARY               "Library"
+#define D_STR_TOLERANCE             "Tolerance"
+#define D_STR_MESGDESC              "Mesg Desc."
+#define D_WARN_BUFFERFULL           "WARNING: IR code is too big for buffer (>= %d). This result shouldn't be trusted until this is resolved. Edit & increase `kCaptureBufferSize`."
+#define D_STR_IRRECVDUMP_STARTUP    "IRrecvDump is now running and waiting for IR input on Pin %d"
+
+#endif  // IRSIM_IRTEXT_H
@@ -0,0 +1,139 @@
+/*
+ *  IRsim:  IRutils.cpp - Host stand-in for the IRremoteESP8266 helper functions.
+*/
+#include <Arduino.h>
+#include <IRrecv.h>
+#include <IRutils.h>
+#include <IRac.h>
+#include "irsim.h"
+
+static const struct
+{
+    decode_type_t protocol;
+    const char *name;
+    bool acState;
+    bool decode;        // DECODE_xxx of the build
+    bool send;          // SEND_xxx of the build
+} protocols[] =
+{
+    { UNKNOWN, "UNKNOWN", false, DECODE_HASH, SEND_RAW },
+    { UNUSED, "UNUSED", false, false, false },
+    { RC5, "RC5", false, DECODE_RC5, SEND_RC5 },
+    { RC6, "RC6", false, DECODE_RC6, SEND_RC6 },
+    { NEC, "NEC", false, DECODE_NEC, SEND_NEC },
+    { SONY, "SONY", false, DECODE_SONY, SEND_SONY },
+    { PANASONIC, "PANASONIC", false, DECODE_PANASONIC, SEND_PANASONIC },
+    { JVC, "JVC", false, DECODE_JVC, SEND_JVC },
+    { SAMSUNG, "SAMSUNG", false, DECODE_SAMSUNG, SEND_SAMSUNG },
+    { WHYNTER, "WHYNTER", false, DECODE_WHYNTER, SEND_WHYNTER },
+    { AIWA_RC_T501, "AIWA_RC_T501", false, DECODE_AIWA_RC_T501, SEND_AIWA_RC_T501 },
+    { LG, "LG", false, DECODE_LG, SEND_LG },
+    { SANYO, "SANYO", false, DECODE_SANYO, SEND_SANYO },
+    { MITSUBISHI, "MITSUBISHI", false, DECODE_MITSUBISHI, SEND_MITSUBISHI },
+    { DISH, "DISH", false, DECODE_DISH, SEND_DISH },
+    { SHARP, "SHARP", false, DECODE_SHARP, SEND_SHARP },
+    { COOLIX, "COOLIX", false, DECODE_COOLIX, SEND_COOLIX },
+    { DAIKIN, "DAIKIN", true, DECODE_DAIKIN, SEND_DAIKIN },
+    { DENON, "DENON", false, DECODE_DENON, SEND_DENON },
+    { KELVINATOR, "KELVINATOR", true, DECODE_KELVINATOR, SEND_KELVINATOR },
+    { SHERWOOD, "SHERWOOD", false, DECODE_SHERWOOD, SEND_SHERWOOD },
+    { MITSUBISHI_AC, "MITSUBISHI_AC", true, DECODE_MITSUBISHI_AC, SEND_MITSUBISHI_AC },
+    { RCMM, "RCMM", false, DECODE_RCMM, SEND_RCMM },
+    { SANYO_LC7461, "SANYO_LC7461", false, DECODE_SANYO, SEND_SANYO },
+    { RC5X, "RC5X", false, DECODE_RC5, SEND_RC5 },
+    { GREE, "GREE", true, DECODE_GREE, SEND_GREE },
+};
+
+String typeToString( const decode_type_t protocol, const bool isRepeat )
+{
+    for( auto &p : protocols )
+    {
+        if( p.protocol == protocol )
+            return isRepeat ? String( p.name ) + " (Repeat)" : String( p.name );
+    }
+
+    return String( "UNKNOWN" );
+}
+
+decode_type_t strToDecodeType( const char *str )
+{
+    for( auto &p : protocols )
+    {
+        if( strcmp( p.name, str ) == 0 )
+            return p.protocol;
+    }
+
+    return UNKNOWN;
+}
+
+bool hasACState( const decode_type_t protocol )
+{
+    for( auto &p : protocols )
+    {
+        if( p.protocol == protocol )
+            return p.acState;
+    }
+
+    return false;
+}
+
+// Did the build enable the decoder of the protocol?
+bool irsimDecodes( const decode_type_t protocol )
+{
+    for( auto &p : protocols )
+    {
+        if( p.protocol == protocol )
+            return p.decode;
+    }
+
+    return false;
+}
+
+// Did the build enable the encoder of the protocol?
+bool irsimSends( const decode_type_t protocol )
+{
+    for( auto &p : protocols )
+    {
+        if( p.protocol == protocol )
+            return p.send;
+    }
+
+    return false;
+}
+
+String resultToHumanReadableBasic( const decode_results * const results )
+{
+    char buf[96];
+
+    snprintf( buf, sizeof(buf), "Protocol  : %s\nCode      : 0x%llX (%u Bits)\n",
+              typeToString( results->decode_type, results->repeat ).c_str(),
+              (unsigned long long)results->value, results->bits );
+
+    return String( buf );
+}
+
+uint16_t getCorrectedRawLength( const decode_results * const results )
+{
+    uint16_t extended = 0;
+
+    for( uint16_t i = 1; i < results->rawlen; i++ )
+    {
+        if( results->rawbuf[i] * kRawTick > UINT16_MAX )
+            extended += ( results->rawbuf[i] * kRawTick ) / UINT16_MAX;
+    }
+
+    return results->rawlen - 1 + extended * 2;
+}
+
+int8_t irutils::lowLevelSanityCheck( void )
+{
+    return 0;
+}
+
+String IRAcUtils::resultAcToString( const decode_results * const results )
+{
+    if( !hasACState( results->decode_type ))
+        return String( "" );
+
+    return String( "(A/C state is not described by the simulation)" );
+}
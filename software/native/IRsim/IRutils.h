@@ -0,0 +1,21 @@
+/*
+ *  IRsim:  IRutils.h - Host stand-in for the IRremoteESP8266 helper functions.
+*/
+#ifndef IRSIM_IRUTILS_H
+#define IRSIM_IRUTILS_H
+
+#include <Arduino.h>
+#include <IRrecv.h>
+
+String typeToString( const decode_type_t protocol, const bool isRepeat = false );
+decode_type_t strToDecodeType( const char *str );
+bool hasACState( const decode_type_t protocol );
+String resultToHumanReadableBasic( const decode_results * const results );
+uint16_t getCorrectedRawLength( const decode_results * const results );
+
+namespace irutils
+{
+    int8_t lowLevelSanityCheck( void );
+}
+
+#endif  // IRSIM_IRUTILS_H
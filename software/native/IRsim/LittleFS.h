@@ -0,0 +1,55 @@
+/*
+ *  IRsim:  LittleFS.h - Host stand-in for the LittleFS flash file system of the ESP8266 Arduino core.
+ *
+ *  The files live in a directory of the host, IRSIM_FS, so they survive a
+ *  restart of the node like they survive a reboot on the device.
+*/
+#ifndef IRSIM_LITTLEFS_H
+#define IRSIM_LITTLEFS_H
+
+#include <Arduino.h>
+#include <dirent.h>
+
+class File
+{
+public:
+    File( FILE *f = NULL ) : fp( f ) {}
+    operator bool() const { return fp != NULL; }
+    size_t read( uint8_t *buf, size_t size ) { return fp ? fread( buf, 1, size, fp ) : 0; }
+    size_t write( const uint8_t *buf, size_t size ) { return fp ? fwrite( buf, 1, size, fp ) : 0; }
+    size_t size( void );
+    void close( void ) { if( fp ) fclose( fp ); fp = NULL; }
+
+private:
+    FILE *fp;
+};
+
+class Dir
+{
+public:
+    Dir( const std::string &p = "" ) : path( p ), dp( NULL ) {}
+    bool next( void );
+    String fileName( void ) const { return String( name ); }
+    size_t fileSize( void ) const { return bytes; }
+
+private:
+    std::string path;
+    DIR *dp;
+    std::string name;
+    size_t bytes = 0;
+};
+
+class FS
+{
+public:
+    bool begin( void );
+    File open( const char *path, const char *mode );
+    Dir openDir( const char *path );
+    bool exists( const char *path );
+    bool remove( const char *path );
+    bool mkdir( const char *path );
+};
+
+extern FS LittleFS;
+
+#endif  // IRSIM_LITTLEFS_H
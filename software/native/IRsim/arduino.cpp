@@ -0,0 +1,434 @@
+/*
+ *  IRsim:  arduino.cpp - Host stand-in for the ESP8266 Arduino core: time, Serial, pins and main().
+*/
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <malloc.h>
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <coredecls.h>
+#include "irsim.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+
+static int eventFd = -1;
+
+uint64_t irsimNowUs( void )
+{
+    struct timespec ts;
+
+    // CLOCK_MONOTONIC is shared by all processes, so the event times of the
+    // nodes can be compared with each other.
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void irsimSleepUntil( uint64_t us )
+{
+    uint64_t now = irsimNowUs();
+
+    // Sleep most of the way, spin for the rest to stay accurate
+    if( us > now + 200 )
+    {
+        struct timespec ts = { 0, (long)( us - now - 100 ) * 1000 };
+
+        while( ts.tv_nsec >= 1000000000 )
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+
+        nanosleep( &ts, NULL );
+    }
+
+    while( irsimNowUs() < us )
+        ;
+}
+
+const char *irsimEnv( const char *name, const char *dflt )
+{
+    const char *value = getenv( name );
+
+    return ( value != NULL && *value != '\0' ) ? value : dflt;
+}
+
+void irsimEvent( const char *fmt, ... )
+{
+    char line[128];
+    va_list args;
+
+    if( eventFd < 0 )
+        return;
+
+    va_start( args, fmt );
+    int len = vsnprintf( line, sizeof(line) - 1, fmt, args );
+    va_end( args );
+
+    if( len < 0 )
+        return;
+
+    if( len > (int)sizeof(line) - 2 )
+        len = sizeof(line) - 2;
+
+    line[len++] = '\n';
+
+    // A single write to an O_APPEND file keeps the lines of both nodes whole
+    if( write( eventFd, line, len ) != len )
+        return;
+}
+
+// timer1 runs its interrupt late, whenever the host gets around to it, but
+// with the clock set back to when it was due. Edges the interrupt makes come
+// out as timed as on the chip.
+static timercallback timer1Isr = NULL;
+static bool timer1Enabled = false;
+static bool timer1Armed = false;
+static bool timer1Loop = false;
+static uint8_t timer1Shift = 0;     // ticks to CPU cycles at 80MHz
+static uint32_t timer1Ticks;
+static uint64_t timer1Due;          // CPU cycle count it is due at
+static bool inIsr = false;
+static uint64_t isrCycles;          // the clock as the interrupt sees it
+
+static uint64_t cpuCycles( void )
+{
+    return inIsr ? isrCycles : irsimNowUs() * 80;
+}
+
+uint64_t irsimCpuUs( void )
+{
+    return cpuCycles() / 80;
+}
+
+void timer1_attachInterrupt( timercallback userFunc )
+{
+    timer1Isr = userFunc;
+}
+
+void timer1_detachInterrupt( void )
+{
+    timer1Isr = NULL;
+}
+
+void timer1_enable( uint8_t divider, uint8_t int_type, uint8_t reload )
+{
+    (void)int_type;
+    timer1Shift = divider == TIM_DIV1 ? 0 : divider == TIM_DIV16 ? 4 : 8;
+    timer1Loop = reload == TIM_LOOP;
+    timer1Enabled = true;
+    irsimLedTimer( true );
+}
+
+void timer1_disable( void )
+{
+    timer1Enabled = false;
+    timer1Armed = false;
+    irsimLedTimer( false );
+}
+
+void timer1_write( uint32_t ticks )
+{
+    timer1Ticks = ticks;
+    timer1Due = cpuCycles() + ( (uint64_t)ticks << timer1Shift );
+    timer1Armed = true;
+}
+
+static void irsimTimerPoll( void )
+{
+    uint64_t now = irsimNowUs() * 80;
+
+    while( !inIsr && timer1Enabled && timer1Armed && timer1Isr != NULL && timer1Due <= now )
+    {
+        inIsr = true;
+        isrCycles = timer1Due;
+        timer1Armed = timer1Loop;
+        timer1Due += (uint64_t)timer1Ticks << timer1Shift;
+        timer1Isr();
+        inIsr = false;
+    }
+}
+
+void irsimPoll( void )
+{
+    irsimTimerPoll();
+    irsimLinkPoll();
+    irsimIrPoll();
+    irsimEmitPoll();
+}
+
+// The clock of the board, behind millis() and micros(). Each board starts
+// its own at power up, and crystals are a few ppm apart.
+static uint64_t boardUs( void )
+{
+    static const int64_t offset = strtoll( irsimEnv( "IRSIM_CLOCK_OFFSET_US", "0" ), NULL, 10 );
+    static const double rate = 1 + atof( irsimEnv( "IRSIM_CLOCK_PPM", "0" )) / 1e6;
+
+    return (uint64_t)( irsimNowUs() * rate ) + offset;
+}
+
+uint32_t millis( void )
+{
+    return boardUs() / 1000;
+}
+
+uint32_t micros( void )
+{
+    return boardUs();
+}
+
+void delay( uint32_t ms )
+{
+    uint64_t end = irsimNowUs() + (uint64_t)ms * 1000;
+
+    // The SDK keeps running while the sketch is in delay()
+    while( irsimNowUs() < end )
+    {
+        irsimPoll();
+        irsimSleepUntil( std::min( end, irsimNowUs() + 500 ));
+    }
+}
+
+// Set by esp_schedule(), a callback wants the sketch to run
+static bool scheduled = false;
+
+void esp_schedule( void )
+{
+    scheduled = true;
+}
+
+void irsimIdle( uint32_t timeoutMs, const std::function<bool( void )> &blocked, uint32_t intervalMs )
+{
+    uint64_t now = irsimNowUs();
+    uint64_t end = now + (uint64_t)timeoutMs * 1000;
+    uint64_t check = now + (uint64_t)intervalMs * 1000;
+
+    scheduled = false;
+
+    while( blocked() )
+    {
+        // The SDK runs, and its callbacks may call esp_schedule()
+        while( !scheduled && now < check )
+        {
+            if( now >= end )
+                return;
+
+            irsimPoll();
+
+            // The CPU is idle, unlike irsimSleepUntil() this doesn't spin. The
+            // other node has the host to itself meanwhile.
+            struct timespec ts = { 0, (long)( std::min( std::min( end, check ), now + 200 ) - now ) * 1000 };
+
+            nanosleep( &ts, NULL );
+            now = irsimNowUs();
+        }
+
+        if( now >= end )
+            return;
+
+        scheduled = false;
+        check = now + (uint64_t)intervalMs * 1000;
+    }
+}
+
+void delayMicroseconds( uint32_t us )
+{
+    irsimSleepUntil( irsimNowUs() + us );
+}
+
+void yield( void )
+{
+    irsimPoll();
+}
+
+void pinMode( uint8_t pin, uint8_t mode )
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite( uint8_t pin, uint8_t val )
+{
+    irsimLedWrite( pin, val );
+}
+
+int digitalRead( uint8_t pin )
+{
+    (void)pin;
+    return HIGH;
+}
+
+uint8_t digitalPinToInterrupt( uint8_t pin )
+{
+    return pin;
+}
+
+void attachInterrupt( uint8_t pin, void (*isr)( void ), int mode )
+{
+    (void)pin;
+    (void)isr;
+    (void)mode;
+}
+
+void detachInterrupt( uint8_t pin )
+{
+    (void)pin;
+}
+
+void HardwareSerial::begin( uint32_t baud, int config )
+{
+    (void)config;
+    usPerByte = 10000000 / baud;
+}
+
+int HardwareSerial::printf( const char *fmt, ... )
+{
+    char buf[512];
+    va_list args;
+
+    va_start( args, fmt );
+    int len = vsnprintf( buf, sizeof(buf), fmt, args );
+    va_end( args );
+
+    if( len < 0 )
+        return len;
+
+    return write( (const uint8_t *)buf, std::min( (size_t)len, sizeof(buf) - 1 ));
+}
+
+// The UART has a 128 byte FIFO. Writing blocks until what doesn't fit in it
+// has been shifted out at the baud rate.
+size_t HardwareSerial::write( const uint8_t *buf, size_t size )
+{
+    uint64_t now = irsimNowUs();
+
+    if( txIdleAt < now )
+        txIdleAt = now;
+
+    txIdleAt += size * usPerByte;
+
+    if( txIdleAt > now + 128 * usPerByte )
+        irsimSleepUntil( txIdleAt - 128 * usPerByte );
+
+    if( strcmp( irsimEnv( "IRSIM_QUIET", "0" ), "1" ) != 0 )
+        fwrite( buf, 1, size, stdout );
+
+    return size;
+}
+
+// Input is read from stdin without blocking, once it ends nothing more is available
+static bool stdinEnded = false;
+
+int HardwareSerial::available( void )
+{
+    struct pollfd fd = { 0, POLLIN, 0 };
+
+    if( stdinEnded || poll( &fd, 1, 0 ) != 1 )
+        return 0;
+
+    return 1;
+}
+
+int HardwareSerial::read( void )
+{
+    unsigned char c;
+
+    if( !available() )
+        return -1;
+
+    if( ::read( 0, &c, 1 ) != 1 )
+    {
+        stdinEnded = true;
+        return -1;
+    }
+
+    return c;
+}
+
+int HardwareSerial::availableForWrite( void )
+{
+    uint64_t now = irsimNowUs();
+    uint64_t queued = ( txIdleAt > now ) ? ( txIdleAt - now ) / usPerByte : 0;
+
+    return queued >= 128 ? 0 : 128 - queued;
+}
+
+void HardwareSerial::flush( void )
+{
+    irsimSleepUntil( txIdleAt );
+    fflush( stdout );
+}
+
+uint32_t EspClass::getCycleCount( void )
+{
+    return cpuCycles();
+}
+
+// The heap of an ESP8266 is modelled as 40000 bytes minus whatever the
+// firmware has allocated since it was first looked at
+static uint32_t simFreeHeap( void )
+{
+    static size_t baseline = mallinfo2().uordblks;
+    size_t used = mallinfo2().uordblks;
+
+    return used > baseline + 40000 ? 0 : 40000 + baseline - used;
+}
+
+uint32_t EspClass::getFreeHeap( void )
+{
+    return simFreeHeap();
+}
+
+uint32_t EspClass::getMaxFreeBlockSize( void )
+{
+    return simFreeHeap();
+}
+
+uint8_t EspClass::getHeapFragmentation( void )
+{
+    return 0;
+}
+
+String WiFiClass::macAddress( void )
+{
+    return String( irsimEnv( "IRSIM_MAC", IRSIM_DEFAULT_MAC ));
+}
+
+int32_t WiFiClass::RSSI( void )
+{
+    return -55;
+}
+
+int main( void )
+{
+    const char *events = irsimEnv( "IRSIM_EVENTS", NULL );
+    uint64_t duration = strtoull( irsimEnv( "IRSIM_DURATION_MS", "0" ), NULL, 10 ) * 1000;
+
+    if( events != NULL )
+        eventFd = open( events, O_WRONLY | O_CREAT | O_APPEND, 0644 );
+
+    setvbuf( stdout, NULL, _IOLBF, 0 );
+
+    // Load the corpus up front, so the heap the firmware sees only changes
+    // with its own allocations
+    irsimCorpus();
+
+    uint64_t end = irsimNowUs() + duration;
+
+    setup();
+
+    while( duration == 0 || irsimNowUs() < end )
+    {
+        loop();
+        irsimPoll();
+    }
+
+    irsimEmitPoll();
+    fflush( stdout );
+
+    return 0;
+}
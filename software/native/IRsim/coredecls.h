@@ -0,0 +1,24 @@
+/*
+ *  IRsim:  coredecls.h - Host stand-in for the scheduling calls of the ESP8266 Arduino core.
+ *
+ *  esp_delay() hands the time to the rest of the simulation, as the SDK gets
+ *  it on the device, until the timeout or blocked() returns false. blocked()
+ *  is checked every intvl_ms, or straight away once a callback called
+ *  esp_schedule().
+*/
+#ifndef IRSIM_COREDECLS_H
+#define IRSIM_COREDECLS_H
+
+#include <functional>
+#include <Arduino.h>
+
+void esp_schedule( void );
+void irsimIdle( uint32_t timeoutMs, const std::function<bool( void )> &blocked, uint32_t intervalMs );
+
+template <typename T>
+inline void esp_delay( const uint32_t timeout_ms, T &&blocked, const uint32_t intvl_ms )
+{
+    irsimIdle( timeout_ms, blocked, intvl_ms );
+}
+
+#endif  // IRSIM_COREDECLS_H
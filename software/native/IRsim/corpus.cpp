@@ -0,0 +1,340 @@
+/*
+ *  IRsim:  corpus.cpp - The captures IRrecv plays back, and matching of emissions against them.
+ *
+ *  The corpus is a text file with one capture per line:
+ *    <protocol> <bits> <value|state|-> [repeat] : <mark>,<space>,<mark>,...
+ *  The value is hex, the state[] of A/C protocols a string of hex bytes, and
+ *  the timings are in usecs. Lines starting with # are comments. Ambient IR
+ *  noise, which shouldn't be relayed, is given as protocol NOISE. A protocol
+ *  can also be given as its decode_type_t number.
+ *
+ *  With IRSIM_TRACE set, the captures are those of a trace IRrecv recorded
+ *  instead (see IRrecv/src/trace.h), each with the gap to the next one it was
+ *  recorded with. They decode as whatever they decoded as on the device.
+*/
+#include <Arduino.h>
+#include <IRutils.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "irsim.h"
+
+// ==================== begin of trace format ====================
+// NOTE: Keep this section in sync with IRrecv/src/trace.h.
+
+#define TRACE_MAGIC             0x52545249      // "IRTR"
+#define TRACE_VERSION           1
+#define TRACE_SYNC              0xA5
+
+#define TRACE_FLAG_NOISE        0x01
+#define TRACE_FLAG_OVERFLOW     0x02
+#define TRACE_FLAG_REPEAT       0x04
+#define TRACE_FLAG_STATE        0x08
+
+typedef struct __attribute__((packed)) struct_trace_hdr
+{
+    uint32_t magic;
+    uint8_t  version;
+    uint8_t  hdrLen;
+    uint16_t bufSize;
+    uint8_t  timeout;
+    uint8_t  reserved[3];
+} struct_trace_hdr;
+
+typedef struct __attribute__((packed)) struct_trace_rec
+{
+    uint8_t  sync;
+    uint8_t  flags;
+    uint16_t len;
+    uint32_t captureUs;
+    int16_t  protocol;
+    uint16_t bits;
+    uint8_t  resultLen;
+    uint16_t rawLen;
+} struct_trace_rec;
+
+// ==================== end of trace format ====================
+
+static std::vector<irsim_capture> corpus;
+static bool loaded = false;
+
+static bool sameLabel( const irsim_capture &a, const irsim_capture &b )
+{
+    return a.protocol == b.protocol && a.bits == b.bits && a.value == b.value &&
+           a.stateLen == b.stateLen && memcmp( a.state, b.state, a.stateLen ) == 0 &&
+           a.repeat == b.repeat && a.noise == b.noise;
+}
+
+static bool sameCapture( const irsim_capture &a, const irsim_capture &b )
+{
+    return sameLabel( a, b ) && a.raw == b.raw;
+}
+
+// Add a capture to the corpus, its id is that of the first one like it. By
+// label those only need to decode the same, else their timings must match.
+static void add( irsim_capture &c, bool byLabel )
+{
+    // UNKNOWN captures are identified by a hash of their timings, as
+    // decodeHash() does. So are those of protocols left out of the build.
+    c.hash = 2166136261u;
+
+    for( size_t i = 2; i < c.raw.size(); i++ )
+        c.hash = ( c.hash * 16777619u ) ^ ( c.raw[i] * 4 < c.raw[i - 2] * 3 ? 0 : c.raw[i] * 3 > c.raw[i - 2] * 4 ? 2 : 1 );
+
+    if( c.protocol == UNKNOWN )
+    {
+        c.value = c.hash;
+        c.bits = 32;
+    }
+
+    c.id = corpus.size();
+
+    for( auto &other : corpus )
+    {
+        if( byLabel ? sameLabel( other, c ) : sameCapture( other, c ))
+        {
+            c.id = other.id;
+            break;
+        }
+    }
+
+    corpus.push_back( c );
+}
+
+// Play back a trace instead. Every press of a button comes out a little
+// different, so its captures are told apart by what they decoded as rather
+// than by their timings.
+static void loadTrace( const char *path )
+{
+    int fd = open( path, O_RDONLY );
+    struct stat st;
+
+    if( fd < 0 || fstat( fd, &st ) != 0 || (size_t)st.st_size < sizeof(struct_trace_hdr) )
+    {
+        fprintf( stderr, "irsim: can't read the trace %s\n", path );
+
+        if( fd >= 0 )
+            close( fd );
+
+        return;
+    }
+
+    size_t size = st.st_size;
+    const uint8_t *map = (const uint8_t *)mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+    close( fd );
+
+    if( map == MAP_FAILED )
+    {
+        fprintf( stderr, "irsim: can't map the trace %s\n", path );
+        return;
+    }
+
+    struct_trace_hdr hdr;
+
+    memcpy( &hdr, map, sizeof(hdr) );
+
+    if( hdr.magic != TRACE_MAGIC || hdr.version != TRACE_VERSION || hdr.hdrLen < sizeof(hdr) )
+    {
+        fprintf( stderr, "irsim: %s isn't a trace\n", path );
+        munmap( (void *)map, size );
+        return;
+    }
+
+    size_t first = corpus.size();
+    std::vector<uint32_t> captureUs;
+
+    for( size_t pos = hdr.hdrLen; pos + sizeof(struct_trace_rec) <= size; )
+    {
+        struct_trace_rec rec;
+        irsim_capture c;
+
+        memcpy( &rec, map + pos, sizeof(rec) );
+
+        if( rec.sync != TRACE_SYNC || pos + sizeof(rec) + rec.len > size ||
+            rec.resultLen + rec.rawLen * 2u > rec.len || rec.resultLen > kStateSizeMax )
+        {
+            fprintf( stderr, "irsim: %s is corrupt at byte %zu\n", path, pos );
+            break;
+        }
+
+        const uint8_t *data = map + pos + sizeof(rec);
+
+        memset( c.state, 0, sizeof(c.state) );
+        c.protocol = (decode_type_t)rec.protocol;
+        c.bits = rec.bits;
+        c.value = 0;
+        c.stateLen = 0;
+        c.repeat = ( rec.flags & TRACE_FLAG_REPEAT ) != 0;
+        c.noise = ( rec.flags & TRACE_FLAG_NOISE ) != 0;
+
+        if( rec.flags & TRACE_FLAG_STATE )
+        {
+            memcpy( c.state, data, rec.resultLen );
+            c.stateLen = rec.resultLen;
+        }
+        else if( rec.resultLen == sizeof(c.value) )
+            memcpy( &c.value, data, sizeof(c.value) );
+
+        c.raw.resize( rec.rawLen );
+        memcpy( c.raw.data(), data + rec.resultLen, rec.rawLen * 2 );
+
+        c.gapUs = 0;
+        add( c, !c.noise );
+        captureUs.push_back( rec.captureUs );
+
+        pos += sizeof(rec) + rec.len;
+    }
+
+    munmap( (void *)map, size );
+
+    // A capture is copied out a timeout after it ended, from start to start
+    // is the time between those less the difference of their durations.
+    // micros() wraps, the differences don't.
+    for( size_t i = first; i + 1 < corpus.size(); i++ )
+    {
+        int64_t gap = (int32_t)( captureUs[i + 1 - first] - captureUs[i - first] );
+
+        gap -= (int64_t)irsimRawDuration( corpus[i + 1].raw.data(), corpus[i + 1].raw.size() ) -
+               (int64_t)irsimRawDuration( corpus[i].raw.data(), corpus[i].raw.size() );
+        corpus[i].gapUs = gap > 0 ? gap : 0;
+    }
+}
+
+static void load( void )
+{
+    const char *path = irsimEnv( "IRSIM_CAPTURES", NULL );
+    const char *trace = irsimEnv( "IRSIM_TRACE", NULL );
+    char line[8192];
+
+    loaded = true;
+
+    if( trace != NULL )
+    {
+        loadTrace( trace );
+        return;
+    }
+
+    if( path == NULL )
+        return;
+
+    FILE *f = fopen( path, "r" );
+
+    if( f == NULL )
+    {
+        fprintf( stderr, "irsim: can't open %s\n", path );
+        return;
+    }
+
+    while( fgets( line, sizeof(line), f ) != NULL )
+    {
+        char *colon = strchr( line, ':' );
+        char name[32], value[2 * kStateSizeMax + 1], flag[16] = "";
+        unsigned int bits;
+        irsim_capture c;
+
+        if( line[0] == '#' || colon == NULL )
+            continue;
+
+        *colon = '\0';
+
+        if( sscanf( line, "%31s %u %106s %15s", name, &bits, value, flag ) < 3 )
+            continue;
+
+        memset( c.state, 0, sizeof(c.state) );
+        c.protocol = isdigit( name[0] ) || name[0] == '-' ? (decode_type_t)atoi( name ) : strToDecodeType( name );
+        c.bits = bits;
+        c.value = 0;
+        c.stateLen = 0;
+        c.repeat = strcmp( flag, "repeat" ) == 0;
+        c.noise = strcmp( name, "NOISE" ) == 0;
+
+        if( hasACState( c.protocol ))
+        {
+            for( size_t i = 0; value[2 * i] != '\0' && value[2 * i + 1] != '\0' && i < kStateSizeMax; i++ )
+            {
+                unsigned int b;
+
+                sscanf( value + 2 * i, "%2x", &b );
+                c.state[c.stateLen++] = b;
+            }
+        }
+        else if( strcmp( value, "-" ) != 0 )
+            c.value = strtoull( value, NULL, 16 );
+
+        for( char *t = strtok( colon + 1, ", \t\r\n" ); t != NULL; t = strtok( NULL, ", \t\r\n" ))
+            c.raw.push_back( atoi( t ));
+
+        c.gapUs = 0;
+        add( c, false );
+    }
+
+    fclose( f );
+}
+
+const std::vector<irsim_capture> &irsimCorpus( void )
+{
+    if( !loaded )
+        load();
+
+    return corpus;
+}
+
+// Find the capture a protocol emission was regenerated from, -1 if none
+int irsimCorpusFind( decode_type_t protocol, uint64_t value, const uint8_t *state, uint16_t nbytes )
+{
+    for( auto &c : irsimCorpus() )
+    {
+        if( c.protocol != protocol || c.repeat )
+            continue;
+
+        if( state != NULL ? ( c.stateLen == nbytes && memcmp( c.state, state, nbytes ) == 0 ) : c.value == value )
+            return c.id;
+    }
+
+    return -1;
+}
+
+// Find the capture a raw emission replays, allowing the usual 25% tolerance.
+// Held buttons give captures that are alike, so the closest one wins.
+int irsimCorpusFindRaw( const uint16_t *raw, uint16_t len )
+{
+    int best = -1;
+    uint32_t bestError = UINT32_MAX;
+
+    for( auto &c : irsimCorpus() )
+    {
+        if( c.raw.size() != len )
+            continue;
+
+        uint32_t error = 0;
+        uint16_t i;
+
+        for( i = 0; i < len; i++ )
+        {
+            if( raw[i] * 4 < c.raw[i] * 3 || raw[i] * 4 > c.raw[i] * 5 )
+                break;
+
+            error += raw[i] > c.raw[i] ? raw[i] - c.raw[i] : c.raw[i] - raw[i];
+        }
+
+        if( i == len && error < bestError )
+        {
+            best = c.id;
+            bestError = error;
+        }
+    }
+
+    return best;
+}
+
+uint32_t irsimRawDuration( const uint16_t *raw, uint16_t len )
+{
+    uint32_t duration = 0;
+
+    for( uint16_t i = 0; i < len; i++ )
+        duration += raw[i];
+
+    return duration;
+}
@@ -0,0 +1,370 @@
+/*
+ *  IRsim:  espnow.cpp - Host stand-in for ESP-NOW over a simulated link.
+ *
+ *  Every node listens on a localhost UDP port derived from its MAC address.
+ *  Packets leave right away, like the radio sends them in the background,
+ *  but carry the time their air time (plus the configured delay and jitter)
+ *  is over, and the receiver holds them back until then. They may be lost.
+ *  A broadcast reaches each of the other peers, or is lost, on its own, and
+ *  like on the radio its send callback always reports success.
+ *  Like on the ESP8266, the receive and send callbacks only ever run between
+ *  loop() iterations, from yield() or delay().
+*/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <deque>
+#include <iterator>
+#include <vector>
+#include <Arduino.h>
+#include <espnow.h>
+#include <user_interface.h>
+#include "irsim.h"
+
+#define ESPNOW_MAX_LEN      250     // largest ESP-NOW payload
+#define AIR_OVERHEAD_US     300     // preamble, MAC header, ACK and inter frame spaces
+#define SNIFFED_LEN         128     // what the SDK hands the promiscuous callback of a management frame
+
+typedef struct sim_packet
+{
+    uint64_t due;           // time the packet has been on the air
+    uint8_t da[6];          // destination, or source of a received packet
+    bool lost;
+    std::vector<uint8_t> data;
+} sim_packet;
+
+// A datagram carries the sender's MAC and the due time ahead of the payload
+#define DATAGRAM_HDR        ( 6 + sizeof(uint64_t) )
+
+static int sock = -1;
+static uint8_t selfMac[6];
+static std::vector<std::vector<uint8_t>> peers;
+static std::deque<sim_packet> pending;     // sent, waiting for the send callback
+static std::deque<sim_packet> inbox;       // received, waiting to be due
+static const uint8_t broadcastMac[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static uint64_t airFreeAt = 0;      // time the simulated radio is free again
+static esp_now_recv_cb_t recvCb = NULL;
+static esp_now_send_cb_t sendCb = NULL;
+static wifi_promiscuous_cb_t sniffCb = NULL;
+static bool promiscuous = false;
+static int8_t rssi;
+
+static double loss;
+static uint32_t delayUs;
+static uint32_t jitterUs;
+static double rateMbps;
+
+static bool parseMac( const char *str, uint8_t *mac )
+{
+    unsigned int b[6];
+
+    if( sscanf( str, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5] ) != 6 )
+        return false;
+
+    for( int i = 0; i < 6; i++ )
+        mac[i] = b[i];
+
+    return true;
+}
+
+static uint16_t macToPort( const uint8_t *mac )
+{
+    return 40000 + ((mac[4] << 8) | mac[5]) % 20000;
+}
+
+static void sendTo( const sim_packet &packet )
+{
+    struct sockaddr_in addr;
+    uint8_t datagram[DATAGRAM_HDR + ESPNOW_MAX_LEN];
+
+    memset( &addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    addr.sin_port = htons( macToPort( packet.da ));
+
+    // The sender's MAC goes first, the receive callback is given it
+    memcpy( datagram, selfMac, 6 );
+    memcpy( datagram + 6, &packet.due, sizeof(packet.due) );
+    memcpy( datagram + DATAGRAM_HDR, packet.data.data(), packet.data.size() );
+    sendto( sock, datagram, DATAGRAM_HDR + packet.data.size(), 0, (struct sockaddr *)&addr, sizeof(addr) );
+}
+
+int esp_now_init( void )
+{
+    struct sockaddr_in addr;
+
+    if( !parseMac( irsimEnv( "IRSIM_MAC", IRSIM_DEFAULT_MAC ), selfMac ))
+        return -1;
+
+    loss = atof( irsimEnv( "IRSIM_LOSS", "0" ));
+    delayUs = atoi( irsimEnv( "IRSIM_DELAY_US", "0" ));
+    jitterUs = atoi( irsimEnv( "IRSIM_JITTER_US", "0" ));
+    rateMbps = atof( irsimEnv( "IRSIM_RATE_MBPS", "1" ));
+    rssi = atoi( irsimEnv( "IRSIM_RSSI", "-55" ));
+    srand( irsimNowUs() );
+
+    sock = socket( AF_INET, SOCK_DGRAM, 0 );
+
+    if( sock < 0 )
+        return -1;
+
+    memset( &addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    addr.sin_port = htons( macToPort( selfMac ));
+
+    if( bind( sock, (struct sockaddr *)&addr, sizeof(addr) ) != 0 )
+    {
+        close( sock );
+        sock = -1;
+        return -1;
+    }
+
+    fcntl( sock, F_SETFL, O_NONBLOCK );
+
+    return 0;
+}
+
+int esp_now_deinit( void )
+{
+    if( sock >= 0 )
+        close( sock );
+
+    sock = -1;
+
+    return 0;
+}
+
+int esp_now_register_send_cb( esp_now_send_cb_t cb )
+{
+    sendCb = cb;
+    return 0;
+}
+
+int esp_now_unregister_send_cb( void )
+{
+    sendCb = NULL;
+    return 0;
+}
+
+int esp_now_register_recv_cb( esp_now_recv_cb_t cb )
+{
+    recvCb = cb;
+    return 0;
+}
+
+int esp_now_unregister_recv_cb( void )
+{
+    recvCb = NULL;
+    return 0;
+}
+
+static int queuePacket( const uint8_t *da, const uint8_t *data, int len )
+{
+    sim_packet packet;
+    uint64_t now = irsimNowUs();
+    uint32_t airTime = AIR_OVERHEAD_US + len * 8 / rateMbps;
+
+    // Packets go out one after the other, each taking its air time
+    if( airFreeAt < now )
+        airFreeAt = now;
+
+    airFreeAt += airTime;
+
+    packet.due = airFreeAt + delayUs;
+
+    if( jitterUs != 0 )
+        packet.due += rand() % jitterUs;
+
+    // Never overtake a packet sent earlier
+    if( !pending.empty() && packet.due < pending.back().due )
+        packet.due = pending.back().due;
+
+    memcpy( packet.da, da, 6 );
+    packet.data.assign( data, data + len );
+
+    if( memcmp( da, broadcastMac, 6 ) == 0 )
+    {
+        packet.lost = false;
+        pending.push_back( packet );
+
+        for( auto &peer : peers )
+        {
+            sim_packet copy = packet;
+
+            memcpy( copy.da, peer.data(), 6 );
+
+            if( memcmp( copy.da, broadcastMac, 6 ) != 0 && rand() >= loss * RAND_MAX )
+                sendTo( copy );
+        }
+
+        return 0;
+    }
+
+    packet.lost = rand() < loss * RAND_MAX;
+    pending.push_back( packet );
+
+    if( !packet.lost )
+        sendTo( packet );
+
+    return 0;
+}
+
+int esp_now_send( u8 *da, u8 *data, int len )
+{
+    if( sock < 0 || len <= 0 || len > ESPNOW_MAX_LEN )
+        return -1;
+
+    // A NULL address sends to every peer
+    if( da == NULL )
+    {
+        for( auto &peer : peers )
+        {
+            if( memcmp( peer.data(), broadcastMac, 6 ) != 0 )
+                queuePacket( peer.data(), data, len );
+        }
+
+        return 0;
+    }
+
+    return queuePacket( da, data, len );
+}
+
+int esp_now_add_peer( u8 *mac_addr, u8 role, u8 channel, u8 *key, u8 key_len )
+{
+    (void)role;
+    (void)channel;
+    (void)key;
+    (void)key_len;
+
+    if( esp_now_is_peer_exist( mac_addr ))
+        return 0;
+
+    peers.push_back( std::vector<uint8_t>( mac_addr, mac_addr + 6 ));
+
+    return 0;
+}
+
+int esp_now_del_peer( u8 *mac_addr )
+{
+    for( auto it = peers.begin(); it != peers.end(); ++it )
+    {
+        if( memcmp( it->data(), mac_addr, 6 ) == 0 )
+        {
+            peers.erase( it );
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int esp_now_set_self_role( u8 role )
+{
+    (void)role;
+    return 0;
+}
+
+int esp_now_is_peer_exist( u8 *mac_addr )
+{
+    for( auto &peer : peers )
+    {
+        if( memcmp( peer.data(), mac_addr, 6 ) == 0 )
+            return 1;
+    }
+
+    return 0;
+}
+
+void wifi_set_promiscuous_rx_cb( wifi_promiscuous_cb_t cb )
+{
+    sniffCb = cb;
+}
+
+void wifi_promiscuous_enable( uint8_t enable )
+{
+    promiscuous = ( enable != 0 );
+}
+
+// Hand a received packet from sender to the promiscuous callback, the way
+// the SDK hands over the ESP-NOW action frame it came in
+static void sniff( const uint8_t *sender )
+{
+    static const uint8_t header[] =
+    {
+        0xD0, 0x00, 0x00, 0x00,                 // action frame, duration
+        0, 0, 0, 0, 0, 0,                       // receiver, filled in below
+        0, 0, 0, 0, 0, 0,                       // transmitter
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,     // BSSID
+        0x00, 0x00,                             // sequence control
+        0x7F, 0x18, 0xFE, 0x34                  // vendor specific, Espressif
+    };
+    uint8_t buf[SNIFFED_LEN];
+
+    memset( buf, 0, sizeof(buf) );
+    buf[0] = (uint8_t)rssi;
+    memcpy( buf + 12, header, sizeof(header) );
+    memcpy( buf + 12 + 4, selfMac, 6 );
+    memcpy( buf + 12 + 10, sender, 6 );
+
+    sniffCb( buf, sizeof(buf) );
+}
+
+// Report sent packets once their air time is over and deliver received ones
+// that are due
+void irsimLinkPoll( void )
+{
+    uint8_t datagram[DATAGRAM_HDR + ESPNOW_MAX_LEN];
+    uint64_t now = irsimNowUs();
+
+    if( sock < 0 )
+        return;
+
+    while( !pending.empty() && pending.front().due <= now )
+    {
+        sim_packet packet = pending.front();
+
+        pending.pop_front();
+
+        // A lost unicast packet is never acknowledged, a broadcast never is
+        if( sendCb != NULL )
+            sendCb( packet.da, packet.lost ? 1 : 0 );
+    }
+
+    for( ;; )
+    {
+        ssize_t len = recv( sock, datagram, sizeof(datagram), 0 );
+        sim_packet packet;
+
+        if( len <= (ssize_t)DATAGRAM_HDR )
+            break;
+
+        memcpy( packet.da, datagram, 6 );
+        memcpy( &packet.due, datagram + 6, sizeof(packet.due) );
+        packet.lost = false;
+        packet.data.assign( datagram + DATAGRAM_HDR, datagram + len );
+
+        // Packets of different senders may be due in another order than they came in
+        auto it = inbox.end();
+
+        while( it != inbox.begin() && std::prev( it )->due > packet.due )
+            --it;
+
+        inbox.insert( it, packet );
+    }
+
+    while( !inbox.empty() && inbox.front().due <= now )
+    {
+        sim_packet packet = inbox.front();
+
+        inbox.pop_front();
+
+        if( promiscuous && sniffCb != NULL )
+            sniff( packet.da );
+
+        if( recvCb != NULL )
+            recvCb( packet.da, packet.data.data(), packet.data.size() );
+    }
+}
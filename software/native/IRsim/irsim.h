@@ -0,0 +1,81 @@
+/*
+ *  IRsim:  irsim.h - Host simulation of an IR_Repeater node.
+ *
+ *  Each node (IRrecv or IRsend built with the native env) runs as its own
+ *  process. They talk over a simulated ESP-NOW link made of UDP datagrams on
+ *  localhost, and report what they capture and emit to a shared event log the
+ *  benchmark (../bench/bench.py) turns into throughput and latency figures.
+ *
+ *  The simulation is configured through the environment:
+ *    IRSIM_MAC           MAC address of this node (default: IRSIM_DEFAULT_MAC)
+ *    IRSIM_LOSS          probability 0..1 that a packet is lost (default: 0)
+ *    IRSIM_DELAY_US      one-way delay of every packet (default: 0)
+ *    IRSIM_JITTER_US     random extra delay of up to this much (default: 0)
+ *    IRSIM_RATE_MBPS     radio bit rate used for the air time (default: 1)
+ *    IRSIM_RSSI          dBm the packets come in at (default: -55)
+ *    IRSIM_CAPTURES      capture corpus IRrecv plays back (see bench/captures.txt)
+ *    IRSIM_TRACE         trace IRrecv plays back instead (see native/trace/trace.py)
+ *    IRSIM_INTERVAL_MS   time between the starts of played back captures (default: 150,
+ *                        or as traced when IRSIM_TRACE is played back without it)
+ *    IRSIM_EVENTS        file the capture and emit events are appended to
+ *    IRSIM_DURATION_MS   run time after which the node exits (default: forever)
+ *    IRSIM_QUIET         1 to drop the Serial output, it is still timed
+ *    IRSIM_FS            directory holding the LittleFS files (default: /tmp/irsim-fs-<MAC>)
+ *    IRSIM_CLOCK_OFFSET_US  added to the clock behind millis() and micros() (default: 0)
+ *    IRSIM_CLOCK_PPM     how much faster that clock runs, in ppm (default: 0)
+*/
+#ifndef IRSIM_H
+#define IRSIM_H
+
+#include <stdint.h>
+#include <vector>
+#include <IRrecv.h>
+
+#ifndef IRSIM_DEFAULT_MAC
+#define IRSIM_DEFAULT_MAC   "02:00:00:00:00:01"
+#endif  // IRSIM_DEFAULT_MAC
+
+// One capture of the corpus
+typedef struct irsim_capture
+{
+    decode_type_t protocol;
+    uint16_t bits;
+    uint64_t value;
+    uint32_t hash;                  // decodeHash() of the timings, what it decodes as without its decoder
+    uint8_t state[kStateSizeMax];
+    uint8_t stateLen;
+    bool repeat;
+    bool noise;                     // ambient IR noise, not a frame to relay
+    std::vector<uint16_t> raw;      // mark/space timings in usecs
+    int id;                         // index of the first identical capture
+    uint64_t gapUs;                 // from its start to the next as traced, 0 if not traced
+} irsim_capture;
+
+uint64_t irsimNowUs( void );
+void irsimSleepUntil( uint64_t us );
+void irsimPoll( void );
+const char *irsimEnv( const char *name, const char *dflt );
+void irsimEvent( const char *fmt, ... ) __attribute__((format(printf, 1, 2)));
+
+const std::vector<irsim_capture> &irsimCorpus( void );
+int irsimCorpusFind( decode_type_t protocol, uint64_t value, const uint8_t *state, uint16_t nbytes );
+int irsimCorpusFindRaw( const uint16_t *raw, uint16_t len );
+uint32_t irsimRawDuration( const uint16_t *raw, uint16_t len );
+bool irsimDecodes( const decode_type_t protocol );
+bool irsimSends( const decode_type_t protocol );
+
+// The clock of the CPU, as the interrupt that runs sees it
+uint64_t irsimCpuUs( void );
+
+// Used by the ESP-NOW stand-in
+void irsimLinkPoll( void );
+
+// Used by the IRrecv and IRsend stand-ins
+void irsimIrPoll( void );
+void irsimEmitPoll( void );
+
+// Used by the Arduino stand-in, the LED is watched while timer1 runs
+void irsimLedTimer( bool running );
+void irsimLedWrite( uint8_t pin, uint8_t val );
+
+#endif  // IRSIM_H
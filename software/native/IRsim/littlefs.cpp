@@ -0,0 +1,101 @@
+/*
+ *  IRsim:  littlefs.cpp - Host stand-in for the LittleFS flash file system of the ESP8266 Arduino core.
+*/
+#include <sys/stat.h>
+#include <errno.h>
+#include <unistd.h>
+#include <LittleFS.h>
+#include "irsim.h"
+
+FS LittleFS;
+
+static std::string root;
+
+// Host path of a path on the file system
+static std::string hostPath( const char *path )
+{
+    return root + ( path[0] == '/' ? "" : "/" ) + path;
+}
+
+size_t File::size( void )
+{
+    struct stat st;
+
+    if( fp == NULL || fstat( fileno( fp ), &st ) != 0 )
+        return 0;
+
+    return st.st_size;
+}
+
+bool Dir::next( void )
+{
+    struct dirent *entry;
+
+    if( dp == NULL && ( dp = opendir( path.c_str() )) == NULL )
+        return false;
+
+    while( ( entry = readdir( dp )) != NULL )
+    {
+        struct stat st;
+
+        if( stat( ( path + "/" + entry->d_name ).c_str(), &st ) != 0 || !S_ISREG( st.st_mode ))
+            continue;
+
+        name = entry->d_name;
+        bytes = st.st_size;
+        return true;
+    }
+
+    closedir( dp );
+    dp = NULL;
+
+    return false;
+}
+
+// The file system of each node is a directory named after its MAC address,
+// unless IRSIM_FS says otherwise
+bool FS::begin( void )
+{
+    std::string mac = irsimEnv( "IRSIM_MAC", IRSIM_DEFAULT_MAC );
+
+    mac.erase( std::remove( mac.begin(), mac.end(), ':' ), mac.end() );
+    root = irsimEnv( "IRSIM_FS", ( "/tmp/irsim-fs-" + mac ).c_str() );
+
+    return ::mkdir( root.c_str(), 0755 ) == 0 || errno == EEXIST;
+}
+
+// Like on LittleFS, writing a file creates the directories it is in
+File FS::open( const char *path, const char *mode )
+{
+    std::string host = hostPath( path );
+
+    if( mode[0] == 'w' || mode[0] == 'a' )
+    {
+        for( size_t i = root.length() + 1; ( i = host.find( '/', i )) != std::string::npos; i++ )
+            ::mkdir( host.substr( 0, i ).c_str(), 0755 );
+    }
+
+    return File( fopen( host.c_str(), mode[0] == 'w' ? "wb" : mode[0] == 'a' ? "ab" : "rb" ));
+}
+
+Dir FS::openDir( const char *path )
+{
+    return Dir( hostPath( path ));
+}
+
+bool FS::exists( const char *path )
+{
+    struct stat st;
+
+    return stat( hostPath( path ).c_str(), &st ) == 0;
+}
+
+bool FS::remove( const char *path )
+{
+    return unlink( hostPath( path ).c_str() ) == 0;
+}
+
+bool FS::mkdir( const char *path )
+{
+    return ::mkdir( hostPath( path ).c_str(), 0755 ) == 0 || errno == EEXIST;
+}
@@ -0,0 +1,19 @@
+/*
+ *  IRsim:  user_interface.h - Host stand-in for the promiscuous mode of the ESP8266 SDK.
+ *
+ *  The callback gets every ESP-NOW packet the node receives, right before
+ *  the ESP-NOW receive callback, as the SDK's 128 byte buffer of a
+ *  management frame: the RxControl with the RSSI (IRSIM_RSSI) and the start
+ *  of the vendor specific action frame an ESP-NOW packet is sent in.
+*/
+#ifndef IRSIM_USER_INTERFACE_H
+#define IRSIM_USER_INTERFACE_H
+
+#include <stdint.h>
+
+typedef void (*wifi_promiscuous_cb_t)( uint8_t *buf, uint16_t len );
+
+void wifi_set_promiscuous_rx_cb( wifi_promiscuous_cb_t cb );
+void wifi_promiscuous_enable( uint8_t promiscuous );
+
+#endif  // IRSIM_USER_INTERFACE_H
@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+"""
+IR_Repeater end-to-end benchmark on the host.
+
+Runs the native builds of IRrecv and IRsend (pio run -e native in each project)
+as two processes connected by the simulated ESP-NOW link of ../IRsim. IRrecv
+plays back a capture corpus, and every emission of IRsend is matched to the
+capture it relays. Reports frames per second and capture-to-emit latency,
+measured from the last edge of a capture to the start of its emission. A long
+frame streamed while it is still being captured starts before it ends, its
+latency is negative. Noise in the corpus is counted apart, along with how
+much of it IRsend emitted. The host CPU each node used is its load, the time
+it idled doesn't count.
+
+With --trace, IRrecv plays back a trace recorded on the device instead (see
+../trace/trace.py), at the pace it was recorded at or, with --speed max, each
+capture 20ms after the previous one ended.
+
+Example:
+    (cd ../../IRrecv && pio run -e native)
+    (cd ../../IRsend && pio run -e native)
+    ./bench.py --duration 10 --loss 0.02
+"""
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+from collections import defaultdict, deque
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SOFTWARE = os.path.dirname(os.path.dirname(HERE))
+
+# The MAC addresses the two firmwares use for each other
+IRRECV_MAC = "50:02:91:EC:18:C5"
+IRSEND_MAC = "18:FE:34:D9:41:7C"
+
+
+def percentile(values, p):
+    if not values:
+        return float("nan")
+    values = sorted(values)
+    k = (len(values) - 1) * p / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(values) - 1)
+    return values[lo] + (values[hi] - values[lo]) * (k - lo)
+
+
+def run(args, events):
+    env = dict(os.environ)
+    env.update({
+        "IRSIM_EVENTS": events,
+        "IRSIM_CAPTURES": args.captures,
+        "IRSIM_TRACE": args.trace or "",
+        "IRSIM_INTERVAL_MS": str(args.interval if args.interval is not None else 150),
+        "IRSIM_LOSS": str(args.loss),
+        "IRSIM_DELAY_US": str(args.delay),
+        "IRSIM_JITTER_US": str(args.jitter),
+        "IRSIM_RATE_MBPS": str(args.rate),
+        "IRSIM_QUIET": "0" if args.verbose else "1",
+    })
+    duration = int(args.duration * 1000)
+
+    # A trace goes at its own pace unless the interval is given
+    if args.trace and args.speed == "max":
+        env["IRSIM_INTERVAL_MS"] = "0"
+    elif args.trace and args.interval is None:
+        env["IRSIM_INTERVAL_MS"] = ""
+
+    # IRsend runs a little longer so it can emit what is still in flight
+    irsend = subprocess.Popen(
+        [args.irsend],
+        env=dict(env, IRSIM_MAC=IRSEND_MAC, IRSIM_DURATION_MS=str(duration + 2000)))
+    irrecv = subprocess.Popen(
+        [args.irrecv],
+        env=dict(env, IRSIM_MAC=IRRECV_MAC, IRSIM_DURATION_MS=str(duration)))
+
+    # Host CPU each node used, an idle one hands it back like it would to the SDK
+    cpu = {}
+    for name, node, ms in (("IRrecv", irrecv, duration), ("IRsend", irsend, duration + 2000)):
+        usage = os.wait4(node.pid, 0)[2]
+        node.returncode = 0
+        cpu[name] = 100.0 * (usage.ru_utime + usage.ru_stime) / (ms / 1000.0)
+    return cpu
+
+
+def analyse(events, window, cpu):
+    captures = defaultdict(deque)    # corpus id -> (start, end) of captures not emitted yet
+    emits = []
+    captured = 0
+    noise = set()                    # corpus ids of noise
+    noiseCaptured = 0
+
+    with open(events) as f:
+        for line in f:
+            fields = line.split()
+            if fields[0] == "C":
+                captured += 1
+                captures[int(fields[2])].append((int(fields[3]), int(fields[1])))
+            elif fields[0] == "N":
+                noiseCaptured += 1
+                noise.add(int(fields[2]))
+            elif fields[0] == "E":
+                emits.append((int(fields[1]), int(fields[2])))
+
+    # Match every emission to the oldest capture of the same frame that started
+    # before it. Captures ending more than the window before it were lost and
+    # are skipped.
+    latencies = []
+    spurious = 0
+    noiseRelayed = 0
+    first = last = None
+    for t, cid in sorted(emits):
+        if cid in noise:
+            noiseRelayed += 1
+            continue
+        queue = captures.get(cid)
+        while queue and queue[0][1] < t - window * 1000:
+            queue.popleft()
+        if not queue or queue[0][0] > t:
+            spurious += 1
+            continue
+        c = queue.popleft()[1]
+        latencies.append((t - c) / 1000.0)
+        first = c if first is None else min(first, c)
+        last = t
+
+    relayed = len(latencies)
+    span = (last - first) / 1e6 if relayed > 1 else float("nan")
+
+    print("captured      : %d" % captured)
+    print("relayed       : %d (%.1f%%)" % (relayed, 100.0 * relayed / captured if captured else 0))
+    print("lost          : %d" % (captured - relayed))
+    print("unmatched     : %d" % spurious)
+    print("noise         : %d, %d relayed" % (noiseCaptured, noiseRelayed))
+    print("frames/sec    : %.2f" % (relayed / span if span == span and span > 0 else 0))
+    print("latency p50   : %.2f ms" % percentile(latencies, 50))
+    print("latency p99   : %.2f ms" % percentile(latencies, 99))
+    print("latency max   : %.2f ms" % (max(latencies) if latencies else float("nan")))
+    print("cpu load      : %s" % ", ".join("%s %.1f%%" % (name, load) for name, load in cpu.items()))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1],
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--irrecv", default=os.path.join(SOFTWARE, "IRrecv/.pio/build/native/program"))
+    parser.add_argument("--irsend", default=os.path.join(SOFTWARE, "IRsend/.pio/build/native/program"))
+    parser.add_argument("--captures", default=os.path.join(HERE, "captures.txt"),
+                        help="capture corpus to play back")
+    parser.add_argument("--duration", type=float, default=10, help="seconds to run")
+    parser.add_argument("--interval", type=int,
+                        help="ms from the start of one capture to the next (default: 150, or as traced)")
+    parser.add_argument("--trace", help="trace recorded by IRrecv to play back instead of the corpus")
+    parser.add_argument("--speed", choices=("recorded", "max"), default="recorded",
+                        help="play the trace back at the pace it was recorded at, or back to back")
+    parser.add_argument("--loss", type=float, default=0.0, help="packet loss probability 0..1")
+    parser.add_argument("--delay", type=int, default=0, help="one-way link delay in usecs")
+    parser.add_argument("--jitter", type=int, default=0, help="random extra delay in usecs")
+    parser.add_argument("--rate", type=float, default=1.0, help="radio bit rate in Mbps")
+    parser.add_argument("--window", type=int, default=1000,
+                        help="ms after a capture its emission is still matched to it")
+    parser.add_argument("--events", help="keep the event log in this file")
+    parser.add_argument("--verbose", action="store_true", help="show the Serial output of the nodes")
+    args = parser.parse_args()
+
+    for binary in (args.irrecv, args.irsend):
+        if not os.path.exists(binary):
+            sys.exit("%s not found, build it with: pio run -e native" % binary)
+
+    events = args.events or tempfile.mkstemp(prefix="irsim-", suffix=".log")[1]
+    open(events, "w").close()
+
+    try:
+        cpu = run(args, events)
+        analyse(events, args.window, cpu)
+    finally:
+        if not args.events:
+            os.unlink(events)
+
+
+if __name__ == "__main__":
+    main()
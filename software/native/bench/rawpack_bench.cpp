@@ -0,0 +1,125 @@
+/*
+ *  IRsim:  rawpack_bench.cpp - Size of the raw timings of a frame packed and as they are, and the time it takes.
+ *
+ *  Builds as a sketch against the stand-ins in ../IRsim, with the raw timing
+ *  codec of the nodes. For every distinct capture of the corpus it packs the
+ *  timings the way IRrecv does and unpacks them the way IRsend does, and
+ *  shows the bytes and ESP-NOW packets of the frame with its timings as they
+ *  are and packed, the time to pack and to unpack them, and how far the
+ *  unpacked timings are from the captured ones. Every capture is unpacked
+ *  twice from its packed timings, which must come out the same.
+ *
+ *  Example, from software/:
+ *    g++ -std=gnu++17 -O2 -Inative/IRsim -Icommon/IRcommon native/bench/rawpack_bench.cpp \
+ *        common/IRcommon/rawpack.cpp native/IRsim/?*.cpp -o /tmp/rawpack_bench
+ *    IRSIM_CAPTURES=native/bench/captures.txt IRSIM_QUIET=1 /tmp/rawpack_bench
+ *  Results go to stderr.
+*/
+#include <Arduino.h>
+#include <IRutils.h>
+#include "irsim.h"
+#include "messages.h"
+#include "rawpack.h"
+
+// Times each capture is packed and unpacked
+const uint32_t kRounds = 20000;
+
+// Frame and the packets it takes with timings of this many bytes
+static uint16_t frameLen( const irsim_capture &cap, uint16_t rawBytes )
+{
+    return sizeof(struct_IRframe_hdr) + (( cap.stateLen + 1 ) & ~1 ) + rawBytes;
+}
+
+static uint16_t packets( uint16_t len )
+{
+    return ( len + IRFRAGMENT_MAX_DATA - 1 ) / IRFRAGMENT_MAX_DATA;
+}
+
+void setup()
+{
+    const std::vector<irsim_capture> &corpus = irsimCorpus();
+    uint16_t raw[IRFRAME_MAX_RAW];
+    uint16_t unpacked[IRFRAME_MAX_RAW];
+    uint16_t again[IRFRAME_MAX_RAW];
+    uint32_t totalRaw = 0;
+    uint32_t totalPacked = 0;
+    uint32_t totalTimings = 0;
+    uint64_t totalPack = 0;
+    uint64_t totalUnpack = 0;
+    bool failed = false;
+
+    fprintf( stderr, "%-12s %6s %12s %12s %8s %10s %12s %10s\n",
+             "protocol", "len", "raw bytes", "packed", "ratio", "pack ns", "unpack ns", "max err us" );
+
+    for( size_t c = 0; c < corpus.size(); c++ )
+    {
+        const irsim_capture &cap = corpus[c];
+        uint16_t len = cap.raw.size();
+        uint16_t packedLen = 0;
+
+        if( cap.id != (int)c || cap.raw.empty() || len > IRFRAME_MAX_RAW )
+            continue;
+
+        // Packing works in place, on a fresh copy every time
+        uint64_t start = irsimNowUs();
+
+        for( uint32_t i = 0; i < kRounds; i++ )
+        {
+            memcpy( raw, cap.raw.data(), len * sizeof(raw[0]) );
+            packedLen = rawPack( raw, len );
+        }
+
+        uint64_t pack = irsimNowUs() - start;
+        uint64_t unpack = 0;
+        uint32_t maxErr = 0;
+
+        if( packedLen != 0 )
+        {
+            start = irsimNowUs();
+
+            for( uint32_t i = 0; i < kRounds; i++ )
+                rawUnpack( (const uint8_t *)raw, packedLen, unpacked, len );
+
+            unpack = irsimNowUs() - start;
+
+            if( !rawUnpack( (const uint8_t *)raw, packedLen, again, len ) ||
+                memcmp( unpacked, again, len * sizeof(again[0]) ) != 0 )
+            {
+                fprintf( stderr, "capture %zu doesn't unpack\n", c );
+                failed = true;
+            }
+
+            for( uint16_t i = 0; i < len; i++ )
+                maxErr = max( maxErr, (uint32_t)abs( (int32_t)unpacked[i] - (int32_t)cap.raw[i] ));
+        }
+
+        uint16_t rawBytes = len * 2;
+        uint16_t packedBytes = packedLen != 0 ? packedLen : rawBytes;
+        char sizes[2][24];
+
+        snprintf( sizes[0], sizeof(sizes[0]), "%u (%u pkt)", rawBytes, packets( frameLen( cap, rawBytes )));
+        snprintf( sizes[1], sizeof(sizes[1]), "%u (%u pkt)", packedBytes, packets( frameLen( cap, packedBytes )));
+
+        fprintf( stderr, "%-12s %6u %12s %12s %7.1fx %10.1f %12.1f %10u%s\n",
+                 typeToString( cap.protocol ).c_str(), len, sizes[0], sizes[1],
+                 (double)rawBytes / packedBytes, pack * 1000.0 / kRounds, unpack * 1000.0 / kRounds, maxErr,
+                 packedLen != 0 ? "" : "   not packed" );
+
+        totalRaw += rawBytes;
+        totalPacked += packedBytes;
+        totalTimings += len;
+        totalPack += pack;
+        totalUnpack += unpack;
+    }
+
+    fprintf( stderr, "\n%u timings, %u bytes packed into %u, %.1fx, pack %.1f Mtimings/s, unpack %.1f Mtimings/s\n",
+             totalTimings, totalRaw, totalPacked, (double)totalRaw / totalPacked,
+             totalPack != 0 ? (double)totalTimings * kRounds / totalPack : 0.0,
+             totalUnpack != 0 ? (double)totalTimings * kRounds / totalUnpack : 0.0 );
+
+    exit( failed ? 1 : 0 );
+}
+
+void loop()
+{
+}
@@ -0,0 +1,122 @@
+/*
+ *  IRsim:  waveform_bench.cpp - Cost of compiling a frame on every press against playing it from the waveform cache.
+ *
+ *  Builds as a sketch against the stand-ins in ../IRsim, with IRsend's
+ *  waveform cache. For every distinct capture of the corpus it times, per
+ *  press, compiling the frame and walking its timings the way sendRaw() does,
+ *  against finding the compiled waveform in the cache and walking that. The
+ *  library's encoders only run while transmitting, so compiling stands in for
+ *  regenerating the frame. It also shows what compiling does to the timings:
+ *  the distinct durations before and after, and the largest change made.
+ *
+ *  Example, from software/:
+ *    g++ -std=gnu++17 -O2 -Inative/IRsim -IIRsend/src -Icommon/IRcommon native/bench/waveform_bench.cpp \
+ *        IRsend/src/waveform.cpp common/IRcommon/rawpack.cpp native/IRsim/?*.cpp -o /tmp/waveform_bench
+ *    IRSIM_CAPTURES=native/bench/captures.txt IRSIM_QUIET=1 /tmp/waveform_bench
+ *  Results go to stderr, IRSIM_QUIET drops the cache's own Serial output.
+*/
+#include <Arduino.h>
+#include <IRutils.h>
+#include <set>
+#include "irsim.h"
+#include "irframe.h"
+#include "waveform.h"
+
+// Presses timed for each capture
+const uint32_t kPresses = 20000;
+
+static volatile uint32_t sink;
+
+// Stand-in for sendRaw(), which goes through the timings one by one
+static void play( const uint16_t *timings, uint16_t len )
+{
+    uint32_t sum = 0;
+
+    for( uint16_t i = 0; i < len; i++ )
+        sum += timings[i];
+
+    sink = sum;
+}
+
+static size_t distinct( const uint16_t *timings, uint16_t len )
+{
+    return std::set<uint16_t>( timings, timings + len ).size();
+}
+
+void setup()
+{
+    const std::vector<irsim_capture> &corpus = irsimCorpus();
+    struct_IRframe frame;
+
+    waveformInit( 38000, 40000 );
+
+    fprintf( stderr, "%-12s %6s %14s %14s %8s %10s %10s\n",
+             "protocol", "len", "compile ns", "cached ns", "speedup", "distinct", "max fix us" );
+
+    for( size_t c = 0; c < corpus.size(); c++ )
+    {
+        const irsim_capture &cap = corpus[c];
+
+        if( cap.id != (int)c || cap.raw.empty() || cap.raw.size() > IRFRAME_MAX_RAW )
+            continue;
+
+        memset( &frame, 0, sizeof(frame) );
+        frame.results.decode_type = cap.protocol;
+        frame.results.bits = cap.bits;
+        frame.raw = cap.raw.data();
+        frame.rawLen = cap.raw.size();
+
+        // Every press compiles the frame again, under a key of its own so
+        // the cache can't help
+        uint64_t start = irsimNowUs();
+
+        for( uint32_t i = 0; i < kPresses; i++ )
+        {
+            const struct_waveform *wf = waveformCompile( 0x80000000 + i, &frame );
+
+            play( wf->timings, wf->len );
+        }
+
+        uint64_t compile = irsimNowUs() - start;
+
+        // Compiled once, every press finds it in the cache
+        uint32_t key = c + 1;
+        const struct_waveform *wf = waveformCompile( key, &frame );
+
+        start = irsimNowUs();
+
+        for( uint32_t i = 0; i < kPresses; i++ )
+        {
+            wf = waveformGet( key );
+            play( wf->timings, wf->len );
+        }
+
+        uint64_t cached = irsimNowUs() - start;
+
+        uint32_t maxFix = 0;
+
+        for( uint16_t i = 0; i < wf->len; i++ )
+        {
+            uint32_t fix = abs( (int32_t)wf->timings[i] - (int32_t)cap.raw[i] );
+
+            if( fix > maxFix )
+                maxFix = fix;
+        }
+
+        char counts[24];
+
+        snprintf( counts, sizeof(counts), "%zu -> %zu", distinct( cap.raw.data(), cap.raw.size() ),
+                  distinct( wf->timings, wf->len ));
+
+        fprintf( stderr, "%-12s %6u %14.1f %14.1f %7.1fx %10s %10u\n",
+                 typeToString( cap.protocol ).c_str(), wf->len,
+                 compile * 1000.0 / kPresses, cached * 1000.0 / kPresses,
+                 cached != 0 ? (double)compile / cached : 0.0, counts, maxFix );
+    }
+
+    exit( 0 );
+}
+
+void loop()
+{
+}
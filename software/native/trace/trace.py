@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+"""
+Record, inspect and convert the capture traces of IRrecv.
+
+IRrecv traces its captures (t on its serial port) to flash or straight to the
+serial port, between the lines of its log (see IRrecv/src/trace.h). record
+picks the trace out of that output, from the port or from a file it was saved
+to, and echoes the text. A flash trace is sent with d and recorded the same
+way. show lists the captures of a trace, and corpus turns it into a capture
+corpus like ../bench/captures.txt.
+
+To replay a trace through the simulated nodes, at the pace it was recorded
+at or back to back:
+    ../bench/bench.py --trace living_room.bin --speed recorded
+    ../bench/bench.py --trace living_room.bin --speed max
+
+Examples:
+    ./trace.py record --port /dev/ttyUSB0 living_room.bin
+    ./trace.py record --input serial.log living_room.bin
+    ./trace.py show living_room.bin
+    ./trace.py corpus living_room.bin > living_room.txt
+"""
+import argparse
+import mmap
+import struct
+import sys
+
+# ==================== begin of trace format ====================
+# NOTE: Keep this section in sync with IRrecv/src/trace.h.
+
+TRACE_MAGIC = 0x52545249        # "IRTR"
+TRACE_VERSION = 1
+TRACE_SYNC = 0xA5
+
+TRACE_FLAG_NOISE = 0x01
+TRACE_FLAG_OVERFLOW = 0x02
+TRACE_FLAG_REPEAT = 0x04
+TRACE_FLAG_STATE = 0x08
+
+HDR = struct.Struct("<IBBHB3x")         # magic, version, hdrLen, bufSize, timeout
+REC = struct.Struct("<BBHIhHBH")        # sync, flags, len, captureUs, protocol, bits, resultLen, rawLen
+
+# ==================== end of trace format ====================
+
+MAGIC = struct.pack("<IB", TRACE_MAGIC, TRACE_VERSION)
+UNKNOWN = -1
+
+
+class Splitter:
+    """Picks the trace out of the serial output of IRrecv. The text is ASCII,
+    a record starts with TRACE_SYNC and a header with the magic, and each is
+    written whole between two lines of text."""
+
+    def __init__(self, out, text):
+        self.out = out
+        self.text = text
+        self.buf = bytearray()
+        self.header = False
+        self.records = 0
+
+    def feed(self, data):
+        self.buf += data
+        while self.buf:
+            if self.buf[0] == TRACE_SYNC:
+                if not self.record():
+                    return
+            elif self.buf.startswith(MAGIC[:len(self.buf)]):
+                if not self.hdr():
+                    return
+            else:
+                # Text, up to where a record or a header could start
+                end = 1
+                while end < len(self.buf) and self.buf[end] != TRACE_SYNC and self.buf[end] != MAGIC[0]:
+                    end += 1
+                self.text.write(self.buf[:end].decode("ascii", "replace"))
+                del self.buf[:end]
+
+    def hdr(self):
+        if len(self.buf) < HDR.size:
+            return False
+        if not self.buf.startswith(MAGIC):
+            self.text.write(self.buf[:1].decode("ascii", "replace"))
+            del self.buf[:1]
+            return True
+        hdrLen = self.buf[5]
+        if len(self.buf) < hdrLen:
+            return False
+        # A trace that goes on, from flash or after t, only has one header
+        if not self.header:
+            self.out.write(self.buf[:hdrLen])
+            self.header = True
+        del self.buf[:hdrLen]
+        return True
+
+    def record(self):
+        if len(self.buf) < REC.size:
+            return False
+        sync, flags, length, captureUs, protocol, bits, resultLen, rawLen = REC.unpack_from(self.buf)
+        if resultLen + rawLen * 2 > length:
+            # Not a record after all
+            self.text.write("?")
+            del self.buf[:1]
+            return True
+        if len(self.buf) < REC.size + length:
+            return False
+        if self.header:
+            self.out.write(self.buf[:REC.size + length])
+            self.records += 1
+        del self.buf[:REC.size + length]
+        return True
+
+
+def record(args):
+    with open(args.trace, "wb") as out:
+        splitter = Splitter(out, sys.stdout)
+        try:
+            if args.port:
+                import serial       # pyserial
+                port = serial.Serial(args.port, args.baud, timeout=0.1)
+                print("Recording, t on IRrecv starts the trace, Ctrl-C stops", file=sys.stderr)
+                while True:
+                    splitter.feed(port.read(4096))
+                    sys.stdout.flush()
+            else:
+                with open(args.input, "rb") if args.input != "-" else sys.stdin.buffer as f:
+                    for data in iter(lambda: f.read(65536), b""):
+                        splitter.feed(data)
+        except KeyboardInterrupt:
+            pass
+    print("\n%d captures recorded to %s" % (splitter.records, args.trace), file=sys.stderr)
+
+
+def captures(path):
+    """The header and the captures of a trace: (flags, captureUs, protocol,
+    bits, result, timings) each."""
+    with open(path, "rb") as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    magic, version, hdrLen, bufSize, timeout = HDR.unpack_from(data)
+    if magic != TRACE_MAGIC or version != TRACE_VERSION:
+        sys.exit("%s isn't a trace" % path)
+    result = []
+    pos = hdrLen
+    while pos + REC.size <= len(data):
+        sync, flags, length, captureUs, protocol, bits, resultLen, rawLen = REC.unpack_from(data, pos)
+        if sync != TRACE_SYNC or pos + REC.size + length > len(data):
+            print("%s is corrupt at byte %d" % (path, pos), file=sys.stderr)
+            break
+        start = pos + REC.size
+        timings = struct.unpack_from("<%dH" % rawLen, data, start + resultLen)
+        result.append((flags, captureUs, protocol, bits, bytes(data[start:start + resultLen]), timings))
+        pos = start + length
+    return (bufSize, timeout), result
+
+
+def label(flags, protocol, bits, result):
+    """What a capture decoded as, as in a capture corpus"""
+    if flags & TRACE_FLAG_NOISE:
+        return "NOISE 0 -"
+    if flags & TRACE_FLAG_STATE:
+        value = result.hex().upper()
+    elif protocol == UNKNOWN or len(result) != 8:
+        value = "-"
+    else:
+        value = "%X" % struct.unpack("<Q", result)[0]
+    name = "UNKNOWN" if protocol == UNKNOWN else str(protocol)
+    return "%s %d %s%s" % (name, bits, value, " repeat" if flags & TRACE_FLAG_REPEAT else "")
+
+
+def show(args):
+    (bufSize, timeout), caps = captures(args.trace)
+    print("capture buffer %d, timeout %d ms, %d captures" % (bufSize, timeout, len(caps)))
+    first = caps[0][1] if caps else 0
+    for flags, captureUs, protocol, bits, result, timings in caps:
+        print("%10.3f ms  %-40s %4d timings %8d us%s" % (
+            ((captureUs - first) & 0xFFFFFFFF) / 1000.0, label(flags, protocol, bits, result),
+            len(timings), sum(timings), "  overflow" if flags & TRACE_FLAG_OVERFLOW else ""))
+
+
+def corpus(args):
+    (bufSize, timeout), caps = captures(args.trace)
+    print("# %d captures traced by IRrecv, protocols are decode_type_t numbers" % len(caps))
+    for flags, captureUs, protocol, bits, result, timings in caps:
+        print("%s : %s" % (label(flags, protocol, bits, result), ",".join(str(t) for t in timings)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1],
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    p = commands.add_parser("record", help="record a trace from the serial output of IRrecv")
+    p.add_argument("trace", help="trace file to write")
+    source = p.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="serial port of IRrecv")
+    source.add_argument("--input", help="file the serial output was saved to, - for stdin")
+    p.add_argument("--baud", type=int, default=115200)
+    p.set_defaults(func=record)
+
+    p = commands.add_parser("show", help="list the captures of a trace")
+    p.add_argument("trace")
+    p.set_defaults(func=show)
+
+    p = commands.add_parser("corpus", help="turn a trace into a capture corpus")
+    p.add_argument("trace")
+    p.set_defaults(func=corpus)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,57 @@
+"""
+IR_Repeater protocol profiles, a PlatformIO extra script.
+
+By default both firmwares build all of IRremoteESP8266: decode() tries every
+decoder on every capture and the image carries every encoder. An environment
+that sets
+    custom_ir_profile = living_room
+    extra_scripts = pre:../profiles/profile.py
+is built for the protocols listed in ../profiles/living_room.txt instead. The
+script turns the list into the library's build flags, only the listed
+DECODE_xxx and SEND_xxx are enabled, along with DECODE_HASH and SEND_RAW so
+anything else is still relayed as UNKNOWN with its raw timings. The list
+itself goes to the firmware as IR_PROFILE_PROTOCOLS, in its order, for the
+table in profile.h.
+"""
+import os
+
+Import("env")  # noqa: F821 - provided by PlatformIO
+
+# Next to IRrecv and IRsend, SCons doesn't set __file__
+PROFILES = os.path.join(env.subst("$PROJECT_DIR"), "..", "profiles")  # noqa: F821
+
+
+def load(name):
+    path = os.path.join(PROFILES, name + ".txt")
+    protocols = []
+
+    with open(path) as f:
+        for line in f:
+            line = line.split("#")[0].strip()
+            if line and line not in protocols:
+                protocols.append(line)
+
+    if not protocols:
+        raise ValueError("%s lists no protocols" % path)
+
+    return protocols
+
+
+name = env.GetProjectOption("custom_ir_profile", "")  # noqa: F821
+
+if name:
+    protocols = load(name)
+    defines = [("_IR_ENABLE_DEFAULT_", "false"), ("DECODE_HASH", "true"), ("SEND_RAW", "true")]
+
+    for p in protocols:
+        defines += [("DECODE_" + p, "true"), ("SEND_" + p, "true")]
+
+    defines += [
+        ("IR_PROFILE", env.StringifyMacro(name)),  # noqa: F821
+        ("IR_PROFILE_PROTOCOLS", ",".join("decode_type_t::" + p for p in protocols)),
+    ]
+
+    # A pre script changes the global environment, the library is built
+    # with these too
+    env.Append(CPPDEFINES=defines)  # noqa: F821
+    print("IR protocol profile %s: %s" % (name, ", ".join(protocols)))
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""
+Flash and RAM of the IR_Repeater firmwares for every protocol profile.
+
+Builds IRrecv and IRsend for the d1_mini, once with the whole library and
+once for each profile in this directory (see profile.py), and prints how
+much flash and RAM each image takes. The decode time per frame of a build
+is the decode row of the IRrecv latency histograms, type s on its serial
+console: the dump starts with the profile it was built for.
+
+Example:
+    ./report.py
+    ./report.py living_room
+"""
+import argparse
+import glob
+import os
+import re
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SOFTWARE = os.path.dirname(HERE)
+
+SIZE = re.compile(r"^(RAM|Flash):.*\(used (\d+) bytes from (\d+) bytes\)", re.M)
+
+
+def build(project, env, profile):
+    command = ["pio", "run", "-d", os.path.join(SOFTWARE, project), "-e", env]
+    if profile:
+        command += ["-O", "custom_ir_profile=" + profile,
+                    "-O", "extra_scripts=pre:../profiles/profile.py"]
+
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+    if result.returncode != 0:
+        sys.stderr.write(result.stdout)
+        sys.exit("%s %s failed" % (project, profile or "all"))
+
+    return {m.group(1): int(m.group(2)) for m in SIZE.finditer(result.stdout)}
+
+
+def main():
+    profiles = sorted(os.path.splitext(os.path.basename(p))[0]
+                      for p in glob.glob(os.path.join(HERE, "*.txt")))
+
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1],
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--env", default="d1_mini", help="PlatformIO environment to build")
+    parser.add_argument("profiles", nargs="*", default=profiles,
+                        help="profiles to build, all of them by default")
+    args = parser.parse_args()
+
+    print("%-8s %-14s %10s %10s" % ("node", "profile", "flash", "RAM"))
+
+    for project in ("IRrecv", "IRsend"):
+        full = None
+
+        for profile in [None] + args.profiles:
+            size = build(project, args.env, profile)
+            line = "%-8s %-14s %10d %10d" % (project, profile or "all", size["Flash"], size["RAM"])
+
+            if full is None:
+                full = size
+            else:
+                line += "   %+d flash, %+d RAM" % (size["Flash"] - full["Flash"], size["RAM"] - full["RAM"])
+
+            print(line)
+
+
+if __name__ == "__main__":
+    main()